@@ -1,58 +1,68 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
 #include "datetime.h"
 
-static int days_in_month[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31, 31};
+/* days before the first day of each month in a common year */
+static const int days_before_month[] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365
+};
 
-int ymd2doy(int year, int month, int day)
+/*
+ * days from 1970-01-01 to year-month-day in the proleptic Gregorian
+ * calendar, closed form over 400-year eras.
+ */
+static long days_from_civil(long y, int m, int d)
 {
-    int i;
-    int doy = 0;
+    long era;
+    long yoe, doy, doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
 
-    for (i=0; i<month-1; i++) {
-        doy += days_in_month[i];
-        if(i==1 && ISLEAP(year)) doy++;
-    }
-    doy += day;
+/* inverse of days_from_civil */
+static void civil_from_days(long z, int *year, int *month, int *day)
+{
+    long era;
+    long doe, yoe, doy, mp;
+
+    z += 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *year = (int)(yoe + era * 400 + (*month <= 2));
+}
 
-    return doy;
+/* day of year of a date, -1 if month is out of 1 to 12 */
+int ymd2doy(int year, int month, int day)
+{
+    if (month < 1 || month > 12) return -1;
+    return days_before_month[month-1] + day
+         + ((month > 2 && ISLEAP(year)) ? 1 : 0);
 }
 
 void doy2ymd(int year, int doy, int *month, int *day)
 {
-    int i, dim, leap;
-
-    leap = ISLEAP(year);
-    *day = doy;
-    for (i=0; i<12; i++) {
-        dim = days_in_month[i];
-        if(leap && i==1) dim++;
-        if(*day <= dim) break;
-        *day -= dim;
-    }
-    *month = i + 1;
+    int y;
+
+    civil_from_days(days_from_civil(year, 1, 1) + doy - 1, &y, month, day);
 }
 
 /* convert julian date to epoch time */
 double day2epoch(int year, int doy)
 {
-    long cnt;
-    long days;
-
-    cnt = (long)year;
-    days = 0L;
-    if (cnt > 1970L) {
-        while (--cnt >= 1970L)
-            days += ISLEAP(cnt) ? 366 : 365;
-    } else if (cnt < 1970L) {
-        while (cnt < 1970L) {
-            days -= ISLEAP(cnt) ? 366 : 365;
-            cnt++;
-        }
-    }
-    return((days + ((doy - 1))) * 86400.);
+    return (days_from_civil(year, 1, 1) + (doy - 1)) * 86400.;
 }
 
 /* convert from human to epoch */
@@ -69,23 +79,18 @@ double datetime2epoch(int year, int jday, int hour, int min, int sec, int msec)
     return epoch;
 }
 
-#define mod(a,b) (a) - ((int)((a)/(b))) * (b)
 void epoch2datetime(double epoch,
                     int *year, int *doy, int *month, int *day,
                     int *hour, int *minute, int *second, int *msec)
 {
-    int diy;
+    long days;
     double secleft;
 
-    *doy = (int)(epoch / 86400.);
-    secleft = mod(epoch,86400.0);
+    days = (long)floor(epoch / 86400.);
+    secleft = epoch - days * 86400.;
     *hour = *minute = *second = *msec = 0;
 
     if(secleft != 0.0) {        /* compute hours minutes seconds */
-        if(secleft < 0) {   /* before 1970 */
-            *doy = *doy - 1;        /* subtract a day */
-            secleft += 86400;   /* add a day */
-        }
         *hour = (int)(secleft/3600);
         secleft = fmod(secleft,3600.0);
         *minute = (int)(secleft/60);
@@ -94,21 +99,33 @@ void epoch2datetime(double epoch,
         *msec = (int)(1000*(secleft+0.00049));
     }
 
-    if(*doy >= 0){
-        for( *year = 1970 ; ; (*year)++ ){
-            diy = ISLEAP(*year) ? 366:365;
-            if( *doy < (long)diy ) break;
-            (*doy) -= (long)diy;
-        }
-    } else {
-        for( *year = 1969 ; ; (*year)-- ){
-            diy = ISLEAP(*year) ? 366:365;
-            *doy += (long)diy;
-            if( *doy >= 0L ) break;
-        }
+    civil_from_days(days, year, month, day);
+    *doy = (int)(days - days_from_civil(*year, 1, 1)) + 1;
+}
+
+/*
+ * parse a time in DATETIME format (yyyy-mm-ddThh:mm:ss.mmm) or
+ * as seconds since 1970-01-01 into epoch time
+ *
+ * Return: 0 if success, -1 if failed
+ */
+int datetime_parse(const char *string, double *epoch)
+{
+    int year, month, day, hour, minute;
+    float secs;
+    char *end;
+
+    if (sscanf(string, "%d-%d-%dT%d:%d:%f",
+               &year, &month, &day, &hour, &minute, &secs) == 6) {
+        if (month < 1 || month > 12 || day < 1 || day > 31) return -1;
+        *epoch = datetime2epoch(year, ymd2doy(year, month, day),
+                                hour, minute, 0, 0) + secs;
+        return 0;
     }
-    *doy = *doy + 1L;
-    doy2ymd(*year, *doy, month, day);
+
+    *epoch = strtod(string, &end);
+    if (end == string || *end != '\0') return -1;
+    return 0;
 }
 
 DATETIME datetime_new(int year, int month, int day,
@@ -129,3 +146,27 @@ DATETIME datetime_new(int year, int month, int day,
 
     return dt;
 }
+
+/*
+ * reference time of a SAC header in seconds since 1970, 0 if undefined
+ */
+double datetime_ref(const SACHEAD *hd)
+{
+    if (hd->nzyear == SAC_INT_UNDEF) return 0.;
+    return datetime2epoch(hd->nzyear, hd->nzjday, hd->nzhour, hd->nzmin,
+                          hd->nzsec, hd->nzmsec);
+}
+
+/*
+ * format epoch time as yyyy-mm-ddThh:mm:ss.mmm into s of DATETIME_LENGTH,
+ * rounded to milliseconds first so that msec does not reach 1000
+ */
+void datetime_format(double epoch, char *s)
+{
+    int year, doy, month, day, hour, minute, second, msec;
+
+    epoch2datetime(floor(epoch * 1000. + 0.5) / 1000., &year, &doy, &month, &day,
+                   &hour, &minute, &second, &msec);
+    snprintf(s, DATETIME_LENGTH, "%04d-%02d-%02dT%02d:%02d:%02d.%03d",
+             year, month, day, hour, minute, second, msec);
+}
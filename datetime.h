@@ -1,6 +1,11 @@
 #ifndef _DATETIME_H
 #define _DATETIME_H
 
+#include "sacio.h"
+
+/* length of yyyy-mm-ddThh:mm:ss.mmm with the terminating null */
+#define DATETIME_LENGTH 24
+
 #define ISLEAP(yr) ((!((yr) % 4) && (yr) % 100) || !((yr) % 400))
 
 typedef struct date_time {
@@ -20,6 +25,9 @@ void doy2ymd(int year, int doy, int *month, int *day);
 double day2epoch(int year, int doy);
 double datetime2epoch(int year, int doy, int hour, int min, int sec, int msec);
 void epoch2datetime(double epoch,int *year,int *doy,int *month,int *day,int *hour,int *minute,int *second,int *msec);
+int datetime_parse(const char *string, double *epoch);
 DATETIME datetime_new(int year, int month, int day, int hour, int min, int sec, int msec);
+double datetime_ref(const SACHEAD *hd);
+void datetime_format(double epoch, char *s);
 
 #endif
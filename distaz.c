@@ -0,0 +1,100 @@
+/*******************************************************************************
+ *                                 distaz.c                                    *
+ *  Distance and azimuth between event and station on the WGS84 ellipsoid:     *
+ *      distaz           one pair of event and station                         *
+ *      distaz_batch     arrays of pairs, in parallel                          *
+ *                                                                             *
+ *  gcarc, az and baz are computed on the sphere of geocentric latitudes, as   *
+ *  SAC does. dist is the geodesic distance by the formula of Andoyer and      *
+ *  Lambert, within tens of meters of the exact geodesic for distances up to  *
+ *  10000 km. The formulas have no iteration or branch, so that loops over     *
+ *  many pairs can be vectorized.                                              *
+ *                                                                             *
+ ******************************************************************************/
+#include <math.h>
+#include "distaz.h"
+
+#define DEG2RAD (M_PI/180.)
+#define RAD2DEG (180./M_PI)
+
+static inline void distaz_one(double evla, double evlo, double stla, double stlo,
+                              double *gcarc, double *az, double *baz, double *dist);
+
+/*
+ *  distaz
+ *
+ *  IN:
+ *      double evla, evlo   :   latitude and longitude of event in degree
+ *      double stla, stlo   :   latitude and longitude of station in degree
+ *  OUT:
+ *      double *gcarc       :   great circle arc in degree
+ *      double *az          :   azimuth from event to station in degree
+ *      double *baz         :   back azimuth from station to event in degree
+ *      double *dist        :   distance in km
+ *
+ */
+void distaz(double evla, double evlo, double stla, double stlo,
+            double *gcarc, double *az, double *baz, double *dist)
+{
+    distaz_one(evla, evlo, stla, stlo, gcarc, az, baz, dist);
+}
+
+/*
+ *  distaz_batch: distaz of n pairs, element by element
+ */
+void distaz_batch(int n, const double *evla, const double *evlo,
+                  const double *stla, const double *stlo,
+                  double *gcarc, double *az, double *baz, double *dist)
+{
+    int i;
+
+    #pragma omp parallel for simd schedule(static) if (n > 4096)
+    for (i=0; i<n; i++)
+        distaz_one(evla[i], evlo[i], stla[i], stlo[i],
+                   &gcarc[i], &az[i], &baz[i], &dist[i]);
+}
+
+static inline void distaz_one(double evla, double evlo, double stla, double stlo,
+                              double *gcarc, double *az, double *baz, double *dist)
+{
+    const double f = DISTAZ_FLATTENING;
+    const double e2 = (1. - f) * (1. - f);  /* tan(geocentric)/tan(geographic) */
+    double th1, th2, dlo;
+    double s1, c1, s2, c2, sd, cd;
+    double x, y, sig;
+    double b1, b2, p, q, sp, cp, sq, cq, ss, sh, ch, X, Y;
+
+    dlo = (stlo - evlo) * DEG2RAD;
+    sd = sin(dlo);
+    cd = cos(dlo);
+
+    /* arc and azimuths on the sphere of geocentric latitudes */
+    th1 = atan(e2 * tan(evla * DEG2RAD));
+    th2 = atan(e2 * tan(stla * DEG2RAD));
+    s1 = sin(th1);  c1 = cos(th1);
+    s2 = sin(th2);  c2 = cos(th2);
+    x = c1*s2 - s1*c2*cd;
+    y = c2*sd;
+    *gcarc = atan2(sqrt(x*x + y*y), s1*s2 + c1*c2*cd) * RAD2DEG;
+    *az = fmod(atan2(y, x) * RAD2DEG + 360., 360.);
+    *baz = fmod(atan2(-c1*sd, c2*s1 - s2*c1*cd) * RAD2DEG + 360., 360.);
+
+    /* Andoyer-Lambert on parametric latitudes */
+    b1 = atan((1. - f) * tan(evla * DEG2RAD));
+    b2 = atan((1. - f) * tan(stla * DEG2RAD));
+    s1 = sin(b1);  c1 = cos(b1);
+    s2 = sin(b2);  c2 = cos(b2);
+    x = c1*s2 - s1*c2*cd;
+    y = c2*sd;
+    sig = atan2(sqrt(x*x + y*y), s1*s2 + c1*c2*cd);
+    p = 0.5 * (b1 + b2);
+    q = 0.5 * (b2 - b1);
+    sp = sin(p);  cp = cos(p);
+    sq = sin(q);  cq = cos(q);
+    ss = sin(sig);
+    sh = sin(0.5*sig);
+    ch = cos(0.5*sig);
+    X = (sig - ss) * sp*sp * cq*cq / (ch*ch);
+    Y = (sig + ss) * cp*cp * sq*sq / (sh*sh + 1e-300);
+    *dist = DISTAZ_RADIUS * (sig - 0.5 * f * (X + Y));
+}
@@ -0,0 +1,14 @@
+#ifndef _DISTAZ_H
+#define _DISTAZ_H
+
+/* WGS84 ellipsoid */
+#define DISTAZ_RADIUS       6378.137            /* equatorial radius in km */
+#define DISTAZ_FLATTENING   (1./298.257223563)
+
+void distaz(double evla, double evlo, double stla, double stlo,
+            double *gcarc, double *az, double *baz, double *dist);
+void distaz_batch(int n, const double *evla, const double *evlo,
+                  const double *stla, const double *stlo,
+                  double *gcarc, double *az, double *baz, double *dist);
+
+#endif
@@ -0,0 +1,191 @@
+/*******************************************************************************
+ *                                   fft.c                                     *
+ *  Radix-2 complex FFT:                                                       *
+ *      fft_size         smallest power of 2 not less than n                   *
+ *      fft_plan         plan of size n, created once and cached               *
+ *      fft_forward      forward transform in place                            *
+ *      fft_inverse      inverse transform in place, scaled by 1/n             *
+ *      fft_analytic     analytic signal x + iH(x) of a real series            *
+ *                                                                             *
+ *  Complex arrays are interleaved, re and im of element k in x[2k], x[2k+1].  *
+ *  Plans are never freed, so they can be shared by threads freely.            *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "fft.h"
+
+struct fft_plan {
+    int     n;
+    int     *rev;   /* bit reversed index */
+    float   *w;     /* exp(-2*pi*i*k/n), k < n/2, interleaved */
+};
+
+static FFTPLAN *plans[FFT_MAX_LOG2+1];
+static pthread_mutex_t plans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void transform(const FFTPLAN *p, float *x, int inverse);
+
+/*
+ *  fft_size: smallest power of 2 not less than n, 0 if too large
+ */
+int fft_size(int n)
+{
+    int m = 1;
+
+    while (m < n) {
+        if (m == (1 << FFT_MAX_LOG2)) return 0;
+        m <<= 1;
+    }
+    return m;
+}
+
+/*
+ *  fft_plan
+ *
+ *  Description: return plan of FFT of size n, a power of 2. The plan is
+ *      created by the first call for a size, and shared by later calls.
+ *
+ *  Return: plan, NULL if n is not a supported power of 2 or failed
+ *
+ */
+const FFTPLAN *fft_plan(int n)
+{
+    FFTPLAN *p;
+    int lg, k, j;
+
+    for (lg=0; lg<=FFT_MAX_LOG2 && (1<<lg) != n; lg++)
+        ;
+    if (lg > FFT_MAX_LOG2) {
+        fprintf(stderr, "FFT size %d is not a power of 2\n", n);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&plans_lock);
+    if ((p = plans[lg]) == NULL) {
+        if ((p = (FFTPLAN *)malloc(sizeof(FFTPLAN))) == NULL
+                || (p->rev = (int *)malloc(n * sizeof(int))) == NULL
+                || (p->w = (float *)malloc((n/2+1) * 2 * sizeof(float))) == NULL) {
+            fprintf(stderr, "Error in allocating memory for FFT of %d\n", n);
+            if (p != NULL) free(p->rev);
+            free(p);
+            pthread_mutex_unlock(&plans_lock);
+            return NULL;
+        }
+        p->n = n;
+        for (k=0; k<n; k++) {
+            int r = 0;
+            for (j=0; j<lg; j++)
+                if (k & (1<<j)) r |= 1 << (lg-1-j);
+            p->rev[k] = r;
+        }
+        for (k=0; k<n/2; k++) {
+            double a = -2. * M_PI * k / n;
+            p->w[2*k]   = (float)cos(a);
+            p->w[2*k+1] = (float)sin(a);
+        }
+        plans[lg] = p;
+    }
+    pthread_mutex_unlock(&plans_lock);
+    return p;
+}
+
+/*
+ *  fft_forward: X[k] = sum x[j] exp(-2*pi*i*j*k/n), in place
+ */
+void fft_forward(const FFTPLAN *p, float *x)
+{
+    transform(p, x, 0);
+}
+
+/*
+ *  fft_inverse: x[j] = 1/n sum X[k] exp(2*pi*i*j*k/n), in place
+ */
+void fft_inverse(const FFTPLAN *p, float *x)
+{
+    float s = 1.f / p->n;
+    int k;
+
+    transform(p, x, 1);
+    for (k=0; k<2*p->n; k++) x[k] *= s;
+}
+
+/*
+ *  fft_analytic
+ *
+ *  Description: analytic signal z = x + iH(x) of n real samples, with
+ *      the series padded by zeros to the size of plan p.
+ *
+ *  IN:
+ *      const FFTPLAN *p    :   plan of size not less than n
+ *      const float   *x    :   n real samples
+ *  OUT:
+ *      float         *z    :   complex series of the size of plan p,
+ *                              of which the first n are the signal
+ *
+ */
+void fft_analytic(const FFTPLAN *p, const float *x, int n, float *z)
+{
+    int k, m = p->n;
+
+    for (k=0; k<n; k++) {
+        z[2*k] = x[k];
+        z[2*k+1] = 0.f;
+    }
+    memset(z + 2*n, 0, (size_t)(m - n) * 2 * sizeof(float));
+    /* a single sample is its own analytic signal */
+    if (m < 2) return;
+
+    fft_forward(p, z);
+    /* double positive frequencies and drop negative ones */
+    for (k=1; k<m/2; k++) {
+        z[2*k] *= 2.f;
+        z[2*k+1] *= 2.f;
+    }
+    memset(z + m + 2, 0, (size_t)(m/2 - 1) * 2 * sizeof(float));
+    fft_inverse(p, z);
+}
+
+/*
+ *  transform:
+ *      iterative radix-2 decimation in time, conjugate twiddles if inverse
+ */
+static void transform(const FFTPLAN *p, float *x, int inverse)
+{
+    int n = p->n;
+    int k, len;
+    float sgn = inverse ? -1.f : 1.f;
+
+    for (k=0; k<n; k++) {
+        int r = p->rev[k];
+        if (r > k) {
+            float t;
+            t = x[2*k];   x[2*k]   = x[2*r];   x[2*r]   = t;
+            t = x[2*k+1]; x[2*k+1] = x[2*r+1]; x[2*r+1] = t;
+        }
+    }
+
+    for (len=2; len<=n; len<<=1) {
+        int half = len / 2;
+        int step = n / len;
+        int i, j;
+        for (i=0; i<n; i+=len) {
+            float *a = x + 2*i;
+            float *b = x + 2*(i+half);
+            #pragma omp simd
+            for (j=0; j<half; j++) {
+                float wr = p->w[2*j*step];
+                float wi = sgn * p->w[2*j*step+1];
+                float tr = b[2*j]*wr - b[2*j+1]*wi;
+                float ti = b[2*j]*wi + b[2*j+1]*wr;
+                b[2*j]   = a[2*j] - tr;
+                b[2*j+1] = a[2*j+1] - ti;
+                a[2*j]   += tr;
+                a[2*j+1] += ti;
+            }
+        }
+    }
+}
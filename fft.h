@@ -0,0 +1,21 @@
+/*
+ *  fft.h
+ *
+ *  Radix-2 complex FFT with plans cached per size.
+ *
+ */
+#ifndef _FFT_H
+#define _FFT_H
+
+/* Largest supported FFT size is 1 << FFT_MAX_LOG2 */
+#define FFT_MAX_LOG2    28
+
+typedef struct fft_plan FFTPLAN;
+
+int fft_size(int n);
+const FFTPLAN *fft_plan(int n);
+void fft_forward(const FFTPLAN *p, float *x);
+void fft_inverse(const FFTPLAN *p, float *x);
+void fft_analytic(const FFTPLAN *p, const float *x, int n, float *z);
+
+#endif
@@ -0,0 +1,430 @@
+/*******************************************************************************
+ *                                  filter.c                                   *
+ *  Filters of SAC data:                                                       *
+ *      filter_butter       design Butterworth filter as cascaded biquads      *
+ *      filter_free         free a Butterworth filter                          *
+ *      filter_apply        filter one channel, optionally zero phase          *
+ *      filter_apply_multi  filter channels of the same length together,      *
+ *                          FILTER_LANES channels per vectorized loop          *
+ *      filter_fir          windowed-sinc FIR filter, created once and cached  *
+ *      filter_fir_apply    zero-phase FIR filtering by overlap-save FFT       *
+ *                                                                             *
+ *  Butterworth filters are designed from analog prototypes by the bilinear    *
+ *  transform with prewarped corners, and run in transposed direct form II     *
+ *  in double precision. filter_apply and filter_apply_multi give the same     *
+ *  results.                                                                   *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <pthread.h>
+#include "filter.h"
+#include "fft.h"
+
+/* biquads of a bandpass filter of the largest order */
+#define MAX_SECTION FILTER_MAX_ORDER
+/* samples of channels interleaved at a time */
+#define LANE_BLOCK  256
+
+struct filter {
+    int     nsec;
+    double  b[MAX_SECTION][3];  /* b0 + b1/z + b2/z^2 */
+    double  a[MAX_SECTION][2];  /*  1 + a1/z + a2/z^2 */
+};
+
+struct fir_filter {
+    int     type, ntap;
+    double  f1, f2, delta;
+    int     nfft;
+    const FFTPLAN *plan;
+    float   *h;             /* spectrum of taps, nfft complex */
+    struct fir_filter *next;
+};
+
+/* FIR filters designed so far */
+static FIRFILTER *firs = NULL;
+static pthread_mutex_t firs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void add_section (FILTER *f, const double *num, const double *den, double k);
+static void run_lanes   (const FILTER *f, float **x, int nl, int n, int reverse);
+static int  check_band  (int type, double f1, double f2, double delta);
+
+/*
+ *  filter_butter
+ *
+ *  Description: design a Butterworth filter
+ *
+ *  IN:
+ *      int     type    :   FILTER_LOWPASS, FILTER_HIGHPASS or FILTER_BANDPASS
+ *      int     order   :   order, 1 to FILTER_MAX_ORDER
+ *      double  f1      :   corner frequency, the low one of bandpass
+ *      double  f2      :   high corner frequency of bandpass
+ *      double  delta   :   sampling interval
+ *
+ *  Return: filter, NULL if failed
+ *
+ */
+FILTER *filter_butter(int type, int order, double f1, double f2, double delta)
+{
+    FILTER *f;
+    double k = 2. / delta;
+    double w1, w2, w0 = 0., bw = 0.;
+    double num[3], den[3];
+    int i;
+
+    if (order < 1 || order > FILTER_MAX_ORDER) {
+        fprintf(stderr, "Order of filter must be 1 to %d\n", FILTER_MAX_ORDER);
+        return NULL;
+    }
+    if (check_band(type, f1, f2, delta) != 0) return NULL;
+    if ((f = (FILTER *)calloc(1, sizeof(FILTER))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        return NULL;
+    }
+
+    /* prewarped corners */
+    w1 = k * tan(M_PI * f1 * delta);
+    w2 = (type == FILTER_BANDPASS) ? k * tan(M_PI * f2 * delta) : 0.;
+    if (type == FILTER_BANDPASS) {
+        w0 = sqrt(w1 * w2);
+        bw = w2 - w1;
+    }
+
+    /* conjugate pairs of poles of the prototype */
+    for (i=0; i<order/2; i++) {
+        double complex p = cexp(I * M_PI * (2*i + order + 1) / (2. * order));
+        if (type == FILTER_BANDPASS) {
+            /* each pole p maps to the roots of s^2 - p*bw*s + w0^2 */
+            double complex q = p * bw;
+            double complex d = csqrt(q * q - 4. * w0 * w0);
+            double complex s[2];
+            int j;
+            s[0] = 0.5 * (q + d);
+            s[1] = 0.5 * (q - d);
+            for (j=0; j<2; j++) {
+                num[0] = 0.; num[1] = bw; num[2] = 0.;
+                den[0] = 1.; den[1] = -2. * creal(s[j]);
+                den[2] = creal(s[j]) * creal(s[j]) + cimag(s[j]) * cimag(s[j]);
+                add_section(f, num, den, k);
+            }
+        } else {
+            den[0] = 1.; den[1] = -2. * creal(p) * w1; den[2] = w1 * w1;
+            num[0] = (type == FILTER_HIGHPASS) ? 1. : 0.;
+            num[1] = 0.;
+            num[2] = (type == FILTER_HIGHPASS) ? 0. : w1 * w1;
+            add_section(f, num, den, k);
+        }
+    }
+    /* real pole -1 of odd order */
+    if (order % 2) {
+        if (type == FILTER_BANDPASS) {
+            num[0] = 0.; num[1] = bw; num[2] = 0.;
+            den[0] = 1.; den[1] = bw; den[2] = w0 * w0;
+        } else {
+            num[0] = 0.;
+            num[1] = (type == FILTER_HIGHPASS) ? 1. : 0.;
+            num[2] = (type == FILTER_HIGHPASS) ? 0. : w1;
+            den[0] = 0.; den[1] = 1.; den[2] = w1;
+        }
+        add_section(f, num, den, k);
+    }
+    return f;
+}
+
+/*
+ *  filter_free: free a Butterworth filter
+ */
+void filter_free(FILTER *f)
+{
+    free(f);
+}
+
+/*
+ *  filter_apply
+ *
+ *  Description: filter n samples in place, forward and then backward if
+ *      zerophase, which doubles the order of the filter.
+ *
+ */
+void filter_apply(const FILTER *f, float *x, int n, int zerophase)
+{
+    double s1[MAX_SECTION] = {0.}, s2[MAX_SECTION] = {0.};
+    int pass, i, j;
+
+    for (pass=0; pass<(zerophase ? 2 : 1); pass++) {
+        memset(s1, 0, sizeof(s1));
+        memset(s2, 0, sizeof(s2));
+        for (i=0; i<n; i++) {
+            int k = pass ? n - 1 - i : i;
+            double v = x[k];
+            for (j=0; j<f->nsec; j++) {
+                double y = f->b[j][0] * v + s1[j];
+                s1[j] = f->b[j][1] * v - f->a[j][0] * y + s2[j];
+                s2[j] = f->b[j][2] * v - f->a[j][1] * y;
+                v = y;
+            }
+            x[k] = (float)v;
+        }
+    }
+}
+
+/*
+ *  filter_apply_multi
+ *
+ *  Description: filter nchan channels of n samples in place. Samples of
+ *      FILTER_LANES channels are interleaved block by block, so that the
+ *      recursion runs on all of them in one vectorized loop.
+ *
+ */
+void filter_apply_multi(const FILTER *f, float **x, int nchan, int n, int zerophase)
+{
+    int c, nl;
+
+    for (c=0; c<nchan; c+=FILTER_LANES) {
+        nl = (nchan - c < FILTER_LANES) ? nchan - c : FILTER_LANES;
+        if (nl == 1) {
+            filter_apply(f, x[c], n, zerophase);
+            continue;
+        }
+        run_lanes(f, x + c, nl, n, 0);
+        if (zerophase) run_lanes(f, x + c, nl, n, 1);
+    }
+}
+
+/*
+ *  filter_fir
+ *
+ *  Description: FIR filter of ntap taps, windowed sinc with Hamming
+ *      window. Filters are designed with the spectrum of their taps at
+ *      the first call for a set of parameters, and shared by later calls.
+ *
+ *  IN:
+ *      int     type    :   FILTER_LOWPASS, FILTER_HIGHPASS or FILTER_BANDPASS
+ *      int     ntap    :   number of taps, made odd
+ *      double  f1      :   corner frequency, the low one of bandpass
+ *      double  f2      :   high corner frequency of bandpass
+ *      double  delta   :   sampling interval
+ *
+ *  Return: filter, NULL if failed
+ *
+ */
+const FIRFILTER *filter_fir(int type, int ntap, double f1, double f2, double delta)
+{
+    FIRFILTER *f;
+    double *h;
+    int k, c;
+
+    if (ntap < 1 || check_band(type, f1, f2, delta) != 0) return NULL;
+    if (ntap % 2 == 0) ntap++;
+    if (type != FILTER_BANDPASS) f2 = 0.;
+
+    pthread_mutex_lock(&firs_lock);
+    for (f=firs; f!=NULL; f=f->next)
+        if (f->type == type && f->ntap == ntap && f->f1 == f1
+                && f->f2 == f2 && f->delta == delta) break;
+    if (f != NULL) {
+        pthread_mutex_unlock(&firs_lock);
+        return f;
+    }
+
+    h = NULL;
+    if ((f = (FIRFILTER *)malloc(sizeof(FIRFILTER))) == NULL
+            || (f->nfft = fft_size(4 * ntap < 1024 ? 1024 : 4 * ntap)) == 0
+            || (f->plan = fft_plan(f->nfft)) == NULL
+            || (f->h = (float *)calloc(2 * f->nfft, sizeof(float))) == NULL
+            || (h = (double *)malloc(ntap * sizeof(double))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for FIR of %d taps\n", ntap);
+        if (f != NULL && f->nfft != 0 && f->plan != NULL) free(f->h);
+        free(f);
+        pthread_mutex_unlock(&firs_lock);
+        return NULL;
+    }
+    f->type = type;
+    f->ntap = ntap;
+    f->f1 = f1;
+    f->f2 = f2;
+    f->delta = delta;
+
+    /* ideal response, lowpass of f2 (or all-pass) minus lowpass of f1 */
+    c = ntap / 2;
+    for (k=0; k<ntap; k++) {
+        double t = k - c;
+        double lp1 = (t == 0.) ? 2. * f1 * delta : sin(2. * M_PI * f1 * delta * t) / (M_PI * t);
+        double lp2 = (t == 0.) ? 2. * f2 * delta : sin(2. * M_PI * f2 * delta * t) / (M_PI * t);
+        if (type == FILTER_LOWPASS)
+            h[k] = lp1;
+        else if (type == FILTER_HIGHPASS)
+            h[k] = ((t == 0.) ? 1. : 0.) - lp1;
+        else
+            h[k] = lp2 - lp1;
+        if (ntap > 1) h[k] *= 0.54 - 0.46 * cos(2. * M_PI * k / (ntap - 1));
+        f->h[2*k] = (float)h[k];
+    }
+    free(h);
+    fft_forward(f->plan, f->h);
+
+    f->next = firs;
+    firs = f;
+    pthread_mutex_unlock(&firs_lock);
+    return f;
+}
+
+/*
+ *  filter_fir_apply
+ *
+ *  Description: filter n samples in place by a FIR filter, delayed by
+ *      half of its length so that the phase is zero. Segments of data are
+ *      convolved by overlap-save two at a time, as real and imaginary
+ *      parts of one complex FFT.
+ *
+ *  Return: 0 if success, -1 if failed
+ *
+ */
+int filter_fir_apply(const FIRFILTER *f, float *x, int n)
+{
+    int nfft = f->nfft, m = f->ntap;
+    int l = nfft - m + 1;           /* outputs per segment */
+    int d = m / 2;
+    float *z, *y;
+    int p, t, u;
+
+    if (n <= 0) return 0;
+    if ((z = (float *)malloc(2 * nfft * sizeof(float))) == NULL
+            || (y = (float *)malloc(n * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for FIR filtering\n");
+        free(z);
+        return -1;
+    }
+
+    /* outputs p to p+2l-1 of the full convolution, y[k] is output k+d */
+    for (p=d; p<d+n; p+=2*l) {
+        int s = p - m + 1;
+        for (t=0; t<nfft; t++) {
+            int i1 = s + t, i2 = s + t + l;
+            z[2*t]   = (i1 >= 0 && i1 < n) ? x[i1] : 0.f;
+            z[2*t+1] = (i2 >= 0 && i2 < n) ? x[i2] : 0.f;
+        }
+        fft_forward(f->plan, z);
+        #pragma omp simd
+        for (t=0; t<nfft; t++) {
+            float re = z[2*t] * f->h[2*t]   - z[2*t+1] * f->h[2*t+1];
+            float im = z[2*t] * f->h[2*t+1] + z[2*t+1] * f->h[2*t];
+            z[2*t] = re;
+            z[2*t+1] = im;
+        }
+        fft_inverse(f->plan, z);
+        for (u=0; u<l; u++) {
+            int k = p - d + u;
+            if (k < n) y[k] = z[2*(m-1+u)];
+            if (k + l < n) y[k+l] = z[2*(m-1+u)+1];
+        }
+    }
+
+    memcpy(x, y, n * sizeof(float));
+    free(y);
+    free(z);
+    return 0;
+}
+
+/*
+ *  add_section:
+ *      append the bilinear transform, s = k(1-1/z)/(1+1/z), of analog
+ *      section (num[0]s^2 + num[1]s + num[2]) / (den[0]s^2 + den[1]s + den[2]),
+ *      of first order if den[0] is 0
+ */
+static void add_section(FILTER *f, const double *num, const double *den, double k)
+{
+    double *b = f->b[f->nsec];
+    double *a = f->a[f->nsec];
+    double k2 = k * k, d0;
+
+    if (den[0] == 0.) {
+        d0 = den[1] * k + den[2];
+        b[0] = (num[1] * k + num[2]) / d0;
+        b[1] = (num[2] - num[1] * k) / d0;
+        b[2] = 0.;
+        a[0] = (den[2] - den[1] * k) / d0;
+        a[1] = 0.;
+    } else {
+        d0 = den[0] * k2 + den[1] * k + den[2];
+        b[0] = (num[0] * k2 + num[1] * k + num[2]) / d0;
+        b[1] = 2. * (num[2] - num[0] * k2) / d0;
+        b[2] = (num[0] * k2 - num[1] * k + num[2]) / d0;
+        a[0] = 2. * (den[2] - den[0] * k2) / d0;
+        a[1] = (den[0] * k2 - den[1] * k + den[2]) / d0;
+    }
+    f->nsec++;
+}
+
+/*
+ *  run_lanes:
+ *      one pass of the filter over nl channels, with samples interleaved
+ *      in blocks of LANE_BLOCK, and unused lanes kept zero
+ */
+static void run_lanes(const FILTER *f, float **x, int nl, int n, int reverse)
+{
+    double s1[MAX_SECTION][FILTER_LANES], s2[MAX_SECTION][FILTER_LANES];
+    double buf[LANE_BLOCK][FILTER_LANES];
+    int i0, i, j, l, m;
+
+    memset(s1, 0, sizeof(s1));
+    memset(s2, 0, sizeof(s2));
+    memset(buf, 0, sizeof(buf));
+
+    for (i0=0; i0<n; i0+=LANE_BLOCK) {
+        m = (n - i0 < LANE_BLOCK) ? n - i0 : LANE_BLOCK;
+        for (l=0; l<nl; l++) {
+            const float *xl = x[l];
+            for (i=0; i<m; i++)
+                buf[i][l] = xl[reverse ? n - 1 - (i0 + i) : i0 + i];
+        }
+
+        for (j=0; j<f->nsec; j++) {
+            const double b0 = f->b[j][0], b1 = f->b[j][1], b2 = f->b[j][2];
+            const double a1 = f->a[j][0], a2 = f->a[j][1];
+            double p1[FILTER_LANES], p2[FILTER_LANES];
+            memcpy(p1, s1[j], sizeof(p1));
+            memcpy(p2, s2[j], sizeof(p2));
+            for (i=0; i<m; i++) {
+                double *v = buf[i];
+                #pragma omp simd
+                for (l=0; l<FILTER_LANES; l++) {
+                    double y = b0 * v[l] + p1[l];
+                    p1[l] = b1 * v[l] - a1 * y + p2[l];
+                    p2[l] = b2 * v[l] - a2 * y;
+                    v[l] = y;
+                }
+            }
+            memcpy(s1[j], p1, sizeof(p1));
+            memcpy(s2[j], p2, sizeof(p2));
+        }
+
+        for (l=0; l<nl; l++) {
+            float *xl = x[l];
+            for (i=0; i<m; i++)
+                xl[reverse ? n - 1 - (i0 + i) : i0 + i] = (float)buf[i][l];
+        }
+    }
+}
+
+/*
+ *  check_band: check corner frequencies against the Nyquist frequency
+ */
+static int check_band(int type, double f1, double f2, double delta)
+{
+    double fn = 0.5 / delta;
+
+    if (type < FILTER_LOWPASS || type > FILTER_BANDPASS || delta <= 0.) {
+        fprintf(stderr, "Invalid type of filter or sampling interval\n");
+        return -1;
+    }
+    if (f1 <= 0. || f1 >= fn
+            || (type == FILTER_BANDPASS && (f2 <= f1 || f2 >= fn))) {
+        fprintf(stderr, "Invalid corner frequencies for Nyquist %g Hz\n", fn);
+        return -1;
+    }
+    return 0;
+}
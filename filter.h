@@ -0,0 +1,30 @@
+/*
+ *  filter.h
+ *
+ *  Butterworth filters as cascaded biquads, and FIR filters by FFT.
+ *
+ */
+#ifndef _FILTER_H
+#define _FILTER_H
+
+/* types of band */
+#define FILTER_LOWPASS  0
+#define FILTER_HIGHPASS 1
+#define FILTER_BANDPASS 2
+
+/* largest order of Butterworth filters */
+#define FILTER_MAX_ORDER    10
+/* channels filtered together by filter_apply_multi */
+#define FILTER_LANES        8
+
+typedef struct filter FILTER;
+typedef struct fir_filter FIRFILTER;
+
+FILTER *filter_butter(int type, int order, double f1, double f2, double delta);
+void filter_free(FILTER *f);
+void filter_apply(const FILTER *f, float *x, int n, int zerophase);
+void filter_apply_multi(const FILTER *f, float **x, int nchan, int n, int zerophase);
+const FIRFILTER *filter_fir(int type, int ntap, double f1, double f2, double delta);
+int filter_fir_apply(const FIRFILTER *f, float *x, int n);
+
+#endif
@@ -0,0 +1,271 @@
+/*******************************************************************************
+ *                                   mseed.c                                   *
+ *  Parsing and decoding of miniSEED 2 data records:                           *
+ *      mseed_parse   fixed header and blockettes 1000 and 1001 of a record    *
+ *      mseed_decode  samples of a record as floats                            *
+ *                                                                             *
+ *  The byte order of headers is found from the year of the start time, and   *
+ *  that of data from blockette 1000, which every record must have. Data      *
+ *  encoded as 16 or 32 bit integers, 32 or 64 bit floats, Steim-1 or Steim-2  *
+ *  are decoded.                                                               *
+ *                                                                             *
+ *  Steim data are frames of 16 words, the first word holding 2-bit codes of   *
+ *  the others. Differences of each frame are unpacked into an array first,    *
+ *  by shifts of constant widths for each code, and then integrated from the   *
+ *  forward constant X0, the first difference of a record being unused.        *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "mseed.h"
+#include "datetime.h"
+
+/* largest number of differences of a Steim frame */
+#define STEIM_MAX_DIFF  (15 * 7)
+
+static uint32_t rd32      (const unsigned char *p, int big);
+static unsigned rd16      (const unsigned char *p, int big);
+static void     copy_field(char *s, const unsigned char *p, int n);
+static int      steim     (const MSRECORD *r, int version, float *out);
+
+/*
+ *  mseed_parse
+ *
+ *  Description: parse the record at p of at most len bytes
+ *
+ *  IN:
+ *      const unsigned char *p  :   start of record
+ *      size_t             len  :   bytes available from p
+ *  OUT:
+ *      MSRECORD            *r  :   record, with rec pointing to p
+ *
+ *  Return: 0 if success, -1 if not a valid data record
+ *
+ */
+int mseed_parse(const unsigned char *p, size_t len, MSRECORD *r)
+{
+    unsigned year, doy, blk, type;
+    int big, fact, mult, nblk, usec = 0, i;
+    int32_t corr;
+
+    if (len < MSEED_HEAD || strchr("DRQM", p[6]) == NULL || p[6] == '\0')
+        return -1;
+    year = rd16(p + 20, 1);
+    big = (year >= 1900 && year <= 2100);
+    if (!big) {
+        year = rd16(p + 20, 0);
+        if (year < 1900 || year > 2100) return -1;
+    }
+    doy = rd16(p + 22, big);
+    if (doy < 1 || doy > 366 || p[24] > 23 || p[25] > 59 || p[26] > 60)
+        return -1;
+
+    copy_field(r->sta, p + 8, 5);
+    copy_field(r->loc, p + 13, 2);
+    copy_field(r->chan, p + 15, 3);
+    copy_field(r->net, p + 18, 2);
+    r->nsamp = rd16(p + 30, big);
+    fact = (int16_t)rd16(p + 32, big);
+    mult = (int16_t)rd16(p + 34, big);
+    nblk = p[39];
+    corr = (int32_t)rd32(p + 40, big);
+    r->offset = rd16(p + 44, big);
+    r->rec = p;
+
+    /* blockettes 1000 and 1001 */
+    r->reclen = 0;
+    for (i=0, blk=rd16(p + 46, big); i<nblk && blk>=MSEED_HEAD && blk+8<=len; i++) {
+        type = rd16(p + blk, big);
+        if (type == 1000) {
+            r->encoding = p[blk+4];
+            r->big = (p[blk+5] == 1);
+            r->reclen = (p[blk+6] < 31) ? 1 << p[blk+6] : 0;
+        } else if (type == 1001) {
+            usec = (int8_t)p[blk+5];
+        }
+        blk = rd16(p + blk + 2, big);
+        if (blk == 0) break;
+    }
+    if (r->reclen < MSEED_HEAD || (size_t)r->reclen > len || r->offset > r->reclen
+            || (r->nsamp > 0 && r->offset < MSEED_HEAD))
+        return -1;
+
+    if (fact > 0 && mult > 0)
+        r->delta = 1. / ((double)fact * mult);
+    else if (fact > 0 && mult < 0)
+        r->delta = -(double)mult / fact;
+    else if (fact < 0 && mult > 0)
+        r->delta = -(double)fact / mult;
+    else if (fact < 0 && mult < 0)
+        r->delta = (double)fact * mult;
+    else
+        r->delta = 0.;
+
+    r->start = datetime2epoch(year, doy, p[24], p[25], p[26], 0)
+             + rd16(p + 28, big) * 1e-4 + usec * 1e-6;
+    /* time correction, unless applied already */
+    if ((p[36] & 0x02) == 0) r->start += corr * 1e-4;
+    return 0;
+}
+
+/*
+ *  mseed_decode
+ *
+ *  Description: decode nsamp samples of a record into out
+ *
+ *  Return: number of samples, -1 if failed
+ *
+ */
+int mseed_decode(const MSRECORD *r, float *out)
+{
+    const unsigned char *d = r->rec + r->offset;
+    const int n = r->nsamp, big = r->big;
+    const size_t size = (size_t)(r->reclen - r->offset);
+    int i;
+
+    switch (r->encoding) {
+        case MSEED_INT16:
+            if ((size_t)n * 2 > size) break;
+            #pragma omp simd
+            for (i=0; i<n; i++) out[i] = (float)(int16_t)rd16(d + 2*i, big);
+            return n;
+        case MSEED_INT32:
+            if ((size_t)n * 4 > size) break;
+            #pragma omp simd
+            for (i=0; i<n; i++) out[i] = (float)(int32_t)rd32(d + 4*i, big);
+            return n;
+        case MSEED_FLOAT32:
+            if ((size_t)n * 4 > size) break;
+            for (i=0; i<n; i++) {
+                uint32_t u = rd32(d + 4*i, big);
+                memcpy(out + i, &u, 4);
+            }
+            return n;
+        case MSEED_FLOAT64:
+            if ((size_t)n * 8 > size) break;
+            for (i=0; i<n; i++) {
+                uint64_t u = big ? (uint64_t)rd32(d + 8*i, 1) << 32 | rd32(d + 8*i + 4, 1)
+                                 : (uint64_t)rd32(d + 8*i + 4, 0) << 32 | rd32(d + 8*i, 0);
+                double v;
+                memcpy(&v, &u, 8);
+                out[i] = (float)v;
+            }
+            return n;
+        case MSEED_STEIM1:
+            return steim(r, 1, out);
+        case MSEED_STEIM2:
+            return steim(r, 2, out);
+        default:
+            fprintf(stderr, "Unsupported encoding %d of %s.%s.%s.%s\n",
+                    r->encoding, r->net, r->sta, r->loc, r->chan);
+            return -1;
+    }
+    fprintf(stderr, "Record of %s.%s.%s.%s too short for %d samples\n",
+            r->net, r->sta, r->loc, r->chan, n);
+    return -1;
+}
+
+/*
+ *  unpack: n signed differences of b bits of word w, most significant first
+ */
+static inline int unpack(uint32_t w, int n, int b, int32_t *d)
+{
+    int q;
+    for (q=0; q<n; q++)
+        d[q] = (int32_t)(w << (32 - b - (n - 1 - q) * b)) >> (32 - b);
+    return n;
+}
+
+/*
+ *  steim: decode Steim-1 or Steim-2 data of a record
+ */
+static int steim(const MSRECORD *r, int version, float *out)
+{
+    const unsigned char *p = r->rec + r->offset;
+    const int nframe = (r->reclen - r->offset) / 64, n = r->nsamp, big = r->big;
+    int32_t d[STEIM_MAX_DIFF], x0, xn, acc = 0;
+    int f, j, q, nd, k = 0;
+
+    if (nframe < 1) return -1;
+    x0 = (int32_t)rd32(p + 4, big);
+    xn = (int32_t)rd32(p + 8, big);
+
+    for (f=0; f<nframe && k<n; f++) {
+        const unsigned char *fr = p + 64 * f;
+        uint32_t ctrl = rd32(fr, big);
+
+        nd = 0;
+        for (j=1; j<16; j++) {
+            uint32_t w = rd32(fr + 4 * j, big);
+            int c = (ctrl >> (30 - 2 * j)) & 3;
+            int dnib = w >> 30;
+            if (c == 0) continue;
+            if (c == 1) {
+                nd += unpack(w, 4, 8, d + nd);
+            } else if (version == 1) {
+                nd += (c == 2) ? unpack(w, 2, 16, d + nd) : unpack(w, 1, 32, d + nd);
+            } else if (c == 2) {
+                if (dnib == 1)      nd += unpack(w, 1, 30, d + nd);
+                else if (dnib == 2) nd += unpack(w, 2, 15, d + nd);
+                else if (dnib == 3) nd += unpack(w, 3, 10, d + nd);
+                else goto invalid;
+            } else {
+                if (dnib == 0)      nd += unpack(w, 5, 6, d + nd);
+                else if (dnib == 1) nd += unpack(w, 6, 5, d + nd);
+                else if (dnib == 2) nd += unpack(w, 7, 4, d + nd);
+                else goto invalid;
+            }
+        }
+
+        /* integrate differences of the frame */
+        q = 0;
+        if (k == 0 && nd > 0) {
+            acc = x0;
+            out[k++] = (float)acc;
+            q = 1;
+        }
+        if (nd - q > n - k) nd = n - k + q;
+        for (; q<nd; q++) {
+            acc += d[q];
+            out[k++] = (float)acc;
+        }
+    }
+
+    if (k < n) {
+        fprintf(stderr, "Steim data of %s.%s.%s.%s short of %d samples\n",
+                r->net, r->sta, r->loc, r->chan, n);
+        return -1;
+    }
+    if (acc != xn)
+        fprintf(stderr, "Warning: last sample of %s.%s.%s.%s is %d, not %d\n",
+                r->net, r->sta, r->loc, r->chan, acc, xn);
+    return n;
+
+invalid:
+    fprintf(stderr, "Invalid Steim-%d data of %s.%s.%s.%s\n",
+            version, r->net, r->sta, r->loc, r->chan);
+    return -1;
+}
+
+/*
+ *  copy_field: n characters of a field, without trailing blanks
+ */
+static void copy_field(char *s, const unsigned char *p, int n)
+{
+    memcpy(s, p, n);
+    while (n > 0 && (s[n-1] == ' ' || s[n-1] == '\0')) n--;
+    s[n] = '\0';
+}
+
+static uint32_t rd32(const unsigned char *p, int big)
+{
+    if (big)
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+static unsigned rd16(const unsigned char *p, int big)
+{
+    return big ? (unsigned)p[0] << 8 | p[1] : (unsigned)p[1] << 8 | p[0];
+}
@@ -0,0 +1,42 @@
+/*
+ *  mseed.h
+ *
+ *  Parsing and decoding of miniSEED 2 data records.
+ *
+ */
+#ifndef _MSEED_H
+#define _MSEED_H
+
+#include <stddef.h>
+
+/* encodings of data */
+#define MSEED_ASCII     0
+#define MSEED_INT16     1
+#define MSEED_INT32     3
+#define MSEED_FLOAT32   4
+#define MSEED_FLOAT64   5
+#define MSEED_STEIM1    10
+#define MSEED_STEIM2    11
+
+/* length of fixed header */
+#define MSEED_HEAD      48
+
+typedef struct mseed_record {
+    char    net[3];
+    char    sta[6];
+    char    loc[3];
+    char    chan[4];
+    double  start;      /* epoch time of first sample, corrected */
+    double  delta;      /* sampling interval, 0 if no samples */
+    int     nsamp;
+    int     encoding;
+    int     big;        /* data in big endian word order */
+    int     reclen;     /* length of record in bytes */
+    int     offset;     /* beginning of data in record */
+    const unsigned char *rec;
+} MSRECORD;
+
+int mseed_parse(const unsigned char *p, size_t len, MSRECORD *r);
+int mseed_decode(const MSRECORD *r, float *out);
+
+#endif
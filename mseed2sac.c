@@ -0,0 +1,401 @@
+/*
+ *  Convert miniSEED files to SAC files
+ *
+ *  Files are mapped into memory and indexed by their record headers in
+ *  parallel. Records of all files are sorted by channel and start time,
+ *  and channels are decoded and written in parallel, contiguous records
+ *  stitched into one SAC file. Gaps either start a new file or are filled,
+ *  and overlaps keep the samples of the earlier or the later record.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sacio.h"
+#include "datetime.h"
+#include "mseed.h"
+
+/* policies of gaps and overlaps */
+#define GAP_SPLIT       0
+#define GAP_ZERO        1
+#define GAP_INTERP      2
+#define GAP_NAN         3
+#define OVERLAP_FIRST   0
+#define OVERLAP_LAST    1
+
+/* largest number of samples of a record */
+#define MAX_SAMPLES     65536
+
+/* record to be converted */
+typedef struct {
+    MSRECORD r;
+    char    chan[SAC_CHANNEL_NAME_LENGTH];
+    int     ifile;
+    int     seg;        /* segment of the channel */
+    long    idx;        /* sample of the segment of the first sample */
+} REC;
+
+/* mapped input file */
+typedef struct {
+    const unsigned char *p;
+    size_t  len;
+    REC     *rec;
+    int     nrec;
+} MAPPED;
+
+void usage(void);
+int index_file(const char *file, MAPPED *m, int ifile);
+int compare_rec(const void *a, const void *b);
+int convert(REC *rec, int nrec, int *nout);
+int write_segment(const REC *r, double t0, long npts, const float *data, char *last);
+
+/* options */
+int gap = GAP_SPLIT;
+int overlap = OVERLAP_FIRST;
+char *dir = ".";
+
+void usage()
+{
+    fprintf(stderr, "Convert miniSEED files to SAC files                        \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  mseed2sac [-Gsplit|zero|interp|nan] [-Ofirst|last]       \n");
+    fprintf(stderr, "            [-D dir] [-L filelist] [mseedfiles]            \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -G   gaps between records start a new file by split, or  \n");
+    fprintf(stderr, "       are filled by zeros, linear interpolation or NaN,   \n");
+    fprintf(stderr, "       default split                                       \n");
+    fprintf(stderr, "  -O   overlapped samples are taken from the earlier or    \n");
+    fprintf(stderr, "       the later record, default first                     \n");
+    fprintf(stderr, "  -D   directory of output files, default is .             \n");
+    fprintf(stderr, "  -L   read names of miniSEED files from filelist, one per \n");
+    fprintf(stderr, "       line                                                \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. records need blockette 1000, encodings of 16 or 32    \n");
+    fprintf(stderr, "     bit integers, 32 or 64 bit floats, Steim-1 and        \n");
+    fprintf(stderr, "     Steim-2 are supported.                                \n");
+    fprintf(stderr, "  2. records of a channel may be in any files and in any   \n");
+    fprintf(stderr, "     order. A record starting within half a sample of the  \n");
+    fprintf(stderr, "     end of the previous one continues it.                 \n");
+    fprintf(stderr, "  3. outputs are dir/NET.STA.LOC.CHN.YYYY.DDD.HHMMSS.SAC   \n");
+    fprintf(stderr, "     by the start of data, with the reference time at the  \n");
+    fprintf(stderr, "     first sample. A segment starting in the same second   \n");
+    fprintf(stderr, "     as the previous one of its channel is skipped.        \n");
+    fprintf(stderr, "  4. a file is converted up to its first invalid record.   \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  mseed2sac IU.ANMO.00.BHZ.2023.001.mseed                  \n");
+    fprintf(stderr, "  mseed2sac -Ginterp -Olast -D sac -L mseed.lst            \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j;
+    int error = 0;
+    char *list = NULL;
+    char **files;
+    int nfile, nrec = 0, nchan = 0, nout = 0, nerr = 0;
+    MAPPED *map;
+    REC *rec;
+    int *chan;
+
+    while ((c=getopt(argc, argv, "G:O:D:L:h")) != -1) {
+        switch (c) {
+            case 'G':
+                if (strcmp(optarg, "split") == 0)
+                    gap = GAP_SPLIT;
+                else if (strcmp(optarg, "zero") == 0)
+                    gap = GAP_ZERO;
+                else if (strcmp(optarg, "interp") == 0)
+                    gap = GAP_INTERP;
+                else if (strcmp(optarg, "nan") == 0)
+                    gap = GAP_NAN;
+                else
+                    error = 1;
+                break;
+            case 'O':
+                if (strcmp(optarg, "first") == 0)
+                    overlap = OVERLAP_FIRST;
+                else if (strcmp(optarg, "last") == 0)
+                    overlap = OVERLAP_LAST;
+                else
+                    error = 1;
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || error) {
+        usage();
+        exit(-1);
+    }
+
+    /* index records of all files */
+    if ((map = (MAPPED *)calloc(nfile, sizeof(MAPPED))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+    for (i=0; i<nfile; i++)
+        if (index_file(files[i], &map[i], i) != 0) nerr++;
+
+    for (i=0; i<nfile; i++) nrec += map[i].nrec;
+    if ((rec = (REC *)malloc((nrec + 1) * sizeof(REC))) == NULL
+            || (chan = (int *)malloc((nrec + 1) * sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (i=0, nrec=0; i<nfile; i++) {
+        memcpy(rec + nrec, map[i].rec, map[i].nrec * sizeof(REC));
+        nrec += map[i].nrec;
+        free(map[i].rec);
+    }
+    qsort(rec, nrec, sizeof(REC), compare_rec);
+
+    /* records chan[j] to chan[j+1]-1 are of channel j */
+    for (i=0; i<nrec; i++)
+        if (i == 0 || strcmp(rec[i].chan, rec[i-1].chan) != 0) chan[nchan++] = i;
+    chan[nchan] = nrec;
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr, nout)
+    for (j=0; j<nchan; j++) {
+        int n = 0;
+        if (convert(rec + chan[j], chan[j+1] - chan[j], &n) != 0) nerr++;
+        nout += n;
+    }
+
+    printf("%d records of %d files converted to %d SAC files\n", nrec, nfile, nout);
+    for (i=0; i<nfile; i++)
+        if (map[i].p != NULL) munmap((void *)map[i].p, map[i].len);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  index_file: map file and index its data records
+ */
+int index_file(const char *file, MAPPED *m, int ifile)
+{
+    struct stat st;
+    size_t off = 0;
+    int fd, nmax = 0;
+    MSRECORD r;
+    void *p;
+
+    if ((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s\n", file);
+        return -1;
+    }
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    m->p = (const unsigned char *)p;
+    m->len = st.st_size;
+
+    while (off + MSEED_HEAD <= m->len) {
+        REC *x;
+        if (mseed_parse(m->p + off, m->len - off, &r) != 0) {
+            fprintf(stderr, "Invalid record at byte %zu of %s, "
+                    "only records before it are converted\n", off, file);
+            return -1;
+        }
+        off += r.reclen;
+        /* records without samples, e.g. logs */
+        if (r.nsamp == 0 || r.delta <= 0. || r.encoding == MSEED_ASCII)
+            continue;
+        if (r.nsamp > MAX_SAMPLES) {
+            fprintf(stderr, "Too many samples in record at byte %zu of %s, "
+                    "only records before it are converted\n", off - r.reclen, file);
+            return -1;
+        }
+        if (m->nrec == nmax) {
+            nmax = nmax ? 2 * nmax : 1024;
+            if ((x = (REC *)realloc(m->rec, nmax * sizeof(REC))) == NULL) {
+                fprintf(stderr, "Error in allocating memory for %s\n", file);
+                free(m->rec);
+                m->rec = NULL;
+                m->nrec = 0;
+                return -1;
+            }
+            m->rec = x;
+        }
+        x = &m->rec[m->nrec++];
+        x->r = r;
+        x->ifile = ifile;
+        snprintf(x->chan, SAC_CHANNEL_NAME_LENGTH, "%s.%s.%s.%s",
+                 r.net, r.sta, r.loc, r.chan);
+    }
+    return 0;
+}
+
+/*
+ *  convert: stitch, decode and write records of a channel sorted by time
+ */
+int convert(REC *rec, int nrec, int *nout)
+{
+    float *buf, *data = NULL;
+    char last[PATH_MAX] = "";
+    int i, s, i0, nerr = 0;
+    long end = 0;
+    double t0 = 0., delta = 0.;
+
+    /* plan segments, i.e. outputs */
+    for (i=0, s=-1; i<nrec; i++) {
+        const MSRECORD *r = &rec[i].r;
+        double off = (s < 0) ? 0. : (r->start - t0) / delta - end;
+        if (s < 0 || fabs(r->delta - delta) * end > 0.5 * delta
+                || (off > 0.5 && gap == GAP_SPLIT)) {
+            s++;
+            t0 = r->start;
+            delta = r->delta;
+            end = 0;
+            off = 0.;
+        }
+        rec[i].seg = s;
+        rec[i].idx = (fabs(off) <= 0.5) ? end : end + lround(off);
+        if (rec[i].idx < 0) rec[i].idx = 0;
+        if (rec[i].idx + r->nsamp > end) end = rec[i].idx + r->nsamp;
+    }
+
+    if ((buf = (float *)malloc(MAX_SAMPLES * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for %s\n", rec[0].chan);
+        return -1;
+    }
+    for (i0=0; i0<nrec; i0=i) {
+        long filled = 0, npts = 0;
+        for (i=i0; i<nrec && rec[i].seg==rec[i0].seg; i++)
+            if (rec[i].idx + rec[i].r.nsamp > npts) npts = rec[i].idx + rec[i].r.nsamp;
+        if ((data = (float *)malloc(npts * sizeof(float))) == NULL) {
+            fprintf(stderr, "Error in allocating memory for %s\n", rec[i0].chan);
+            nerr++;
+            continue;
+        }
+
+        for (i=i0; i<nrec && rec[i].seg==rec[i0].seg; i++) {
+            const long idx = rec[i].idx;
+            int n = mseed_decode(&rec[i].r, buf);
+            long k;
+            if (n < 0) {
+                /* filled as a gap by later records */
+                nerr++;
+                continue;
+            }
+            if (idx > filled) {
+                for (k=filled; k<idx; k++) {
+                    if (gap == GAP_INTERP && filled > 0)
+                        data[k] = data[filled-1] + (buf[0] - data[filled-1])
+                                * (float)(k - filled + 1) / (float)(idx - filled + 1);
+                    else
+                        data[k] = (gap == GAP_NAN) ? NAN : (gap == GAP_INTERP) ? buf[0] : 0.f;
+                }
+            }
+            if (overlap == OVERLAP_LAST || idx >= filled) {
+                memcpy(data + idx, buf, n * sizeof(float));
+            } else if (idx + n > filled) {
+                memcpy(data + filled, buf + (filled - idx), (idx + n - filled) * sizeof(float));
+            }
+            if (idx + n > filled) filled = idx + n;
+        }
+        /* trailing samples of records failed to decode */
+        for (; filled<npts; filled++) data[filled] = (gap == GAP_NAN) ? NAN : 0.f;
+
+        if (write_segment(&rec[i0], rec[i0].r.start, npts, data, last) != 0)
+            nerr++;
+        else
+            (*nout)++;
+        free(data);
+    }
+    free(buf);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  write_segment: write npts samples starting at t0 of the channel of r,
+ *      unless its name is last, that of the previous segment of the channel
+ */
+int write_segment(const REC *r, double t0, long npts, const float *data, char *last)
+{
+    char out[PATH_MAX];
+    int year, jday, month, day, hour, minute, second, msec;
+    SACHEAD hd;
+
+    if (npts > INT_MAX) {
+        fprintf(stderr, "Too many samples of %s\n", r->chan);
+        return -1;
+    }
+    epoch2datetime(t0, &year, &jday, &month, &day, &hour, &minute, &second, &msec);
+    if (snprintf(out, PATH_MAX, "%s/%s.%04d.%03d.%02d%02d%02d.SAC", dir, r->chan,
+                 year, jday, hour, minute, second) >= PATH_MAX) {
+        fprintf(stderr, "File name too long %s/%s\n", dir, r->chan);
+        return -1;
+    }
+    /* segments starting in the same second have the same name */
+    if (strcmp(out, last) == 0) {
+        fprintf(stderr, "Warning: segment of %s starts in the second of the previous "
+                "one, not written over %s\n", r->chan, out);
+        return -1;
+    }
+    strcpy(last, out);
+    hd = new_sac_head((float)r->r.delta, (int)npts, 0.f);
+    hd.nzyear = year;
+    hd.nzjday = jday;
+    hd.nzhour = hour;
+    hd.nzmin = minute;
+    hd.nzsec = second;
+    hd.nzmsec = msec;
+    hd.b = (float)(t0 - datetime2epoch(year, jday, hour, minute, second, msec));
+    hd.e = hd.b + (npts - 1) * hd.delta;
+    hd.o = SAC_FLOAT_UNDEF;
+    hd.iztype = IB;
+    strcpy(hd.knetwk, r->r.net);
+    strcpy(hd.kstnm, r->r.sta);
+    if (r->r.loc[0] != '\0') strcpy(hd.khole, r->r.loc);
+    strcpy(hd.kcmpnm, r->r.chan);
+    return write_sac_opt(out, hd, data, SAC_WRITE_STATS);
+}
+
+/*
+ *  compare_rec: order records by channel, start time, then by file
+ */
+int compare_rec(const void *a, const void *b)
+{
+    const REC *x = (const REC *)a;
+    const REC *y = (const REC *)b;
+    int c = strcmp(x->chan, y->chan);
+
+    if (c != 0) return c;
+    if (x->r.start != y->r.start) return (x->r.start < y->r.start) ? -1 : 1;
+    if (x->ifile != y->ifile) return x->ifile - y->ifile;
+    return (x->r.rec < y->r.rec) ? -1 : (x->r.rec > y->r.rec);
+}
@@ -0,0 +1,469 @@
+/*******************************************************************************
+ *                                 pipeline.c                                  *
+ *  Preprocessing pipeline of SAC data:                                        *
+ *      pipeline_new     compile a list of stages                              *
+ *      pipeline_free    free a pipeline                                       *
+ *      pipeline_run     run a pipeline on data in memory                      *
+ *      pipeline_file    run a pipeline on a file, streamed if long            *
+ *                                                                             *
+ *  Stages, separated by commas:                                               *
+ *      rmean            remove mean                                           *
+ *      rtrend           remove least-squares linear trend                     *
+ *      taper[/width]    Hanning taper of width (default 0.05) at each end     *
+ *      scale/value      multiply by value                                     *
+ *      int              integrate by trapezoidal rule                         *
+ *      diff             differentiate by backward difference                  *
+ *                                                                             *
+ *  Stages are compiled into passes over the data. A pass starts with the      *
+ *  statistics of rmean or rtrend, accumulated for mean and trend at once,     *
+ *  and runs its other stages block by block in one loop, with consecutive     *
+ *  rtrend, taper and scale fused into a single vectorized loop. Statistics    *
+ *  of the next pass are accumulated while the data are in cache.             *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pipeline.h"
+
+/* statistics of a pass */
+#define STAT_NONE   0
+#define STAT_MEAN   1
+#define STAT_TREND  2
+
+/* operations of a pass */
+#define OP_LINEAR   0   /* (x - trend) * taper * gain */
+#define OP_INT      1
+#define OP_DIFF     2
+
+typedef struct {
+    int     type;
+    int     detrend;    /* remove trend of the pass */
+    double  taper;      /* width of taper, 0 for none */
+    double  gain;
+} OP;
+
+typedef struct {
+    int     stats;
+    int     op0, nop;   /* operations of the pass */
+} PASS;
+
+struct pipeline {
+    int     nop, npass;
+    OP      op[PIPELINE_MAX_STAGE];
+    PASS    pass[PIPELINE_MAX_STAGE];
+};
+
+/* state of a pipeline running on a trace */
+typedef struct {
+    int     npts;
+    double  delta;
+    double  c;                          /* center of trend, (npts-1)/2 */
+    double  sx[PIPELINE_MAX_STAGE];     /* sums of statistics of passes */
+    double  stx[PIPELINE_MAX_STAGE];
+    double  a[PIPELINE_MAX_STAGE];      /* trend a + b*(k-c) of passes */
+    double  b[PIPELINE_MAX_STAGE];
+    double  y[PIPELINE_MAX_STAGE];      /* running integral */
+    float   prev[PIPELINE_MAX_STAGE];   /* previous input sample */
+} RUN;
+
+static int  add_op      (PIPELINE *p, int type);
+static void run_init    (RUN *r, const SACHEAD *hd);
+static void run_reset   (RUN *r);
+static void stats_block (RUN *r, int pass, const float *x, int n, int k0);
+static void stats_done  (const PIPELINE *p, RUN *r, int pass);
+static void apply_pass  (const PIPELINE *p, RUN *r, int pass, float *x, int n, int k0);
+static void set_idep    (const PIPELINE *p, SACHEAD *hd);
+
+/*
+ *  pipeline_new
+ *
+ *  Description: compile a list of stages, e.g. "rmean,rtrend,taper/0.05"
+ *
+ *  Return: pipeline, NULL if the list is invalid
+ *
+ */
+PIPELINE *pipeline_new(const char *spec)
+{
+    PIPELINE *p;
+    char *buf, *tok, *save, *val;
+    OP *op;
+    double v;
+    int error = 0;
+
+    if ((p = (PIPELINE *)calloc(1, sizeof(PIPELINE))) == NULL
+            || (buf = strdup(spec)) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        free(p);
+        return NULL;
+    }
+
+    for (tok=strtok_r(buf, ",", &save); tok!=NULL && !error;
+            tok=strtok_r(NULL, ",", &save)) {
+        if ((val = strchr(tok, '/')) != NULL) *val++ = '\0';
+        if (strcmp(tok, "rmean") == 0 || strcmp(tok, "rtrend") == 0) {
+            int stats = (tok[1] == 'm') ? STAT_MEAN : STAT_TREND;
+            PASS *ps = (p->npass > 0) ? p->pass + p->npass - 1 : NULL;
+            op = (p->nop > 0) ? p->op + p->nop - 1 : NULL;
+            /* statistics after other stages start a new pass */
+            if (ps == NULL || ps->nop != 1 || !op->detrend
+                    || op->taper > 0. || op->gain != 1.) {
+                p->npass++;
+                ps = p->pass + p->npass - 1;
+                if (add_op(p, OP_LINEAR) != 0) {
+                    error = 1;
+                    break;
+                }
+                p->op[p->nop-1].detrend = 1;
+            }
+            if (stats > ps->stats) ps->stats = stats;
+        } else if (strcmp(tok, "taper") == 0 || strcmp(tok, "scale") == 0) {
+            int taper = (tok[0] == 't');
+            if (taper) {
+                v = (val == NULL) ? 0.05 : atof(val);
+                if (v <= 0. || v > 0.5) {
+                    fprintf(stderr, "Invalid width of taper %s\n", val);
+                    error = 1;
+                    break;
+                }
+            } else {
+                if (val == NULL) {
+                    fprintf(stderr, "Missing value of scale\n");
+                    error = 1;
+                    break;
+                }
+                v = atof(val);
+            }
+            op = (p->nop > 0) ? p->op + p->nop - 1 : NULL;
+            if (op == NULL || op->type != OP_LINEAR || (taper && op->taper > 0.)) {
+                if (p->npass == 0) p->npass = 1;
+                if (add_op(p, OP_LINEAR) != 0) {
+                    error = 1;
+                    break;
+                }
+                op = p->op + p->nop - 1;
+            }
+            if (taper)
+                op->taper = v;
+            else
+                op->gain *= v;
+        } else if (strcmp(tok, "int") == 0 || strcmp(tok, "diff") == 0) {
+            if (p->npass == 0) p->npass = 1;
+            if (add_op(p, (tok[0] == 'i') ? OP_INT : OP_DIFF) != 0) error = 1;
+        } else {
+            fprintf(stderr, "Unknown stage %s\n", tok);
+            error = 1;
+        }
+    }
+    free(buf);
+
+    if (!error && p->nop == 0) {
+        fprintf(stderr, "No stage in %s\n", spec);
+        error = 1;
+    }
+    if (error) {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+/*
+ *  pipeline_free: free a pipeline
+ */
+void pipeline_free(PIPELINE *p)
+{
+    free(p);
+}
+
+/*
+ *  pipeline_run
+ *
+ *  Description: run a pipeline on data in place, and update idep of
+ *      the header for int and diff.
+ *
+ *  IN:
+ *      const PIPELINE *p   :   pipeline
+ *      SACHEAD        *hd  :   header of data
+ *      float          *data:   data, npts samples
+ *
+ *  Return: 0 if success, -1 if failed
+ *
+ */
+int pipeline_run(const PIPELINE *p, SACHEAD *hd, float *data)
+{
+    RUN r;
+    int i, k, n;
+
+    if (hd->iftype == IXY) {
+        fprintf(stderr, "Unable to process IXY data\n");
+        return -1;
+    }
+    run_init(&r, hd);
+
+    if (p->pass[0].stats != STAT_NONE) {
+        for (k=0; k<hd->npts; k+=PIPELINE_BLOCK) {
+            n = (hd->npts - k < PIPELINE_BLOCK) ? hd->npts - k : PIPELINE_BLOCK;
+            stats_block(&r, 0, data + k, n, k);
+        }
+        stats_done(p, &r, 0);
+    }
+    for (i=0; i<p->npass; i++) {
+        int next = (i + 1 < p->npass && p->pass[i+1].stats != STAT_NONE);
+        for (k=0; k<hd->npts; k+=PIPELINE_BLOCK) {
+            n = (hd->npts - k < PIPELINE_BLOCK) ? hd->npts - k : PIPELINE_BLOCK;
+            apply_pass(p, &r, i, data + k, n, k);
+            if (next) stats_block(&r, i + 1, data + k, n, k);
+        }
+        if (next) stats_done(p, &r, i + 1);
+    }
+
+    set_idep(p, hd);
+    return 0;
+}
+
+/*
+ *  pipeline_file
+ *
+ *  Description: run a pipeline on a SAC file and write the result.
+ *      Files of more than PIPELINE_STREAM_MIN samples are streamed,
+ *      reading the input once per pass with statistics and once more
+ *      for the output, in bounded memory.
+ *
+ *  IN:
+ *      const PIPELINE *p   :   pipeline
+ *      const char     *in  :   input file
+ *      const char     *out :   output file, may be the same as in
+ *      int             flags:  flags of write_sac_opt, depmin, depmax
+ *                              and depmen are always updated
+ *
+ *  Return: 0 if success, -1 if failed
+ *
+ */
+int pipeline_file(const PIPELINE *p, const char *in, const char *out, int flags)
+{
+    SACHEAD hd;
+    SACSTREAM *s = NULL, *w = NULL;
+    float *data;
+    RUN r;
+    int i, j, k, l, n = 0, m;
+    int error = 0;
+
+    if (read_sac_head(in, &hd) != 0) return -1;
+    flags |= SAC_WRITE_STATS;
+
+    if (hd.npts <= PIPELINE_STREAM_MIN || hd.iftype == IXY) {
+        if ((data = read_sac(in, &hd)) == NULL) return -1;
+        if (pipeline_run(p, &hd, data) != 0
+                || write_sac_opt(out, hd, data, flags) != 0)
+            error = -1;
+        free(data);
+        return error;
+    }
+
+    if ((data = (float *)malloc(PIPELINE_CHUNK*sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for %s\n", in);
+        return -1;
+    }
+    run_init(&r, &hd);
+
+    /* statistics of each pass, from data through the passes before it */
+    for (i=0; i<p->npass && !error; i++) {
+        if (p->pass[i].stats == STAT_NONE) continue;
+        run_reset(&r);
+        if ((s = sac_stream_open(in, &hd)) == NULL) {
+            error = -1;
+            break;
+        }
+        for (k=0; (n = sac_stream_read(s, data, PIPELINE_CHUNK)) > 0; k+=n) {
+            for (j=0; j<n; j+=m) {
+                m = (n - j < PIPELINE_BLOCK) ? n - j : PIPELINE_BLOCK;
+                for (l=0; l<i; l++) apply_pass(p, &r, l, data + j, m, k + j);
+                stats_block(&r, i, data + j, m, k + j);
+            }
+        }
+        if (n < 0) error = -1;
+        sac_stream_close(s);
+        stats_done(p, &r, i);
+    }
+
+    /* output through all passes */
+    if (!error) {
+        run_reset(&r);
+        if (sac_same_file(in, out)) flags |= SAC_WRITE_ATOMIC;
+        if ((s = sac_stream_open(in, &hd)) == NULL) {
+            error = -1;
+        } else {
+            set_idep(p, &hd);
+            if ((w = sac_stream_create(out, hd, flags)) == NULL) error = -1;
+        }
+        for (k=0; !error && (n = sac_stream_read(s, data, PIPELINE_CHUNK)) > 0; k+=n) {
+            for (j=0; j<n; j+=m) {
+                m = (n - j < PIPELINE_BLOCK) ? n - j : PIPELINE_BLOCK;
+                for (i=0; i<p->npass; i++) apply_pass(p, &r, i, data + j, m, k + j);
+            }
+            if (sac_stream_write(w, data, n) != 0) error = -1;
+        }
+        if (n < 0) error = -1;
+        sac_stream_close(s);
+        if (error)
+            sac_stream_cancel(w);
+        else if (sac_stream_close(w) != 0)
+            error = -1;
+    }
+
+    free(data);
+    return error;
+}
+
+/*
+ *  add_op: append an operation to the last pass
+ */
+static int add_op(PIPELINE *p, int type)
+{
+    PASS *ps = p->pass + p->npass - 1;
+    OP *op;
+
+    if (p->nop == PIPELINE_MAX_STAGE) {
+        fprintf(stderr, "Too many stages, at most %d\n", PIPELINE_MAX_STAGE);
+        return -1;
+    }
+    if (ps->nop == 0) ps->op0 = p->nop;
+    op = p->op + p->nop++;
+    op->type = type;
+    op->detrend = 0;
+    op->taper = 0.;
+    op->gain = 1.;
+    ps->nop++;
+    return 0;
+}
+
+/*
+ *  run_init: start running on a trace of hd
+ */
+static void run_init(RUN *r, const SACHEAD *hd)
+{
+    memset(r, 0, sizeof(RUN));
+    r->npts = hd->npts;
+    r->delta = hd->delta;
+    r->c = 0.5 * (hd->npts - 1);
+}
+
+/*
+ *  run_reset: clear state of operations to run from the first sample again
+ */
+static void run_reset(RUN *r)
+{
+    memset(r->y, 0, sizeof(r->y));
+    memset(r->prev, 0, sizeof(r->prev));
+}
+
+/*
+ *  stats_block: accumulate sums for mean and trend of a pass
+ */
+static void stats_block(RUN *r, int pass, const float *x, int n, int k0)
+{
+    double sx = 0., stx = 0., t0 = k0 - r->c;
+    int j;
+
+    #pragma omp simd reduction(+:sx,stx)
+    for (j=0; j<n; j++) {
+        sx += x[j];
+        stx += (t0 + j) * x[j];
+    }
+    r->sx[pass] += sx;
+    r->stx[pass] += stx;
+}
+
+/*
+ *  stats_done: trend of a pass from its sums, with time centered so
+ *      that mean and slope are independent
+ */
+static void stats_done(const PIPELINE *p, RUN *r, int pass)
+{
+    double n = r->npts;
+
+    if (r->npts <= 0) return;
+    r->a[pass] = r->sx[pass] / n;
+    r->b[pass] = 0.;
+    if (p->pass[pass].stats == STAT_TREND && r->npts > 1)
+        r->b[pass] = r->stx[pass] / (n * (n * n - 1.) / 12.);
+}
+
+/*
+ *  apply_pass: run operations of a pass on a block of samples from k0
+ */
+static void apply_pass(const PIPELINE *p, RUN *r, int pass, float *x, int n, int k0)
+{
+    const PASS *ps = p->pass + pass;
+    int i, j;
+
+    for (i=ps->op0; i<ps->op0+ps->nop; i++) {
+        const OP *op = p->op + i;
+
+        if (op->type == OP_LINEAR) {
+            double a = op->detrend ? r->a[pass] : 0.;
+            double b = op->detrend ? r->b[pass] : 0.;
+            double g = op->gain;
+            double t0 = k0 - r->c;
+            int mt = (int)(op->taper * r->npts);
+
+            if (k0 >= mt && k0 + n <= r->npts - mt) {
+                #pragma omp simd
+                for (j=0; j<n; j++)
+                    x[j] = (float)((x[j] - a - b * (t0 + j)) * g);
+            } else {
+                for (j=0; j<n; j++) {
+                    int k = k0 + j;
+                    double w = g;
+                    if (k < mt)
+                        w *= 0.5 * (1. - cos(M_PI * k / mt));
+                    else if (k >= r->npts - mt)
+                        w *= 0.5 * (1. - cos(M_PI * (r->npts - 1 - k) / mt));
+                    x[j] = (float)((x[j] - a - b * (t0 + j)) * w);
+                }
+            }
+        } else if (op->type == OP_INT) {
+            double y = r->y[i], h = 0.5 * r->delta;
+            float prev = r->prev[i];
+            j = 0;
+            if (k0 == 0) {
+                prev = x[0];
+                x[j++] = 0.f;
+                y = 0.;
+            }
+            for (; j<n; j++) {
+                y += h * (prev + x[j]);
+                prev = x[j];
+                x[j] = (float)y;
+            }
+            r->y[i] = y;
+            r->prev[i] = prev;
+        } else {
+            double rd = 1. / r->delta;
+            float prev = (k0 == 0) ? x[0] : r->prev[i];
+            for (j=0; j<n; j++) {
+                float cur = x[j];
+                x[j] = (float)((cur - prev) * rd);
+                prev = cur;
+            }
+            r->prev[i] = prev;
+        }
+    }
+}
+
+/*
+ *  set_idep: type of dependent variable after int and diff
+ */
+static void set_idep(const PIPELINE *p, SACHEAD *hd)
+{
+    int i;
+
+    for (i=0; i<p->nop && hd->idep != SAC_INT_UNDEF; i++) {
+        if (p->op[i].type == OP_INT)
+            hd->idep = (hd->idep == IACC) ? IVEL : (hd->idep == IVEL) ? IDISP : IUNKN;
+        else if (p->op[i].type == OP_DIFF)
+            hd->idep = (hd->idep == IDISP) ? IVEL : (hd->idep == IVEL) ? IACC : IUNKN;
+    }
+}
@@ -0,0 +1,28 @@
+/*
+ *  pipeline.h
+ *
+ *  Preprocessing of SAC data by a list of stages run in fused passes.
+ *
+ */
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include "sacio.h"
+
+/* maximum number of stages of a pipeline */
+#define PIPELINE_MAX_STAGE  32
+/* samples taken through all stages of a pass at a time */
+#define PIPELINE_BLOCK      4096
+/* samples read at a time when streaming */
+#define PIPELINE_CHUNK      (1 << 20)
+/* files with more samples are streamed by pipeline_file */
+#define PIPELINE_STREAM_MIN (1 << 24)
+
+typedef struct pipeline PIPELINE;
+
+PIPELINE *pipeline_new(const char *spec);
+void pipeline_free(PIPELINE *p);
+int pipeline_run(const PIPELINE *p, SACHEAD *hd, float *data);
+int pipeline_file(const PIPELINE *p, const char *in, const char *out, int flags);
+
+#endif
@@ -0,0 +1,159 @@
+/*******************************************************************************
+ *                                    psd.c                                    *
+ *  Power spectral density by Welch's method:                                  *
+ *      psd_window  window of segments, created once and cached                *
+ *      psd_nfreq   number of frequencies of a PSD                             *
+ *      psd_welch   one-sided PSD averaged over overlapping segments           *
+ *                                                                             *
+ *  Segments are demeaned and windowed, and zero padded to a power of 2.       *
+ *  Two segments share each complex FFT as real and imaginary parts. The PSD   *
+ *  at frequency k/(nfft*delta) is 2*delta*|X[k]|^2/sum(w^2), not doubled at   *
+ *  zero and Nyquist frequency, so that it integrates to the variance.         *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "psd.h"
+#include "fft.h"
+
+struct psd_window {
+    int     type, n;
+    int     nfft;
+    const FFTPLAN *plan;
+    double  power;      /* sum of squared window */
+    float   *w;
+    struct psd_window *next;
+};
+
+/* windows created so far */
+static PSDWINDOW *windows = NULL;
+static pthread_mutex_t windows_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  psd_window
+ *
+ *  Description: window of type PSD_HANN, PSD_HAMMING or PSD_BOXCAR of n
+ *      samples, created by the first call and shared by later calls
+ *
+ *  Return: window, NULL if failed
+ *
+ */
+const PSDWINDOW *psd_window(int type, int n)
+{
+    PSDWINDOW *w;
+    int k;
+
+    if (n < 2 || type < PSD_HANN || type > PSD_BOXCAR) {
+        fprintf(stderr, "Invalid window of %d samples\n", n);
+        return NULL;
+    }
+    pthread_mutex_lock(&windows_lock);
+    for (w=windows; w!=NULL; w=w->next)
+        if (w->type == type && w->n == n) break;
+    if (w != NULL) {
+        pthread_mutex_unlock(&windows_lock);
+        return w;
+    }
+
+    if ((w = (PSDWINDOW *)malloc(sizeof(PSDWINDOW))) == NULL
+            || (w->w = (float *)malloc(n * sizeof(float))) == NULL
+            || (w->nfft = fft_size(n)) == 0
+            || (w->plan = fft_plan(w->nfft)) == NULL) {
+        fprintf(stderr, "Error in allocating memory for window\n");
+        if (w != NULL) free(w->w);
+        free(w);
+        pthread_mutex_unlock(&windows_lock);
+        return NULL;
+    }
+    w->type = type;
+    w->n = n;
+    w->power = 0.;
+    for (k=0; k<n; k++) {
+        double c = cos(2. * M_PI * k / (n - 1));
+        w->w[k] = (type == PSD_HANN) ? (float)(0.5 - 0.5 * c)
+                : (type == PSD_HAMMING) ? (float)(0.54 - 0.46 * c) : 1.f;
+        w->power += (double)w->w[k] * w->w[k];
+    }
+
+    w->next = windows;
+    windows = w;
+    pthread_mutex_unlock(&windows_lock);
+    return w;
+}
+
+/*
+ *  psd_nfreq: number of frequencies of a PSD by a window, nfft/2+1
+ */
+int psd_nfreq(const PSDWINDOW *w)
+{
+    return w->nfft / 2 + 1;
+}
+
+/*
+ *  psd_welch
+ *
+ *  Description: PSD of n samples averaged over segments of the window
+ *      length overlapping by nover samples
+ *
+ *  IN:
+ *      const PSDWINDOW *w  :   window
+ *      const float     *x  :   data
+ *      int              n  :   samples of data
+ *      int          nover  :   samples of overlap, less than the window
+ *      double       delta  :   sampling interval
+ *  OUT:
+ *      float         *psd  :   psd_nfreq values, in unit^2/Hz
+ *
+ *  Return: number of segments averaged, 0 if n is shorter than a segment,
+ *      -1 if failed
+ *
+ */
+int psd_welch(const PSDWINDOW *w, const float *x, int n, int nover,
+              double delta, float *psd)
+{
+    const int m = w->n, nfft = w->nfft, nf = nfft / 2 + 1;
+    int step = m - nover;
+    int nseg, s, q, k;
+    float *z;
+    double *sum, scale;
+
+    if (step < 1 || n < m) return 0;
+    nseg = (n - m) / step + 1;
+    z = (float *)malloc(2 * nfft * sizeof(float));
+    sum = (double *)calloc(nf, sizeof(double));
+    if (z == NULL || sum == NULL) {
+        fprintf(stderr, "Error in allocating memory for PSD\n");
+        free(z);
+        free(sum);
+        return -1;
+    }
+
+    for (s=0; s<nseg; s+=2) {
+        memset(z, 0, 2 * nfft * sizeof(float));
+        for (q=0; q<2 && s+q<nseg; q++) {
+            const float *y = x + (size_t)(s + q) * step;
+            double mean = 0.;
+            for (k=0; k<m; k++) mean += y[k];
+            mean /= m;
+            for (k=0; k<m; k++) z[2*k+q] = (float)(y[k] - mean) * w->w[k];
+        }
+        fft_forward(w->plan, z);
+        /* |A|^2 + |B|^2 of the two real segments from Z[k] and Z[-k] */
+        for (k=0; k<nf; k++) {
+            int r = (nfft - k) % nfft;
+            double ar = z[2*k] + z[2*r], ai = z[2*k+1] - z[2*r+1];
+            double br = z[2*k+1] + z[2*r+1], bi = z[2*k] - z[2*r];
+            sum[k] += 0.25 * (ar * ar + ai * ai + br * br + bi * bi);
+        }
+    }
+
+    scale = 2. * delta / (w->power * nseg);
+    for (k=0; k<nf; k++)
+        psd[k] = (float)(sum[k] * ((k == 0 || k == nfft/2) ? 0.5 * scale : scale));
+    free(z);
+    free(sum);
+    return nseg;
+}
@@ -0,0 +1,22 @@
+/*
+ *  psd.h
+ *
+ *  Power spectral density by Welch's method.
+ *
+ */
+#ifndef _PSD_H
+#define _PSD_H
+
+/* windows of segments */
+#define PSD_HANN        0
+#define PSD_HAMMING     1
+#define PSD_BOXCAR      2
+
+typedef struct psd_window PSDWINDOW;
+
+const PSDWINDOW *psd_window(int type, int n);
+int psd_nfreq(const PSDWINDOW *w);
+int psd_welch(const PSDWINDOW *w, const float *x, int n, int nover,
+              double delta, float *psd);
+
+#endif
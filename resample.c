@@ -0,0 +1,312 @@
+/*******************************************************************************
+ *                                 resample.c                                  *
+ *  Rational resampling by up/down with polyphase FIR filter banks:            *
+ *      resample_ratio   up and down factors from old and new delta            *
+ *      resample_plan    filter bank of up/down, created once and cached       *
+ *      resample_length  number of output samples                              *
+ *      resample         resample data in memory                               *
+ *      resample_file    resample a SAC file, streamed                         *
+ *                                                                             *
+ *  Output sample m is at time m*down/up of input samples. Its value is the    *
+ *  dot product of a phase, (m*down) mod up, of the bank and the input         *
+ *  samples around it, with zeros out of data. With up of 1 this is            *
+ *  decimation by an anti-alias FIR filter evaluated every down samples.       *
+ *  The filter is a Kaiser windowed sinc, with each phase normalized to a      *
+ *  gain of 1 at zero frequency.                                               *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+#include "sacio.h"
+#include "resample.h"
+
+/* shape parameter of the Kaiser window */
+#define KAISER_BETA 8.
+
+struct resampler {
+    int     up, down;
+    int     lead;       /* input samples before the one at or before output */
+    int     ntap;       /* taps per phase */
+    float   *bank;      /* up phases of ntap taps */
+    struct resampler *next;
+};
+
+/* filter banks created so far */
+static RESAMPLER *plans = NULL;
+static pthread_mutex_t plans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double bessel_i0 (double x);
+static void   run       (const RESAMPLER *r, const float *buf, long long base,
+                         long long m0, long long m1, float *y);
+
+/*
+ *  resample_ratio
+ *
+ *  Description: smallest up and down with down/up equal to the ratio of
+ *      newdelta to delta, up to 1e-6
+ *
+ *  Return: 0 if success, -1 if up would exceed RESAMPLE_MAX_UP
+ *
+ */
+int resample_ratio(double delta, double newdelta, int *up, int *down)
+{
+    double r = newdelta / delta;
+    int l;
+    long m;
+
+    for (l=1; l<=RESAMPLE_MAX_UP && r > 0.; l++) {
+        m = lround(r * l);
+        if (m >= 1 && m <= INT_MAX && fabs((double)m / l - r) <= 1e-6 * r) {
+            *up = l;
+            *down = (int)m;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unable to resample from delta %g to %g\n", delta, newdelta);
+    return -1;
+}
+
+/*
+ *  resample_plan
+ *
+ *  Description: filter bank of resampling by up/down, created by the
+ *      first call for a ratio and shared by later calls
+ *
+ *  Return: plan, NULL if failed
+ *
+ */
+const RESAMPLER *resample_plan(int up, int down)
+{
+    RESAMPLER *r;
+    int a, b, t, p, k, f, q;
+    double fc, w, *h;
+
+    if (up < 1 || down < 1 || up > RESAMPLE_MAX_UP) {
+        fprintf(stderr, "Invalid resampling %d/%d\n", up, down);
+        return NULL;
+    }
+    for (a=up, b=down; b!=0; t=a%b, a=b, b=t)
+        ;
+    up /= a;
+    down /= a;
+
+    pthread_mutex_lock(&plans_lock);
+    for (r=plans; r!=NULL; r=r->next)
+        if (r->up == up && r->down == down) break;
+    if (r != NULL) {
+        pthread_mutex_unlock(&plans_lock);
+        return r;
+    }
+
+    /* half length q input samples, covering RESAMPLE_HALF samples of the
+     * lower rate */
+    f = (up > down) ? up : down;
+    q = (RESAMPLE_HALF * f + up - 1) / up;
+    if ((r = (RESAMPLER *)malloc(sizeof(RESAMPLER))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for resampling\n");
+        pthread_mutex_unlock(&plans_lock);
+        return NULL;
+    }
+    r->up = up;
+    r->down = down;
+    r->lead = (up == 1 && down == 1) ? 0 : q - 1;
+    r->ntap = (up == 1 && down == 1) ? 1 : 2 * q;
+    h = (double *)malloc(r->ntap * sizeof(double));
+    r->bank = (float *)malloc((size_t)up * r->ntap * sizeof(float));
+    if (h == NULL || r->bank == NULL) {
+        fprintf(stderr, "Error in allocating memory for resampling\n");
+        free(h);
+        free(r->bank);
+        free(r);
+        pthread_mutex_unlock(&plans_lock);
+        return NULL;
+    }
+
+    /* tap k of phase p is at p + (lead - k)*up samples of the upsampled rate */
+    fc = 0.5 * RESAMPLE_ROLLOFF / f;
+    w = (double)q * up;
+    for (p=0; p<up; p++) {
+        double sum = 0.;
+        for (k=0; k<r->ntap; k++) {
+            double j = p + (double)(r->lead - k) * up;
+            double x = j / w;
+            h[k] = (j == 0.) ? 2. * fc : sin(2. * M_PI * fc * j) / (M_PI * j);
+            if (r->ntap > 1)
+                h[k] *= (fabs(x) < 1.) ? bessel_i0(KAISER_BETA * sqrt(1. - x * x)) : 0.;
+            sum += h[k];
+        }
+        for (k=0; k<r->ntap; k++)
+            r->bank[(size_t)p * r->ntap + k] = (float)(h[k] / sum);
+    }
+    free(h);
+
+    r->next = plans;
+    plans = r;
+    pthread_mutex_unlock(&plans_lock);
+    return r;
+}
+
+/*
+ *  resample_length: number of output samples of n input samples
+ */
+int resample_length(const RESAMPLER *r, int n)
+{
+    if (n <= 0) return 0;
+    return (int)((long long)(n - 1) * r->up / r->down) + 1;
+}
+
+/*
+ *  resample
+ *
+ *  Description: resample n samples of x into y of resample_length samples
+ *
+ *  Return: number of output samples, -1 if failed
+ *
+ */
+int resample(const RESAMPLER *r, const float *x, int n, float *y)
+{
+    int nout = resample_length(r, n);
+    float *buf;
+
+    if (nout == 0) return 0;
+    if ((buf = (float *)calloc((size_t)n + r->ntap, sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for resampling\n");
+        return -1;
+    }
+    memcpy(buf + r->lead, x, n * sizeof(float));
+    run(r, buf, -r->lead, 0, nout, y);
+    free(buf);
+    return nout;
+}
+
+/*
+ *  resample_file
+ *
+ *  Description: resample a SAC file by a plan, and write it with delta,
+ *      npts and e updated. The input is streamed in chunks of
+ *      RESAMPLE_CHUNK samples, keeping the taps between chunks.
+ *
+ *  IN:
+ *      const RESAMPLER *r  :   plan
+ *      const char     *in  :   input file
+ *      const char     *out :   output file, may be the same as in
+ *      int             flags:  flags of sac_stream_create, depmin, depmax
+ *                              and depmen are always updated
+ *
+ *  Return: 0 if success, -1 if failed
+ *
+ */
+int resample_file(const RESAMPLER *r, const char *in, const char *out, int flags)
+{
+    SACHEAD hd;
+    SACSTREAM *s, *w = NULL;
+    float *buf, *y;
+    long long base, m, m1, nmax, keep;
+    int len, cap, nout, ahead, k;
+    int eof = 0, error = 0;
+
+    if ((s = sac_stream_open(in, &hd)) == NULL) return -1;
+    nout = resample_length(r, hd.npts);
+    ahead = r->ntap - 1 - r->lead;
+    cap = RESAMPLE_CHUNK + r->ntap;
+    buf = (float *)calloc(cap + ahead, sizeof(float));
+    y = (float *)malloc(RESAMPLE_CHUNK * sizeof(float));
+    if (buf == NULL || y == NULL) {
+        fprintf(stderr, "Error in allocating memory for resampling %s\n", in);
+        free(buf);
+        free(y);
+        sac_stream_close(s);
+        return -1;
+    }
+
+    hd.delta = (float)((double)hd.delta * r->down / r->up);
+    if (sac_same_file(in, out)) flags |= SAC_WRITE_ATOMIC;
+    if ((w = sac_stream_create(out, hd, flags | SAC_WRITE_STATS)) == NULL)
+        error = -1;
+
+    /* buf holds input samples base to base+len-1, zeros before the first
+     * and after the last */
+    base = -r->lead;
+    len = r->lead;
+    for (m=0; m<nout && !error; m=m1) {
+        if (!eof && len < cap) {
+            if ((k = sac_stream_read(s, buf + len, cap - len)) < 0) {
+                error = -1;
+                break;
+            } else if (k == 0) {
+                eof = 1;
+                memset(buf + len, 0, ahead * sizeof(float));
+                len += ahead;
+            } else {
+                len += k;
+            }
+        }
+
+        /* outputs whose last tap is in buf */
+        nmax = base + len - 1 - ahead;
+        m1 = (nmax < 0) ? 0 : ((nmax + 1) * r->up - 1) / r->down + 1;
+        if (m1 > nout) m1 = nout;
+        if (m1 > m + RESAMPLE_CHUNK) m1 = m + RESAMPLE_CHUNK;
+        if (m1 <= m) continue;
+        run(r, buf, base, m, m1, y);
+        if (sac_stream_write(w, y, (int)(m1 - m)) != 0) error = -1;
+
+        /* keep from the first tap of the next output */
+        keep = m1 * r->down / r->up - r->lead - base;
+        if (keep > 0) {
+            memmove(buf, buf + keep, (len - keep) * sizeof(float));
+            base += keep;
+            len -= (int)keep;
+        }
+    }
+
+    sac_stream_close(s);
+    if (error)
+        sac_stream_cancel(w);
+    else if (sac_stream_close(w) != 0)
+        error = -1;
+    free(buf);
+    free(y);
+    return error;
+}
+
+/*
+ *  run: outputs m0 to m1-1 from input samples in buf starting at base
+ */
+static void run(const RESAMPLER *r, const float *buf, long long base,
+                long long m0, long long m1, float *y)
+{
+    const int ntap = r->ntap;
+    long long m;
+    int k;
+
+    for (m=m0; m<m1; m++) {
+        long long t = m * r->down;
+        long long n0 = t / r->up;
+        const float *h = r->bank + (size_t)(t - n0 * r->up) * ntap;
+        const float *x = buf + (n0 - r->lead - base);
+        float s = 0.f;
+        #pragma omp simd reduction(+:s)
+        for (k=0; k<ntap; k++) s += h[k] * x[k];
+        y[m-m0] = s;
+    }
+}
+
+/*
+ *  bessel_i0: modified Bessel function of order 0 by its series
+ */
+static double bessel_i0(double x)
+{
+    double s = 1., t = 1.;
+    int k;
+
+    for (k=1; k<50 && t > 1e-16 * s; k++) {
+        t *= (x / (2. * k)) * (x / (2. * k));
+        s += t;
+    }
+    return s;
+}
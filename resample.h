@@ -0,0 +1,27 @@
+/*
+ *  resample.h
+ *
+ *  Rational resampling of SAC data by polyphase FIR filter banks.
+ *
+ */
+#ifndef _RESAMPLE_H
+#define _RESAMPLE_H
+
+/* largest factor of upsampling */
+#define RESAMPLE_MAX_UP     1000
+/* half length of the filter in input (or output) samples */
+#define RESAMPLE_HALF       16
+/* cutoff of the anti-alias filter relative to the lower Nyquist frequency */
+#define RESAMPLE_ROLLOFF    0.9
+/* samples read at a time by resample_file */
+#define RESAMPLE_CHUNK      (1 << 18)
+
+typedef struct resampler RESAMPLER;
+
+int resample_ratio(double delta, double newdelta, int *up, int *down);
+const RESAMPLER *resample_plan(int up, int down);
+int resample_length(const RESAMPLER *r, int n);
+int resample(const RESAMPLER *r, const float *x, int n, float *y);
+int resample_file(const RESAMPLER *r, const char *in, const char *out, int flags);
+
+#endif
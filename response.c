@@ -0,0 +1,276 @@
+/*******************************************************************************
+ *                                 response.c                                  *
+ *  Removal of instrument responses given by SAC pole-zero files:              *
+ *      response_get     inverse response of a file for npts and delta,        *
+ *                       evaluated once and cached                             *
+ *      response_remove  deconvolve data by an inverse response                *
+ *                                                                             *
+ *  A pole-zero file has lines ZEROS n, POLES n and CONSTANT c, with the       *
+ *  zeros or poles listed after their counts, and zeros or poles not listed    *
+ *  at the origin. Lines starting with * are comments. The response to         *
+ *  displacement is H(s) = c * prod(s - z) / prod(s - p) with s = 2*pi*i*f.    *
+ *                                                                             *
+ *  The inverse response is s^type / H(s) multiplied by the cosine taper of    *
+ *  the pre-filter f1 < f2 < f3 < f4, which is 0 below f1 and above f4, and    *
+ *  1 from f2 to f3. Data are deconvolved in the frequency domain, padded      *
+ *  by zeros to a power of 2 of at least twice their length, so that the       *
+ *  circular deconvolution does not wrap the end of data onto their start.     *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+#include "response.h"
+#include "fft.h"
+
+struct response {
+    char    *file;
+    int     nfft;
+    float   delta;
+    int     type;
+    double  freq[4];
+    const FFTPLAN *plan;
+    float   *inv;       /* nfft/2+1 complex values */
+    struct response *next;
+};
+
+/* responses evaluated so far */
+static RESPONSE *responses = NULL;
+static pthread_mutex_t responses_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int    read_pz (const char *file, double *zero, int *nzero,
+                       double *pole, int *npole, double *c);
+static double prefilter(const double *freq, double f);
+
+/*
+ *  response_get
+ *
+ *  Description: inverse response of a pole-zero file for data of npts
+ *      samples at delta, to displacement, velocity or acceleration by
+ *      type, evaluated by the first call and shared by later calls
+ *
+ *  IN:
+ *      const char  *pzfile :   SAC pole-zero file
+ *      int          npts   :   samples of data
+ *      float        delta  :   sampling interval
+ *      int          type   :   RESPONSE_DISP, RESPONSE_VEL or RESPONSE_ACC
+ *      const double *freq  :   f1, f2, f3 and f4 of the pre-filter
+ *
+ *  Return: inverse response, NULL if failed
+ *
+ */
+const RESPONSE *response_get(const char *pzfile, int npts, float delta,
+                             int type, const double *freq)
+{
+    RESPONSE *r;
+    double zero[2*RESPONSE_MAX_PZ], pole[2*RESPONSE_MAX_PZ], c;
+    int nzero, npole, nfft, nf, k, j;
+
+    if (npts > INT_MAX / 2 || (nfft = fft_size(2 * npts)) == 0) {
+        fprintf(stderr, "Too many samples %d for response removal\n", npts);
+        return NULL;
+    }
+    pthread_mutex_lock(&responses_lock);
+    for (r=responses; r!=NULL; r=r->next)
+        if (r->nfft == nfft && r->delta == delta && r->type == type
+                && memcmp(r->freq, freq, sizeof(r->freq)) == 0
+                && strcmp(r->file, pzfile) == 0) break;
+    if (r != NULL) {
+        pthread_mutex_unlock(&responses_lock);
+        return r;
+    }
+
+    if (read_pz(pzfile, zero, &nzero, pole, &npole, &c) != 0) {
+        pthread_mutex_unlock(&responses_lock);
+        return NULL;
+    }
+    nf = nfft / 2 + 1;
+    if ((r = (RESPONSE *)malloc(sizeof(RESPONSE))) != NULL) {
+        r->inv = (float *)malloc(2 * nf * sizeof(float));
+        r->file = strdup(pzfile);
+        r->plan = fft_plan(nfft);
+    }
+    if (r == NULL || r->inv == NULL || r->file == NULL || r->plan == NULL) {
+        fprintf(stderr, "Error in allocating memory for response %s\n", pzfile);
+        if (r != NULL) {
+            free(r->inv);
+            free(r->file);
+        }
+        free(r);
+        pthread_mutex_unlock(&responses_lock);
+        return NULL;
+    }
+    r->nfft = nfft;
+    r->delta = delta;
+    r->type = type;
+    memcpy(r->freq, freq, sizeof(r->freq));
+
+    for (k=0; k<nf; k++) {
+        double f = k / (nfft * (double)delta);
+        double w = 2. * M_PI * f;
+        double t = prefilter(freq, f);
+        double hr = c, hi = 0., ar, ai, m;
+        if (t == 0.) {
+            r->inv[2*k] = r->inv[2*k+1] = 0.f;
+            continue;
+        }
+        /* H = c * prod(s - z) / prod(s - p), s = i*w */
+        for (j=0; j<nzero; j++) {
+            ar = -zero[2*j];
+            ai = w - zero[2*j+1];
+            m = hr * ar - hi * ai;
+            hi = hr * ai + hi * ar;
+            hr = m;
+        }
+        for (j=0; j<npole; j++) {
+            ar = -pole[2*j];
+            ai = w - pole[2*j+1];
+            m = ar * ar + ai * ai;
+            ar /= m;
+            ai /= -m;
+            m = hr * ar - hi * ai;
+            hi = hr * ai + hi * ar;
+            hr = m;
+        }
+        /* s^type / H */
+        m = hr * hr + hi * hi;
+        if (m == 0.) {
+            r->inv[2*k] = r->inv[2*k+1] = 0.f;
+            continue;
+        }
+        ar = t * hr / m;
+        ai = -t * hi / m;
+        for (j=0; j<type; j++) {
+            m = -ai * w;
+            ai = ar * w;
+            ar = m;
+        }
+        r->inv[2*k] = (float)ar;
+        r->inv[2*k+1] = (float)ai;
+    }
+
+    r->next = responses;
+    responses = r;
+    pthread_mutex_unlock(&responses_lock);
+    return r;
+}
+
+/*
+ *  response_remove
+ *
+ *  Description: deconvolve npts samples of x in place by an inverse
+ *      response got for npts
+ *
+ *  Return: 0 if success, -1 if failed
+ *
+ */
+int response_remove(const RESPONSE *r, float *x, int npts)
+{
+    const int nfft = r->nfft;
+    float *z;
+    int k;
+
+    if (npts > INT_MAX / 2 || fft_size(2 * npts) != nfft) {
+        fprintf(stderr, "Response of %s not for %d samples\n", r->file, npts);
+        return -1;
+    }
+    if ((z = (float *)calloc(2 * nfft, sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for response removal\n");
+        return -1;
+    }
+    for (k=0; k<npts; k++) z[2*k] = x[k];
+    fft_forward(r->plan, z);
+
+    /* negative frequencies by the conjugate, so that the output is real */
+    for (k=0; k<=nfft/2; k++) {
+        float ar = r->inv[2*k], ai = r->inv[2*k+1];
+        float zr = z[2*k], zi = z[2*k+1];
+        z[2*k]   = zr * ar - zi * ai;
+        z[2*k+1] = zr * ai + zi * ar;
+        if (k > 0 && k < nfft/2) {
+            int j = nfft - k;
+            zr = z[2*j];
+            zi = z[2*j+1];
+            z[2*j]   = zr * ar + zi * ai;
+            z[2*j+1] = zi * ar - zr * ai;
+        }
+    }
+    fft_inverse(r->plan, z);
+    for (k=0; k<npts; k++) x[k] = z[2*k];
+    free(z);
+    return 0;
+}
+
+/*
+ *  read_pz: zeros, poles and constant of a SAC pole-zero file
+ */
+static int read_pz(const char *file, double *zero, int *nzero,
+                   double *pole, int *npole, double *c)
+{
+    FILE *fp;
+    char line[1024], key[32];
+    double re, im;
+    double *list = NULL;
+    int n, nlist = 0, error = 0;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        fprintf(stderr, "Unable to open pole-zero file %s\n", file);
+        return -1;
+    }
+    *nzero = *npole = 0;
+    *c = 1.;
+    memset(zero, 0, 2 * RESPONSE_MAX_PZ * sizeof(double));
+    memset(pole, 0, 2 * RESPONSE_MAX_PZ * sizeof(double));
+
+    while (fgets(line, sizeof(line), fp) != NULL && !error) {
+        if (line[0] == '*') continue;
+        if (sscanf(line, "%31s %d", key, &n) == 2
+                && (strcasecmp(key, "ZEROS") == 0 || strcasecmp(key, "POLES") == 0)) {
+            if (n < 0 || n > RESPONSE_MAX_PZ) {
+                error = 1;
+                break;
+            }
+            if (strcasecmp(key, "ZEROS") == 0) {
+                *nzero = n;
+                list = zero;
+            } else {
+                *npole = n;
+                list = pole;
+            }
+            nlist = 0;
+        } else if (sscanf(line, "%31s %lf", key, &re) == 2
+                && strcasecmp(key, "CONSTANT") == 0) {
+            *c = re;
+            list = NULL;
+        } else if (sscanf(line, "%lf %lf", &re, &im) == 2 && list != NULL) {
+            if (nlist == ((list == zero) ? *nzero : *npole)) {
+                error = 1;
+                break;
+            }
+            list[2*nlist] = re;
+            list[2*nlist+1] = im;
+            nlist++;
+        }
+    }
+    fclose(fp);
+    if (error) {
+        fprintf(stderr, "Invalid pole-zero file %s\n", file);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ *  prefilter: cosine taper of frequency f by f1, f2, f3 and f4
+ */
+static double prefilter(const double *freq, double f)
+{
+    if (f <= freq[0] || f >= freq[3]) return 0.;
+    if (f < freq[1]) return 0.5 - 0.5 * cos(M_PI * (f - freq[0]) / (freq[1] - freq[0]));
+    if (f > freq[2]) return 0.5 + 0.5 * cos(M_PI * (f - freq[2]) / (freq[3] - freq[2]));
+    return 1.;
+}
@@ -0,0 +1,23 @@
+/*
+ *  response.h
+ *
+ *  Removal of instrument responses given by SAC pole-zero files.
+ *
+ */
+#ifndef _RESPONSE_H
+#define _RESPONSE_H
+
+/* output of response removal */
+#define RESPONSE_DISP   0
+#define RESPONSE_VEL    1
+#define RESPONSE_ACC    2
+/* largest number of poles or zeros of a pole-zero file */
+#define RESPONSE_MAX_PZ 100
+
+typedef struct response RESPONSE;
+
+const RESPONSE *response_get(const char *pzfile, int npts, float delta,
+                             int type, const double *freq);
+int response_remove(const RESPONSE *r, float *x, int npts);
+
+#endif
@@ -13,15 +13,75 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <math.h>
+#include <sys/stat.h>
 #include "sacio.h"
 #include "datetime.h"
+#include "distaz.h"
+
+/* number of headers changed together */
+#define BLOCK   4096
+
+/* kind of a key=value pair */
+#define KV_FLOAT    0
+#define KV_INT      1
+#define KV_CHAR     2
+#define KV_TIME     3
+#define KV_ALLT     4
+
+typedef struct {
+    int kind;
+    int index;      /* index for numeric fields, byte offset for strings */
+    int tmark;      /* flag for value in DATETIME format or not */
+    double fvalue;
+    int ivalue;
+    char cvalue[SAC_HEADER_STRING_LENGTH_FILE*2+1];
+    DATETIME dt;
+} KEYVAL;
+
+/* a set of changes applied to one file */
+typedef struct {
+    KEYVAL *kv;
+    int n;
+} EDITS;
+
+/* key resolved for a column of the table */
+typedef struct {
+    char key[16];
+    int kind;
+    int index;
+} KEYCACHE;
+
+/* one row of a table */
+typedef struct {
+    char *file;
+    EDITS edits;
+} ROW;
+
+/* a file to change, with its local changes */
+typedef struct {
+    const char *file;
+    const EDITS *local;
+    int order;      /* position on the command line and in the table */
+    dev_t dev;      /* identity of the file, 0 if unknown */
+    ino_t ino;
+} TARGET;
 
 void usage(void);
 void datetime_undef(DATETIME *dt);
-DATETIME datetime_read(char *string);
+int datetime_read(const char *string, DATETIME *dt);
 DATETIME datetime_set_ref(SACHEAD hd);
 void datetime_add(DATETIME *dt, double span);
+int parse_keyval(const char *arg, KEYVAL *kv, KEYCACHE *cache);
+void edits_append(EDITS *ed, const KEYVAL *kv);
+void apply_edits(SACHEAD *hd, const EDITS *ed);
+int edit_head(const TARGET *t, int n, const EDITS *global, SACHEAD *hd);
+void update_distaz(SACHEAD *hd, int *ok, int n);
+ROW *read_table(const char *table, int *nrow);
+void free_rows(ROW *rows, int nrow);
+int compare_target(const void *a, const void *b);
+int same_file(const TARGET *x, const TARGET *y);
 
 void usage() {
     fprintf(stderr, "Change the value of selected head fields       \n");
@@ -30,6 +90,7 @@ void usage() {
     fprintf(stderr, "   sacch key1=value1 key2=value2 ... sacfiles  \n");
     fprintf(stderr, "   sacch time=DATETIME sacfiles                \n");
     fprintf(stderr, "   sacch allt=value sacfiles                   \n");
+    fprintf(stderr, "   sacch -F table [key1=value1 ...] [sacfiles] \n");
     fprintf(stderr, "                                               \n");
     fprintf(stderr, "Notes:                                         \n");
     fprintf(stderr, "   1. keys are sac head fields, like npts, evla\n");
@@ -40,6 +101,17 @@ void usage() {
     fprintf(stderr, "      in DATETIME format                       \n");
     fprintf(stderr, "   6. allt: add seconds to all defined header  \n");
     fprintf(stderr, "      times, and subtract seconds from refer time\n");
+    fprintf(stderr, "   7. -F: each line of table is                \n");
+    fprintf(stderr, "        sacfile key1=value1 key2=value2 ...    \n");
+    fprintf(stderr, "      key=value pairs on the command line are  \n");
+    fprintf(stderr, "      applied before those of each line.       \n");
+    fprintf(stderr, "   8. only SAC headers are rewritten. Changes  \n");
+    fprintf(stderr, "      of a file given more than once are all   \n");
+    fprintf(stderr, "      applied, in order of the command line    \n");
+    fprintf(stderr, "      and then the table.                      \n");
+    fprintf(stderr, "   9. if lcalda is true after the changes, dist,\n");
+    fprintf(stderr, "      az, baz and gcarc are computed from stla,\n");
+    fprintf(stderr, "      stlo, evla and evlo.                     \n");
     fprintf(stderr, "                                               \n");
     fprintf(stderr, "Examples:                                      \n");
     fprintf(stderr, "   sacch stla=10.2 stlo=20.2 kstnm=COLA seis1 seis2 \n");
@@ -47,188 +119,507 @@ void usage() {
     fprintf(stderr, "   sacch t7=2010-02-03T10:20:30.000 seis1           \n");
     fprintf(stderr, "   sacch t9=undef kt9=undef seis*                   \n");
     fprintf(stderr, "   sacch allt=10.23 seis*                           \n");
+    fprintf(stderr, "   sacch -F stations.tsv                            \n");
+    fprintf(stderr, "   sacch lcalda=1 evla=35.1 evlo=139.2 seis*        \n");
 }
 
-#define MAX_HEAD 20
 #define FNEQ(x,y) (fabs(x-y)>0.1)
 int main(int argc, char *argv[])
 {
-    struct {
-        int index;
-        int tmark;      // flag for value in DATETIME format or not
-        double value;
-    } Fkeyval[MAX_HEAD];
-
-    struct {
-        int index;
-        int value;
-    } Ikeyval[MAX_HEAD];
-
-    struct {
-        int offset;
-        char value[80];
-    } Ckeyval[MAX_HEAD];
-
-    int i, j;
-    char key[10];
-    char val[80];
-    DATETIME dt;
-    char *p;
-    int time = 0;
-    int fkey = 0;
-    int ikey = 0;
-    int ckey = 0;
-    int file = 0;
+    int c, i, k;
+    int nfile = 0;
+    int ntarget, ngroup = 0;
+    int nrow = 0;
+    int nerr = 0;
+    char *table = NULL;
+    ROW *rows = NULL;
+    TARGET *target;
+    SACHEAD *hd;
+    int *ok, *group;
+    EDITS global = {NULL, 0};
+    EDITS none = {NULL, 0};
+    KEYCACHE cache = {"", -1, -1};
 
-    /* ALLT option */
-    int lallt = 0;
-    float vallt = 0.0;
-
-    float *data;
-    char sacfile[80];
-    SACHEAD hd;
+    while ((c=getopt(argc, argv, "F:h")) != -1) {
+        switch (c) {
+            case 'F':
+                table = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
 
-    char args[80];
-    for (i=1; i<argc; i++) {
-        strcpy(args, argv[i]);
+    for (i=optind; i<argc; i++) {
+        KEYVAL kv;
 
-        if ((p = strchr(args, '=')) == NULL) {
+        if (strchr(argv[i], '=') == NULL) {
             /* no equal in argument, assume it is a SAC file */
-            file++;
+            nfile++;
             continue;
         }
 
         /* KEY=VALUE pairs */
-        *p = ' ';  sscanf(args, "%s %s", key, val);
-        if (strcasecmp(key, "time") == 0) {     /* TIME */
+        if (parse_keyval(argv[i], &kv, &cache) != 0) exit(-1);
+        edits_append(&global, &kv);
+    }
+
+    if (table != NULL) {
+        if ((rows = read_table(table, &nrow)) == NULL) exit(-1);
+    } else if (global.n == 0) {
+        usage();
+        exit(-1);
+    }
+
+    if (nfile + nrow == 0) {
+        usage();
+        exit(-1);
+    }
+
+    ntarget = nfile + nrow;
+    if ((target = (TARGET *)malloc(ntarget*sizeof(TARGET))) == NULL
+            || (group = (int *)malloc((ntarget+1)*sizeof(int))) == NULL
+            || (hd = (SACHEAD *)malloc(BLOCK*sizeof(SACHEAD))) == NULL
+            || (ok = (int *)malloc(BLOCK*sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (i=optind, k=0; i<argc; i++) {
+        /* skip key=value pairs */
+        if (strchr(argv[i], '=') != NULL) continue;
+        target[k].file = argv[i];
+        target[k++].local = &none;
+    }
+    for (i=0; i<nrow; i++) {
+        target[k].file = rows[i].file;
+        target[k++].local = &rows[i].edits;
+    }
+
+    /* targets of the same file are changed together, as one group */
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (i=0; i<ntarget; i++) {
+        struct stat st;
+        target[i].order = i;
+        target[i].dev = 0;
+        target[i].ino = 0;
+        if (stat(target[i].file, &st) == 0) {
+            target[i].dev = st.st_dev;
+            target[i].ino = st.st_ino;
+        }
+    }
+    qsort(target, ntarget, sizeof(TARGET), compare_target);
+    for (i=0; i<ntarget; i++)
+        if (i == 0 || !same_file(&target[i-1], &target[i]))
+            group[ngroup++] = i;
+    group[ngroup] = ntarget;
+
+    /* read and change headers of a block of files, compute distances
+     * and azimuths of the block together, and write headers */
+    for (k=0; k<ngroup; k+=BLOCK) {
+        int n = (ngroup - k < BLOCK) ? ngroup - k : BLOCK;
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (i=0; i<n; i++)
+            ok[i] = (edit_head(target + group[k+i], group[k+i+1] - group[k+i],
+                               &global, &hd[i]) == 0);
+
+        update_distaz(hd, ok, n);
+
+        #pragma omp parallel for schedule(dynamic, 64) reduction(+:nerr)
+        for (i=0; i<n; i++) {
+            if (!ok[i] || write_sac_head(target[group[k+i]].file, hd[i]) != 0) nerr++;
+        }
+    }
+
+    free(target);
+    free(group);
+    free(hd);
+    free(ok);
+    free(global.kv);
+    free_rows(rows, nrow);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  edit_head: read header of n targets of the same file, and apply global
+ *      changes and then local changes of each target in order to it
+ */
+int edit_head(const TARGET *t, int n, const EDITS *global, SACHEAD *hd)
+{
+    int i;
+
+    if (read_sac_head(t[0].file, hd) != 0) return -1;
+
+    apply_edits(hd, global);
+    for (i=0; i<n; i++)
+        apply_edits(hd, t[i].local);
+    return 0;
+}
+
+/*
+ *  compare_target: order targets by file, then by order
+ */
+int compare_target(const void *a, const void *b)
+{
+    const TARGET *x = (const TARGET *)a;
+    const TARGET *y = (const TARGET *)b;
+    int c;
+
+    if (x->dev != y->dev) return (x->dev < y->dev) ? -1 : 1;
+    if (x->ino != y->ino) return (x->ino < y->ino) ? -1 : 1;
+    /* files unable to stat are told by name */
+    if (x->ino == 0 && (c = strcmp(x->file, y->file)) != 0) return c;
+    return (x->order < y->order) ? -1 : (x->order > y->order);
+}
+
+/*
+ *  same_file: whether two targets are of the same file
+ */
+int same_file(const TARGET *x, const TARGET *y)
+{
+    if (x->dev != y->dev || x->ino != y->ino) return 0;
+    return x->ino != 0 || strcmp(x->file, y->file) == 0;
+}
+
+/*
+ *  update_distaz: set dist, az, baz and gcarc of headers with lcalda true
+ *      and defined stla, stlo, evla and evlo. If memory is not allocated,
+ *      headers with lcalda true are marked not ok.
+ */
+void update_distaz(SACHEAD *hd, int *ok, int n)
+{
+    double *evla, *evlo, *stla, *stlo;
+    double *gcarc, *az, *baz, *dist;
+    int *idx;
+    int i, j, m;
+
+    for (i=0, m=0; i<n; i++)
+        if (ok[i] && hd[i].lcalda == TRUE) m++;
+    if (m == 0) return;
+
+    if ((evla = (double *)malloc(8*m*sizeof(double))) == NULL
+            || (idx = (int *)malloc(m*sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for dist/az of %d files\n", m);
+        free(evla);
+        /* not written with stale distances */
+        for (i=0; i<n; i++)
+            if (hd[i].lcalda == TRUE) ok[i] = 0;
+        return;
+    }
+    evlo = evla + m;    stla = evla + 2*m;  stlo = evla + 3*m;
+    gcarc = evla + 4*m; az = evla + 5*m;    baz = evla + 6*m;
+    dist = evla + 7*m;
+
+    for (i=0, m=0; i<n; i++) {
+        if (!ok[i] || hd[i].lcalda != TRUE) continue;
+        if (!FNEQ(hd[i].stla, SAC_FLOAT_UNDEF) || !FNEQ(hd[i].stlo, SAC_FLOAT_UNDEF)
+                || !FNEQ(hd[i].evla, SAC_FLOAT_UNDEF)
+                || !FNEQ(hd[i].evlo, SAC_FLOAT_UNDEF)) continue;
+        evla[m] = hd[i].evla;
+        evlo[m] = hd[i].evlo;
+        stla[m] = hd[i].stla;
+        stlo[m] = hd[i].stlo;
+        idx[m++] = i;
+    }
+
+    distaz_batch(m, evla, evlo, stla, stlo, gcarc, az, baz, dist);
+
+    for (j=0; j<m; j++) {
+        SACHEAD *h = &hd[idx[j]];
+        h->gcarc = gcarc[j];
+        h->az = az[j];
+        h->baz = baz[j];
+        h->dist = dist[j];
+    }
+    free(evla);
+    free(idx);
+}
+
+void apply_edits(SACHEAD *hd, const EDITS *ed)
+{
+    DATETIME tref;
+    int j;
+    int time = 0;
+    DATETIME dt = {0};
+    int lallt = 0;
+    float vallt = 0.0;
+
+    if (ed->n == 0) return;
+
+    tref = datetime_set_ref(*hd);
+
+    for (j=0; j<ed->n; j++) {
+        const KEYVAL *kv = &ed->kv[j];
+        if (kv->kind == KV_FLOAT) {
+            float *pt = &hd->delta;
+            if (kv->tmark==0) {
+                *(pt + kv->index) = (float)kv->fvalue;
+            } else if (kv->tmark==1) {
+                *(pt + kv->index) = (float)(kv->fvalue - tref.epoch);
+            }
+        } else if (kv->kind == KV_INT) {
+            int *pt = &hd->nzyear;
+            *(pt + kv->index) = kv->ivalue;
+        } else if (kv->kind == KV_CHAR) {
+            char *pt = hd->kstnm;
+            strcpy(pt + kv->index, kv->cvalue);
+        } else if (kv->kind == KV_TIME) {
             time = 1;
-            if (strcasecmp(val, "undef") == 0)
-                datetime_undef(&dt);
-            else
-                dt = datetime_read(val);
-        } else if (strcasecmp(key, "allt") == 0) {  /* ALLT */
+            dt = kv->dt;
+        } else if (kv->kind == KV_ALLT) {
             lallt = 1;
-            vallt = (float)(atof(val));
-        } else {                                /* HEAD */
+            vallt = (float)kv->fvalue;
+        }
+    }
+
+    if (time) {
+        hd->nzyear = dt.year;
+        hd->nzjday = dt.doy;
+        hd->nzhour = dt.hour;
+        hd->nzmin  = dt.minute;
+        hd->nzsec  = dt.second;
+        hd->nzmsec = dt.msec;
+    }
+
+    if (lallt) {    /* ALLT option */
+        hd->b += vallt;
+        hd->e += vallt;
+        if (hd->nzyear != SAC_INT_UNDEF) {
+            datetime_add(&tref, -vallt);
+            hd->nzyear = tref.year;
+            hd->nzjday = tref.doy;
+            hd->nzhour = tref.hour;
+            hd->nzmin  = tref.minute;
+            hd->nzsec  = tref.second;
+            hd->nzmsec = tref.msec;
+        }
+        if (FNEQ(hd->a, SAC_FLOAT_UNDEF)) hd->a += vallt;
+        if (FNEQ(hd->f, SAC_FLOAT_UNDEF)) hd->f += vallt;
+        if (FNEQ(hd->o, SAC_FLOAT_UNDEF)) hd->o += vallt;
+        if (FNEQ(hd->t0, SAC_FLOAT_UNDEF)) hd->t0 += vallt;
+        if (FNEQ(hd->t1, SAC_FLOAT_UNDEF)) hd->t1 += vallt;
+        if (FNEQ(hd->t2, SAC_FLOAT_UNDEF)) hd->t2 += vallt;
+        if (FNEQ(hd->t3, SAC_FLOAT_UNDEF)) hd->t3 += vallt;
+        if (FNEQ(hd->t4, SAC_FLOAT_UNDEF)) hd->t4 += vallt;
+        if (FNEQ(hd->t5, SAC_FLOAT_UNDEF)) hd->t5 += vallt;
+        if (FNEQ(hd->t6, SAC_FLOAT_UNDEF)) hd->t6 += vallt;
+        if (FNEQ(hd->t7, SAC_FLOAT_UNDEF)) hd->t7 += vallt;
+        if (FNEQ(hd->t8, SAC_FLOAT_UNDEF)) hd->t8 += vallt;
+        if (FNEQ(hd->t9, SAC_FLOAT_UNDEF)) hd->t9 += vallt;
+    }
+}
+
+/*
+ *  parse_keyval: parse a key=value pair
+ *
+ *  The key is only looked up by sac_head_index if it differs from the
+ *  one resolved last time in cache, so that a column of a table is
+ *  resolved once.
+ *
+ *  Return: 0 if success, -1 if failed
+ */
+int parse_keyval(const char *arg, KEYVAL *kv, KEYCACHE *cache)
+{
+    const char *p;
+    char key[16];
+    char *val;
+    size_t len;
+
+    p = strchr(arg, '=');
+    len = (size_t)(p - arg);
+    if (len == 0 || len >= sizeof(key)) {
+        fprintf(stderr, "Error in sac head name: %.*s\n", (int)len, arg);
+        return -1;
+    }
+    memcpy(key, arg, len);
+    key[len] = '\0';
+    val = (char *)(p + 1);
+
+    if (strcasecmp(key, cache->key) != 0) {
+        strcpy(cache->key, key);
+        if (strcasecmp(key, "time") == 0) {
+            cache->kind = KV_TIME;
+        } else if (strcasecmp(key, "allt") == 0) {
+            cache->kind = KV_ALLT;
+        } else {
             int index = sac_head_index(key);
             if (index < 0) {
+                cache->key[0] = '\0';
                 fprintf(stderr, "Error in sac head name: %s\n", key);
-                exit(-1);
-            } else if (index >=0 && index < SAC_HEADER_FLOATS) {
-                Fkeyval[fkey].index = index;
-                Fkeyval[fkey].tmark = 0;
-                if (strcasecmp(val, "undef") == 0) {
-                    Fkeyval[fkey].value = SAC_FLOAT_UNDEF;
-                } else if ((strchr(val, 'T')) != NULL) {
-                    /* support datetime for time variables */
-                    DATETIME tvalue;
-                    tvalue = datetime_read(val);
-                    Fkeyval[fkey].value = tvalue.epoch;
-                    Fkeyval[fkey].tmark = 1;
-                } else {
-                    Fkeyval[fkey].value = atof(val);
-                }
-                fkey++;
+                return -1;
+            } else if (index < SAC_HEADER_FLOATS) {
+                cache->kind = KV_FLOAT;
+                cache->index = index;
             } else if (index < SAC_HEADER_NUMBERS) {
                 /* index relative to the start of int fields */
-                Ikeyval[ikey].index = index - SAC_HEADER_FLOATS;
-                if (strcasecmp(val, "undef") == 0)
-                    Ikeyval[ikey].value = SAC_INT_UNDEF;
-                else
-                    Ikeyval[ikey].value = atoi(val);
-                ikey++;
+                cache->kind = KV_INT;
+                cache->index = index - SAC_HEADER_FLOATS;
             } else {
-                /* offset in bytes relative to the start of */
-                Ckeyval[ckey].offset =
-                    (index - SAC_HEADER_NUMBERS) * SAC_HEADER_STRING_LENGTH;
-                if (strcasecmp(val, "undef") == 0) {  /* undefined chars */
-                    if (strcasecmp(key, "kevnm") == 0)
-                        strcpy(val, SAC_CHAR16_UNDEF);
-                    else
-                        strcpy(val, SAC_CHAR8_UNDEF);
-                }
-                strcpy(Ckeyval[ckey].value, val);
-                ckey++;
+                /* offset in bytes relative to the start of strings */
+                cache->kind = KV_CHAR;
+                cache->index = (index - SAC_HEADER_NUMBERS)
+                                    * SAC_HEADER_STRING_LENGTH;
             }
         }
     }
 
-    if (!(time || lallt || ikey || fkey || ckey) || !file) {
-        usage();
+    kv->kind = cache->kind;
+    kv->index = cache->index;
+    kv->tmark = 0;
+
+    switch (kv->kind) {
+        case KV_TIME:
+            if (strcasecmp(val, "undef") == 0)
+                datetime_undef(&kv->dt);
+            else if (datetime_read(val, &kv->dt) != 0)
+                return -1;
+            break;
+        case KV_ALLT:
+            kv->fvalue = atof(val);
+            break;
+        case KV_FLOAT:
+            if (strcasecmp(val, "undef") == 0) {
+                kv->fvalue = SAC_FLOAT_UNDEF;
+            } else if ((strchr(val, 'T')) != NULL) {
+                /* support datetime for time variables */
+                DATETIME tvalue;
+                if (datetime_read(val, &tvalue) != 0) return -1;
+                kv->fvalue = tvalue.epoch;
+                kv->tmark = 1;
+            } else {
+                kv->fvalue = atof(val);
+            }
+            break;
+        case KV_INT:
+            if (strcasecmp(val, "undef") == 0)
+                kv->ivalue = SAC_INT_UNDEF;
+            else
+                kv->ivalue = atoi(val);
+            break;
+        case KV_CHAR:
+            /* kevnm is the only string of 16 characters */
+            len = (strcasecmp(key, "kevnm") == 0) ?
+                    SAC_HEADER_STRING_LENGTH_FILE*2 :
+                    SAC_HEADER_STRING_LENGTH_FILE;
+            if (strcasecmp(val, "undef") == 0)
+                val = (len == SAC_HEADER_STRING_LENGTH_FILE) ?
+                        SAC_CHAR8_UNDEF : SAC_CHAR16_UNDEF;
+            strncpy(kv->cvalue, val, len);
+            kv->cvalue[len] = '\0';
+            break;
+    }
+    return 0;
+}
+
+void edits_append(EDITS *ed, const KEYVAL *kv)
+{
+    ed->kv = (KEYVAL *)realloc(ed->kv, (ed->n+1)*sizeof(KEYVAL));
+    if (ed->kv == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
         exit(-1);
     }
+    ed->kv[ed->n++] = *kv;
+}
 
-    for (i=1; i<argc; i++) {
-        DATETIME tref;
+/*
+ *  read_table: read a table of changes, each line is
+ *      sacfile key1=value1 key2=value2 ...
+ *
+ *  Empty lines and lines starting with '#' are skipped.
+ */
+ROW *read_table(const char *table, int *nrow)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t cap = 0;
+    int nline = 0;
+    int ncache = 0;
+    int n = 0;
+    int nmax = 0;
+    ROW *rows = NULL;
+    KEYCACHE *cache = NULL;
 
-        /* skip key=value pairs */
-        if ((strchr(argv[i], '=')) != NULL) continue;
+    if ((fp = fopen(table, "r")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", table);
+        return NULL;
+    }
 
-        strcpy(sacfile, argv[i]);
-        if ((data= read_sac(sacfile, &hd)) == NULL) continue;
+    while (getline(&line, &cap, fp) != -1) {
+        char *tok, *save;
+        int col;
 
-        tref = datetime_set_ref(hd);
+        nline++;
+        if ((tok = strtok_r(line, " \t\r\n", &save)) == NULL) continue;
+        if (tok[0] == '#') continue;
 
-        for (j=0; j<fkey; j++) {
-            float *pt = &hd.delta;
-            if (Fkeyval[j].tmark==0) {
-                *(pt + Fkeyval[j].index) = (float)Fkeyval[j].value;
-            } else if (Fkeyval[j].tmark==1) {
-                *(pt + Fkeyval[j].index) = (float)(Fkeyval[j].value - tref.epoch);
+        if (n == nmax) {
+            nmax = nmax ? 2*nmax : 1024;
+            if ((rows = (ROW *)realloc(rows, nmax*sizeof(ROW))) == NULL) {
+                fprintf(stderr, "Error in allocating memory\n");
+                exit(-1);
             }
         }
-        for (j=0; j<ikey; j++) {
-            int *pt = &hd.nzyear;
-            *(pt + Ikeyval[j].index) = Ikeyval[j].value;
-        }
-        for (j=0; j<ckey; j++) {
-            char *pt = hd.kstnm;
-            strcpy(pt+Ckeyval[j].offset, Ckeyval[j].value);
-        }
-
-        if (time) {
-            hd.nzyear = dt.year;
-            hd.nzjday = dt.doy;
-            hd.nzhour = dt.hour;
-            hd.nzmin  = dt.minute;
-            hd.nzsec  = dt.second;
-            hd.nzmsec = dt.msec;
+        if ((rows[n].file = strdup(tok)) == NULL) {
+            fprintf(stderr, "Error in allocating memory\n");
+            exit(-1);
         }
+        rows[n].edits.kv = NULL;
+        rows[n].edits.n = 0;
 
-        if (lallt) {    /* ALLT option */
-            hd.b += vallt;
-            hd.e += vallt;
-            if (hd.nzyear != SAC_INT_UNDEF) {
-                datetime_add(&tref, -vallt);
-                hd.nzyear = tref.year;
-                hd.nzjday = tref.doy;
-                hd.nzhour = tref.hour;
-                hd.nzmin  = tref.minute;
-                hd.nzsec  = tref.second;
-                hd.nzmsec = tref.msec;
+        for (col=0; (tok=strtok_r(NULL, " \t\r\n", &save))!=NULL; col++) {
+            KEYVAL kv;
+            if (col == ncache) {
+                if ((cache = (KEYCACHE *)realloc(cache, (ncache+1)*sizeof(KEYCACHE))) == NULL) {
+                    fprintf(stderr, "Error in allocating memory\n");
+                    exit(-1);
+                }
+                cache[ncache].key[0] = '\0';
+                ncache++;
             }
-            if (FNEQ(hd.a, SAC_FLOAT_UNDEF)) hd.a += vallt;
-            if (FNEQ(hd.f, SAC_FLOAT_UNDEF)) hd.f += vallt;
-            if (FNEQ(hd.o, SAC_FLOAT_UNDEF)) hd.o += vallt;
-            if (FNEQ(hd.t0, SAC_FLOAT_UNDEF)) hd.t0 += vallt;
-            if (FNEQ(hd.t1, SAC_FLOAT_UNDEF)) hd.t1 += vallt;
-            if (FNEQ(hd.t2, SAC_FLOAT_UNDEF)) hd.t2 += vallt;
-            if (FNEQ(hd.t3, SAC_FLOAT_UNDEF)) hd.t3 += vallt;
-            if (FNEQ(hd.t4, SAC_FLOAT_UNDEF)) hd.t4 += vallt;
-            if (FNEQ(hd.t5, SAC_FLOAT_UNDEF)) hd.t5 += vallt;
-            if (FNEQ(hd.t6, SAC_FLOAT_UNDEF)) hd.t6 += vallt;
-            if (FNEQ(hd.t7, SAC_FLOAT_UNDEF)) hd.t7 += vallt;
-            if (FNEQ(hd.t8, SAC_FLOAT_UNDEF)) hd.t8 += vallt;
-            if (FNEQ(hd.t9, SAC_FLOAT_UNDEF)) hd.t9 += vallt;
+            if (strchr(tok, '=') == NULL
+                    || parse_keyval(tok, &kv, &cache[col]) != 0) {
+                fprintf(stderr, "Error in line %d of %s: %s\n",
+                        nline, table, tok);
+                exit(-1);
+            }
+            edits_append(&rows[n].edits, &kv);
         }
+        n++;
+    }
+    free(line);
+    free(cache);
+    fclose(fp);
+
+    *nrow = n;
+    if (rows == NULL && (rows = (ROW *)malloc(sizeof(ROW))) == NULL)
+        fprintf(stderr, "Error in allocating memory\n");
+    return rows;
+}
+
+/*
+ *  free_rows: free rows of a table
+ */
+void free_rows(ROW *rows, int nrow)
+{
+    int i;
 
-        write_sac(sacfile, hd, data);
-        free(data);
+    if (rows == NULL) return;
+    for (i=0; i<nrow; i++) {
+        free(rows[i].file);
+        free(rows[i].edits.kv);
     }
-    return 0;
+    free(rows);
 }
 
-DATETIME datetime_read(char *string)
+/*
+ *  datetime_read: read a time in DATETIME format
+ *
+ *  Return: 0 if success, -1 if the format, month or day is invalid
+ */
+int datetime_read(const char *string, DATETIME *dt)
 {
     int num;
     float secs;
@@ -238,13 +629,18 @@ DATETIME datetime_read(char *string)
                  &year, &month, &day, &hour, &minute, &secs);
 
     if (num != 6) {
-        fprintf(stderr, "Error in time format\n");
-        exit(-1);
+        fprintf(stderr, "Error in time format %s\n", string);
+        return -1;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31) {
+        fprintf(stderr, "Error in month or day of %s\n", string);
+        return -1;
     }
     second  = (int)(floor(secs));
     msec = (int)((secs - (float)second) * 1000 + 0.5);
 
-    return datetime_new(year, month, day, hour, minute, second, msec);
+    *dt = datetime_new(year, month, day, hour, minute, second, msec);
+    return 0;
 }
 
 void datetime_undef(DATETIME *dt)
@@ -0,0 +1,118 @@
+/*
+ *  Pack or unpack data of SAC files in place
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sacio.h"
+
+void usage(void);
+
+void usage()
+{
+    fprintf(stderr, "Pack or unpack data of SAC files losslessly in place     \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Usage:                                                   \n");
+    fprintf(stderr, "  saccomp [-d] [-S] [-L filelist] [sacfiles]             \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Options:                                                 \n");
+    fprintf(stderr, "  -d   unpack files to plain SAC format                  \n");
+    fprintf(stderr, "  -S   sync outputs in groups before renaming them, so   \n");
+    fprintf(stderr, "       that files are old or new after a crash           \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line\n");
+    fprintf(stderr, "  -h   show usage.                                       \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Notes:                                                   \n");
+    fprintf(stderr, "  1. integer samples, e.g. raw counts, are stored as     \n");
+    fprintf(stderr, "     bit packed differences, other blocks stay raw.      \n");
+    fprintf(stderr, "  2. packed files are read by read_sac and read_sac_pdw  \n");
+    fprintf(stderr, "     transparently, but not by other SAC programs.       \n");
+    fprintf(stderr, "  3. depmin, depmax and depmen are updated.              \n");
+    fprintf(stderr, "  4. packing saves space, not time: decoding packed data \n");
+    fprintf(stderr, "     is slower than reading plain files from the cache,  \n");
+    fprintf(stderr, "     so unpack files which are read over and over.       \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Examples:                                                \n");
+    fprintf(stderr, "  saccomp seis*                                          \n");
+    fprintf(stderr, "  saccomp -S -d -L archive.lst                           \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i;
+    char *list = NULL;
+    char **files;
+    int nfile;
+    int flags = SAC_WRITE_ATOMIC | SAC_WRITE_STATS | SAC_WRITE_PACK;
+    int nerr = 0;
+    long long size0 = 0, size1 = 0;
+    char *done;
+
+    while ((c=getopt(argc, argv, "dSL:h")) != -1) {
+        switch (c) {
+            case 'd':
+                flags &= ~SAC_WRITE_PACK;
+                break;
+            case 'S':
+                flags |= SAC_WRITE_BATCH;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+
+    if (nfile == 0) {
+        usage();
+        exit(-1);
+    }
+    if ((done = (char *)calloc(nfile, 1)) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:nerr,size0,size1)
+    for (i=0; i<nfile; i++) {
+        SACHEAD hd;
+        struct stat st;
+        float *data;
+
+        if (stat(files[i], &st) != 0
+                || (data = read_sac(files[i], &hd)) == NULL) {
+            nerr++;
+            continue;
+        }
+        size0 += st.st_size;
+        if (write_sac_opt(files[i], hd, data, flags) != 0)
+            nerr++;
+        else
+            done[i] = 1;
+        free(data);
+    }
+    /* files of a batch are renamed by the commit */
+    if (flags & SAC_WRITE_BATCH) nerr += sac_write_commit();
+
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+:size1)
+    for (i=0; i<nfile; i++) {
+        struct stat st;
+        if (done[i] && stat(files[i], &st) == 0) size1 += st.st_size;
+    }
+    free(done);
+
+    printf("%d of %d files converted, %lld -> %lld bytes\n",
+           nfile - nerr, nfile, size0, size1);
+    return nerr ? -1 : 0;
+}
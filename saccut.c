@@ -0,0 +1,434 @@
+/*
+ *  Cut time windows from SAC files in bulk
+ *
+ *  Jobs are grouped by input file and sorted by offset, so that each input
+ *  file is opened once and read sequentially. Windows follow the semantics
+ *  of read_sac_pdw, including zero padding outside of the data, but e is the
+ *  time of the last sample of the window. Each window
+ *  is read on its own by a stream, and when the input file is in native
+ *  byte order, samples are copied to the output by copy_file_range without
+ *  passing through user space (see sac_stream_copy). Packed input files are
+ *  read once in full.
+ *
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sacio.h"
+
+typedef struct {
+    char *sacfile;
+    char *outfile;
+    int tmark;
+    float t1, t2;
+    SACHEAD hd;     /* header of the window */
+    int nt1;        /* index of the first sample of the window in file */
+    int line;
+    dev_t dev;      /* device and inode of the directory of outfile */
+    ino_t ino;
+} JOB;
+
+void usage(void);
+JOB *read_jobs(const char *list, int *njob);
+void free_jobs(JOB *job, int n);
+int check_outputs(JOB *job, int n, const char *list);
+int cut_file(JOB *job, int n);
+int cut_stream(SACSTREAM *in, const JOB *job, int npts);
+int cut_buffer(const float *buf, const JOB *job, int npts);
+int write_zeros(SACSTREAM *s, int n);
+int compare_file(const void *a, const void *b);
+int compare_offset(const void *a, const void *b);
+int compare_output(const void *a, const void *b);
+
+/* writer of windows cut from packed files */
+SACWRITER *writer;
+/* flags of output files written by streams */
+int wflags = 0;
+
+void usage()
+{
+    fprintf(stderr, "Cut time windows from SAC files in bulk               \n");
+    fprintf(stderr, "                                                      \n");
+    fprintf(stderr, "Usage:                                                \n");
+    fprintf(stderr, "  saccut [-S] joblist                                 \n");
+    fprintf(stderr, "                                                      \n");
+    fprintf(stderr, "Options:                                              \n");
+    fprintf(stderr, "  -S   write each output to a temporary file, sync it \n");
+    fprintf(stderr, "       and rename it, so that it is complete or absent\n");
+    fprintf(stderr, "       after a crash                                  \n");
+    fprintf(stderr, "  -h   show usage.                                    \n");
+    fprintf(stderr, "                                                      \n");
+    fprintf(stderr, "Notes:                                                \n");
+    fprintf(stderr, "  1. each line of joblist is                          \n");
+    fprintf(stderr, "       sacfile tmark t1 t2 outfile                    \n");
+    fprintf(stderr, "     which cuts tmark+t1 to tmark+t2 of sacfile.      \n");
+    fprintf(stderr, "  2. tmark: -5(b), -4(e), -3(o), -2(a), 0-9(Tn),      \n");
+    fprintf(stderr, "     others(t=0), the same as read_sac_pdw.           \n");
+    fprintf(stderr, "  3. data out of the file are filled with zeros.      \n");
+    fprintf(stderr, "  4. e of outputs is the time of their last sample.   \n");
+    fprintf(stderr, "  5. outfile must differ among lines. An outfile that \n");
+    fprintf(stderr, "     is its sacfile is written to a temporary file and \n");
+    fprintf(stderr, "     renamed.                                          \n");
+    fprintf(stderr, "                                                      \n");
+    fprintf(stderr, "Examples:                                             \n");
+    fprintf(stderr, "  saccut jobs.lst                                     \n");
+}
+
+int main(int argc, char *argv[])
+{
+    JOB *job;
+    int *first;
+    int njob, ngroup;
+    int durability = SAC_DURABLE_NONE;
+    int i, c, nerr = 0;
+
+    while ((c = getopt(argc, argv, "Sh")) != -1) {
+        switch (c) {
+            case 'S':
+                wflags = SAC_WRITE_SYNC;
+                durability = SAC_DURABLE_FSYNC;
+                break;
+            case 'h':
+                usage();
+                exit(0);
+            default:
+                usage();
+                exit(-1);
+        }
+    }
+    if (argc - optind != 1) {
+        usage();
+        exit(-1);
+    }
+
+    if ((job = read_jobs(argv[optind], &njob)) == NULL) exit(-1);
+
+    /* group jobs by input file */
+    qsort(job, njob, sizeof(JOB), compare_file);
+    if ((first = (int *)malloc((njob+1)*sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (i=0, ngroup=0; i<njob; i++)
+        if (i == 0 || strcmp(job[i].sacfile, job[i-1].sacfile) != 0)
+            first[ngroup++] = i;
+    first[ngroup] = njob;
+
+    if ((writer = sac_writer_new(4, 64, durability)) == NULL) exit(-1);
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+    for (i=0; i<ngroup; i++)
+        nerr += cut_file(job + first[i], first[i+1] - first[i]);
+
+    nerr += sac_writer_close(writer);
+
+    if (nerr) fprintf(stderr, "%d of %d windows failed\n", nerr, njob);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  cut_file: cut all windows of the same input file
+ *
+ *  Return: number of failed windows
+ */
+int cut_file(JOB *job, int n)
+{
+    SACHEAD hd;
+    SACSTREAM *in;
+    int i, nok;
+    int nerr = 0;
+
+    if (read_sac_head(job[0].sacfile, &hd) != 0) return n;
+    if (hd.iftype == IXY) {
+        fprintf(stderr, "%s is not evenly spaced\n", job[0].sacfile);
+        return n;
+    }
+
+    /* windows of all jobs, sorted by offset */
+    for (i=0, nok=0; i<n; i++) {
+        JOB tmp;
+        job[i].hd = hd;
+        switch (sac_pdw_head(&job[i].hd, job[i].tmark, job[i].t1, job[i].t2,
+                             &job[i].nt1)) {
+            case -1:
+                fprintf(stderr, "Empty window in line %d\n", job[i].line);
+                nerr++;
+                continue;
+            case -2:
+                fprintf(stderr, "Time mark undefined in %s\n", job[i].sacfile);
+                nerr++;
+                continue;
+        }
+        /* e of the last sample, as set by sac_stream_close */
+        job[i].hd.e = job[i].hd.b + (job[i].hd.npts - 1) * job[i].hd.delta;
+        tmp = job[nok];
+        job[nok++] = job[i];
+        job[i] = tmp;
+    }
+    if (nok == 0) return nerr;
+    qsort(job, nok, sizeof(JOB), compare_offset);
+
+    if (hd.unused17 == SAC_DATA_PACKED
+            && strstr(job[0].sacfile, SAC_BUNDLE_EXT ":") == NULL) {
+        /* packed, decode the whole file once */
+        SACHEAD tmp;
+        float *buf;
+        if ((buf = read_sac(job[0].sacfile, &tmp)) == NULL) {
+            nerr += nok;
+        } else {
+            for (i=0; i<nok; i++)
+                if (cut_buffer(buf, &job[i], hd.npts) != 0) nerr++;
+        }
+        free(buf);
+        return nerr;
+    }
+
+    if ((in = sac_stream_open(job[0].sacfile, &hd)) == NULL) return nerr + nok;
+    for (i=0; i<nok; i++)
+        if (cut_stream(in, &job[i], hd.npts) != 0) nerr++;
+    sac_stream_close(in);
+    return nerr;
+}
+
+/*
+ *  cut_stream: write window of a file read by stream in
+ */
+int cut_stream(SACSTREAM *in, const JOB *job, int npts)
+{
+    SACSTREAM *out;
+    int nt1 = job->nt1;
+    int nt2 = job->nt1 + job->hd.npts;
+    int lead, tail;
+    int flags = wflags;
+
+    if (nt1>npts || nt2<0) {    /* zero filled window */
+        lead = job->hd.npts;
+        tail = 0;
+        nt1 = nt2 = 0;
+    } else {
+        lead = (nt1 < 0) ? -nt1 : 0;
+        tail = (nt2 > npts) ? nt2 - npts : 0;
+        if (nt1 < 0) nt1 = 0;
+        if (nt2 > npts) nt2 = npts;
+    }
+
+    /* not truncating the input before it is copied */
+    if (sac_same_file(job->sacfile, job->outfile)) flags |= SAC_WRITE_ATOMIC;
+    if ((out = sac_stream_create(job->outfile, job->hd, flags)) == NULL)
+        return -1;
+    if (write_zeros(out, lead) != 0
+            || sac_stream_seek(in, nt1) != 0
+            || sac_stream_copy(out, in, nt2 - nt1) != 0
+            || write_zeros(out, tail) != 0) {
+        sac_stream_cancel(out);
+        return -1;
+    }
+    return sac_stream_close(out);
+}
+
+/*
+ *  cut_buffer: write window from samples of the file in buf
+ *      by the asynchronous writer
+ */
+int cut_buffer(const float *buf, const JOB *job, int npts)
+{
+    float *ar;
+    int nt1 = job->nt1;
+    int nt2 = job->nt1 + job->hd.npts;
+
+    if ((ar = (float *)calloc((size_t)job->hd.npts, SAC_DATA_SIZEOF)) == NULL) {
+        fprintf(stderr, "Error in allocating memory for %s\n", job->outfile);
+        return -1;
+    }
+    if (!(nt1>npts || nt2<0)) {
+        float *fpt = ar;
+        if (nt1 < 0) {
+            fpt = ar - nt1;
+            nt1 = 0;
+        }
+        if (nt2 > npts) nt2 = npts;
+        if (nt2 > nt1)
+            memcpy(fpt, buf + nt1, (size_t)(nt2 - nt1)*SAC_DATA_SIZEOF);
+    }
+    return sac_writer_submit(writer, job->outfile, job->hd, ar);
+}
+
+/*
+ *  write_zeros: append n zeros to a stream
+ */
+int write_zeros(SACSTREAM *s, int n)
+{
+    static const float zeros[16384];
+
+    while (n > 0) {
+        int len = n < 16384 ? n : 16384;
+        if (sac_stream_write(s, zeros, len) != 0) return -1;
+        n -= len;
+    }
+    return 0;
+}
+
+int compare_file(const void *a, const void *b)
+{
+    const JOB *x = (const JOB *)a;
+    const JOB *y = (const JOB *)b;
+    int cmp = strcmp(x->sacfile, y->sacfile);
+
+    return cmp ? cmp : x->line - y->line;
+}
+
+int compare_offset(const void *a, const void *b)
+{
+    const JOB *x = (const JOB *)a;
+    const JOB *y = (const JOB *)b;
+
+    if (x->nt1 != y->nt1) return x->nt1 < y->nt1 ? -1 : 1;
+    return x->line - y->line;
+}
+
+/*
+ *  compare_output: order jobs by directory of outfile and base name,
+ *      or by outfile if the directory is not found
+ */
+int compare_output(const void *a, const void *b)
+{
+    const JOB *x = (const JOB *)a;
+    const JOB *y = (const JOB *)b;
+    const char *bx, *by;
+
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    if (x->ino == 0) return strcmp(x->outfile, y->outfile);
+    bx = strrchr(x->outfile, '/');
+    by = strrchr(y->outfile, '/');
+    return strcmp(bx ? bx + 1 : x->outfile, by ? by + 1 : y->outfile);
+}
+
+/*
+ *  read_jobs: read job list, each line is
+ *      sacfile tmark t1 t2 outfile
+ */
+JOB *read_jobs(const char *list, int *njob)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t cap = 0;
+    int nline = 0;
+    int n = 0, nmax = 0;
+    JOB *job = NULL, *tmp;
+
+    if ((fp = fopen(list, "r")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", list);
+        return NULL;
+    }
+
+    while (getline(&line, &cap, fp) != -1) {
+        char sacfile[4096], outfile[4096];
+        char c;
+        int tmark;
+        float t1, t2;
+
+        nline++;
+        if (sscanf(line, " %c", &c) != 1 || c == '#') continue;
+        if (sscanf(line, "%4095s %d %f %f %4095s",
+                   sacfile, &tmark, &t1, &t2, outfile) != 5) {
+            fprintf(stderr, "Error in line %d of %s\n", nline, list);
+            goto error;
+        }
+        if (n == nmax) {
+            nmax = nmax ? 2*nmax : 1024;
+            if ((tmp = (JOB *)realloc(job, nmax*sizeof(JOB))) == NULL) {
+                fprintf(stderr, "Error in allocating memory\n");
+                goto error;
+            }
+            job = tmp;
+        }
+        job[n].sacfile = strdup(sacfile);
+        job[n].outfile = strdup(outfile);
+        job[n].tmark = tmark;
+        job[n].t1 = t1;
+        job[n].t2 = t2;
+        job[n].line = nline;
+        /* counted first, so that free_jobs frees it */
+        n++;
+        if (job[n-1].sacfile == NULL || job[n-1].outfile == NULL) {
+            fprintf(stderr, "Error in allocating memory\n");
+            goto error;
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    if (n == 0) {
+        fprintf(stderr, "No job in %s\n", list);
+        free(job);
+        return NULL;
+    }
+    if (check_outputs(job, n, list) != 0) {
+        free_jobs(job, n);
+        return NULL;
+    }
+    *njob = n;
+    return job;
+
+error:
+    free(line);
+    fclose(fp);
+    free_jobs(job, n);
+    return NULL;
+}
+
+void free_jobs(JOB *job, int n)
+{
+    int i;
+
+    for (i=0; i<n; i++) {
+        free(job[i].sacfile);
+        free(job[i].outfile);
+    }
+    free(job);
+}
+
+/*
+ *  check_outputs: reject jobs writing the same output, which would be
+ *      written in parallel. Outputs are told by the directory, by device
+ *      and inode, and the base name, so that other paths of the same
+ *      directory are found too.
+ *
+ *  Return: 0 if outputs are distinct, -1 if not
+ */
+int check_outputs(JOB *job, int n, const char *list)
+{
+    char dir[4096];
+    char *p;
+    struct stat st;
+    int i;
+
+    for (i=0; i<n; i++) {
+        job[i].dev = 0;
+        job[i].ino = 0;
+        if ((p = strrchr(job[i].outfile, '/')) == NULL) {
+            strcpy(dir, ".");
+        } else {
+            int len = (p == job[i].outfile) ? 1 : (int)(p - job[i].outfile);
+            memcpy(dir, job[i].outfile, len);
+            dir[len] = '\0';
+        }
+        if (stat(dir, &st) == 0) {
+            job[i].dev = st.st_dev;
+            job[i].ino = st.st_ino;
+        }
+    }
+    qsort(job, n, sizeof(JOB), compare_output);
+    for (i=1; i<n; i++) {
+        if (compare_output(&job[i-1], &job[i]) == 0) {
+            fprintf(stderr, "Output %s of line %d of %s is also of line %d\n",
+                    job[i].outfile, job[i].line, list, job[i-1].line);
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ *  Filter SAC files by Butterworth or FIR filters
+ *
+ *  Files of the same delta and npts are filtered FILTER_LANES at a time
+ *  by the multi-channel Butterworth filter, and batches of files are
+ *  filtered in parallel. FIR filters are designed once per delta and
+ *  shared by all files.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include "sacio.h"
+#include "filter.h"
+
+/* file to be filtered */
+typedef struct {
+    int     ifile;
+    float   delta;
+    int     npts;
+} ITEM;
+
+void usage(void);
+int compare_item(const void *a, const void *b);
+int filter_batch(char **files, const ITEM *item, int n);
+
+/* options */
+int type = -1;
+double f1, f2 = 0.;
+int order = 4;
+int zerophase = 0;
+int ntap = 0;       /* taps of FIR, 0 for Butterworth */
+char *dir = NULL;
+
+void usage()
+{
+    fprintf(stderr, "Filter SAC files by Butterworth or FIR filters             \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacfilter -Fband [-Norder] [-Z] [-Mntap] [-D dir]        \n");
+    fprintf(stderr, "            [-L filelist] [sacfiles]                       \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -F   band: bp/f1/f2 bandpass, lp/f lowpass, hp/f highpass\n");
+    fprintf(stderr, "  -N   order of Butterworth filter, 1 to 10 (default 4)    \n");
+    fprintf(stderr, "  -Z   zero phase, filter forward and backward             \n");
+    fprintf(stderr, "  -M   FIR filter of ntap taps instead of Butterworth,     \n");
+    fprintf(stderr, "       always zero phase                                   \n");
+    fprintf(stderr, "  -D   directory of output files, default is to overwrite  \n");
+    fprintf(stderr, "       input files                                         \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. frequencies are in Hz, below the Nyquist frequency.   \n");
+    fprintf(stderr, "  2. FIR filters are windowed sinc (Hamming), applied by   \n");
+    fprintf(stderr, "     FFT, fit for long filters.                            \n");
+    fprintf(stderr, "  3. depmin, depmax and depmen are updated.                \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacfilter -Fbp/0.02/0.1 -N4 -Z seis*                     \n");
+    fprintf(stderr, "  sacfilter -Flp/1 -M2001 -D lp -L day.lst                 \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j;
+    int error = 0;
+    char *list = NULL;
+    char **files;
+    int nfile, nitem, nbatch, nerr = 0;
+    ITEM *item;
+    int *batch;
+    char band[3];
+
+    while ((c=getopt(argc, argv, "F:N:ZM:D:L:h")) != -1) {
+        switch (c) {
+            case 'F':
+                if (sscanf(optarg, "%2[a-z]/%lf/%lf", band, &f1, &f2) < 2) {
+                    error = 1;
+                } else if (strcmp(band, "lp") == 0) {
+                    type = FILTER_LOWPASS;
+                } else if (strcmp(band, "hp") == 0) {
+                    type = FILTER_HIGHPASS;
+                } else if (strcmp(band, "bp") == 0) {
+                    type = FILTER_BANDPASS;
+                } else {
+                    error = 1;
+                }
+                break;
+            case 'N':
+                order = atoi(optarg);
+                break;
+            case 'Z':
+                zerophase = 1;
+                break;
+            case 'M':
+                if ((ntap = atoi(optarg)) <= 0) error = 1;
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || type < 0 || error) {
+        usage();
+        exit(-1);
+    }
+
+    if ((item = (ITEM *)malloc(nfile*sizeof(ITEM))) == NULL
+            || (batch = (int *)malloc((nfile+1)*sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+
+    /* headers, to batch files of the same delta and npts */
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+:nerr)
+    for (i=0; i<nfile; i++) {
+        SACHEAD hd;
+        item[i].ifile = i;
+        item[i].npts = -1;
+        if (read_sac_head(files[i], &hd) != 0) {
+            nerr++;
+        } else if (hd.iftype == IXY) {
+            fprintf(stderr, "Warning: IXY file %s skipped\n", files[i]);
+            nerr++;
+        } else {
+            item[i].delta = hd.delta;
+            item[i].npts = hd.npts;
+        }
+    }
+    for (i=0, nitem=0; i<nfile; i++)
+        if (item[i].npts >= 0) item[nitem++] = item[i];
+    qsort(item, nitem, sizeof(ITEM), compare_item);
+
+    for (i=0, nbatch=0; i<nitem; i=j) {
+        for (j=i+1; j<nitem && j-i<FILTER_LANES && item[j].delta == item[i].delta
+                && item[j].npts == item[i].npts; j++)
+            ;
+        batch[nbatch++] = i;
+    }
+    batch[nbatch] = nitem;
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+    for (i=0; i<nbatch; i++)
+        nerr += filter_batch(files, item + batch[i], batch[i+1] - batch[i]);
+
+    printf("%d of %d files filtered\n", nfile - nerr, nfile);
+    free(item);
+    free(batch);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  filter_batch
+ *
+ *  Description: filter n files of the same delta and npts
+ *
+ *  Return: number of files failed
+ */
+int filter_batch(char **files, const ITEM *item, int n)
+{
+    SACHEAD hd[FILTER_LANES];
+    float *data[FILTER_LANES];
+    int ifile[FILTER_LANES];
+    char out[PATH_MAX];
+    FILTER *bw = NULL;
+    const FIRFILTER *fir = NULL;
+    int i, m = 0, nerr = 0;
+
+    if (ntap > 0)
+        fir = filter_fir(type, ntap, f1, f2, item[0].delta);
+    else
+        bw = filter_butter(type, order, f1, f2, item[0].delta);
+    if (fir == NULL && bw == NULL) return n;
+
+    /* files read are packed into the first m lanes */
+    for (i=0; i<n; i++) {
+        if ((data[m] = read_sac(files[item[i].ifile], &hd[m])) == NULL)
+            nerr++;
+        else
+            ifile[m++] = item[i].ifile;
+    }
+
+    if (bw != NULL) {
+        if (m > 0) filter_apply_multi(bw, data, m, item[0].npts, zerophase);
+    } else {
+        for (i=0; i<m; i++)
+            if (filter_fir_apply(fir, data[i], item[0].npts) != 0) {
+                free(data[i]);
+                data[i] = NULL;
+                nerr++;
+            }
+    }
+
+    for (i=0; i<m; i++) {
+        if (data[i] == NULL) continue;
+        if (sac_out_name(files[ifile[i]], dir, NULL, out, sizeof(out)) != 0
+                || write_sac_opt(out, hd[i], data[i],
+                                 SAC_WRITE_ATOMIC|SAC_WRITE_STATS) != 0)
+            nerr++;
+        free(data[i]);
+    }
+    filter_free(bw);
+    return nerr;
+}
+
+/*
+ *  compare_item: order files by delta, npts, then by name
+ */
+int compare_item(const void *a, const void *b)
+{
+    const ITEM *x = (const ITEM *)a;
+    const ITEM *y = (const ITEM *)b;
+
+    if (x->delta != y->delta) return (x->delta > y->delta) - (x->delta < y->delta);
+    if (x->npts != y->npts) return (x->npts > y->npts) - (x->npts < y->npts);
+    return (x->ifile > y->ifile) - (x->ifile < y->ifile);
+}
@@ -0,0 +1,479 @@
+/*
+ *  Estimate slowness and back-azimuth of waves across an array by f-k
+ *  beamforming of SAC files
+ *
+ *  Channels are read on a common time grid, and each sliding window of
+ *  each channel is transformed once. Beam power over a grid of slowness
+ *  is summed over frequencies of a band. Steering vectors separate into
+ *  east and north factors tabulated once, so that beams of a row of the
+ *  grid are a product of the spectra by a table, computed in tiles of
+ *  rows and blocks of frequencies in parallel.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "sacio.h"
+#include "sacmatrix.h"
+#include "datetime.h"
+#include "distaz.h"
+#include "fft.h"
+
+/* samples of each channel read at a time */
+#define CHUNK   (1 << 20)
+/* rows of the grid and frequencies of a task */
+#define TILE    4
+#define FBLOCK  8
+
+void usage(void);
+int write_grid_head(FILE *fp, int nwin, int n, double t0, double dt,
+                    double s0, double ds);
+int spectra(const SACMATRIX *m, int j0, float *xr, float *xi);
+int beam(const float *xr, const float *xi, float *part, float *power);
+
+/* options */
+double win = 0., step = 0.;
+double f1 = 0., f2 = 0.;
+double smax = 0., ds = 0.;
+double vel = 0.;
+
+/* array and windows */
+int nsta, nwin, nfft, k1, nf, n, nfb;
+float *taper;
+double *stat;               /* elevation statics in seconds */
+const FFTPLAN *plan;
+float *exr, *exi;           /* [nf][nsta][n] east and north factors */
+float *eyr, *eyi;           /*   of steering vectors */
+
+void usage()
+{
+    fprintf(stderr, "Estimate slowness and back-azimuth of waves across an      \n");
+    fprintf(stderr, "array by f-k beamforming of SAC files                      \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacfk -Wwindow/step -Ff1/f2 -Ssmax/ds [-Vvelocity]       \n");
+    fprintf(stderr, "        [-G gridfile] [-L filelist] [sacfiles]             \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -W   length and step of sliding windows in seconds       \n");
+    fprintf(stderr, "  -F   band of frequencies in Hz                           \n");
+    fprintf(stderr, "  -S   largest slowness and step of the grid of slowness   \n");
+    fprintf(stderr, "       in s/km, from -smax to smax east and north          \n");
+    fprintf(stderr, "  -V   velocity under the array in km/s to correct for     \n");
+    fprintf(stderr, "       elevations of stations, default no correction       \n");
+    fprintf(stderr, "  -G   write beam power of all windows to gridfile         \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. stla, stlo and the reference time must be set, and    \n");
+    fprintf(stderr, "     stel in meters if -V is given. Only the time common   \n");
+    fprintf(stderr, "     to all files is used.                                 \n");
+    fprintf(stderr, "  2. windows are demeaned and tapered by a Hann window.    \n");
+    fprintf(stderr, "  3. each line of output is the center of a window, the    \n");
+    fprintf(stderr, "     slowness in s/km, back-azimuth in degrees and power   \n");
+    fprintf(stderr, "     of the peak of the beam, relative to the sum of       \n");
+    fprintf(stderr, "     powers of channels, 1 for a coherent plane wave.      \n");
+    fprintf(stderr, "  4. gridfile is in native byte order:                     \n");
+    fprintf(stderr, "       char[4] \"SAFK\", int nwin, int n, double t0, dt,     \n");
+    fprintf(stderr, "       s0, ds, float power[nwin][n][n]                     \n");
+    fprintf(stderr, "     with windows centered at t0+i*dt seconds since 1970,  \n");
+    fprintf(stderr, "     north slowness s0+j*ds of rows and east slowness      \n");
+    fprintf(stderr, "     s0+k*ds of columns.                                   \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacfk -W4/1 -F1/4 -S0.5/0.01 XX.A*.SHZ                   \n");
+    fprintf(stderr, "  sacfk -W10/5 -F0.5/2 -S0.4/0.02 -G fk.grd -L array.lst   \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j, k, w;
+    int error = 0;
+    char *list = NULL;
+    char *grid = NULL;
+    char **files;
+    int nfile, nw, nstep, kw, nerr = 0;
+    double t1 = -1e30, t2 = 1e30, delta = 0.;
+    double lat0 = 0., lon0 = 0., el0 = 0.;
+    double *x, *y;
+    SACHEAD *hd;
+    FILE *fp = NULL;
+    float *xr, *xi, *part, *power;
+
+    while ((c=getopt(argc, argv, "W:F:S:V:G:L:h")) != -1) {
+        switch (c) {
+            case 'W':
+                if (sscanf(optarg, "%lf/%lf", &win, &step) != 2
+                        || win <= 0. || step <= 0.)
+                    error = 1;
+                break;
+            case 'F':
+                if (sscanf(optarg, "%lf/%lf", &f1, &f2) != 2
+                        || f1 < 0. || f2 <= f1)
+                    error = 1;
+                break;
+            case 'S':
+                if (sscanf(optarg, "%lf/%lf", &smax, &ds) != 2
+                        || smax <= 0. || ds <= 0. || smax / ds > 1000.)
+                    error = 1;
+                break;
+            case 'V':
+                if (sscanf(optarg, "%lf", &vel) != 1 || vel <= 0.)
+                    error = 1;
+                break;
+            case 'G':
+                grid = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || error || win <= 0. || f2 <= 0. || smax <= 0.) {
+        usage();
+        exit(-1);
+    }
+    if (nfile < 2) {
+        fprintf(stderr, "At least two files are needed for an array\n");
+        exit(-1);
+    }
+    nsta = nfile;
+
+    /* common time and geometry of the array */
+    if ((hd = (SACHEAD *)malloc(nsta * sizeof(SACHEAD))) == NULL
+            || (x = (double *)malloc(nsta * sizeof(double))) == NULL
+            || (y = (double *)malloc(nsta * sizeof(double))) == NULL
+            || (stat = (double *)calloc(nsta, sizeof(double))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:nerr)
+    for (i=0; i<nsta; i++)
+        if (read_sac_head(files[i], &hd[i]) != 0) nerr++;
+    if (nerr > 0) exit(-1);
+    delta = hd[0].delta;
+    for (i=0; i<nsta; i++) {
+        double tb;
+        if (hd[i].nzyear == SAC_INT_UNDEF || hd[i].stla == SAC_FLOAT_UNDEF
+                || hd[i].stlo == SAC_FLOAT_UNDEF
+                || (vel > 0. && hd[i].stel == SAC_FLOAT_UNDEF)) {
+            fprintf(stderr, "Reference time or location undefined in %s\n", files[i]);
+            nerr++;
+        } else if (hd[i].iftype == IXY || fabs(hd[i].delta - delta) > 1e-4 * delta) {
+            fprintf(stderr, "Delta of %s differs from %g\n", files[i], delta);
+            nerr++;
+        } else {
+            tb = datetime_ref(&hd[i]) + hd[i].b;
+            t1 = fmax(t1, tb);
+            t2 = fmin(t2, tb + (hd[i].npts - 1) * (double)delta);
+            lat0 += hd[i].stla;
+            lon0 += hd[i].stlo;
+            el0 += hd[i].stel;
+        }
+    }
+    if (nerr > 0) exit(-1);
+    lat0 /= nsta;
+    lon0 /= nsta;
+    el0 /= nsta;
+    for (i=0; i<nsta; i++) {
+        double gcarc, az, baz, dist;
+        distaz(lat0, lon0, hd[i].stla, hd[i].stlo, &gcarc, &az, &baz, &dist);
+        x[i] = dist * sin(az * M_PI / 180.);
+        y[i] = dist * cos(az * M_PI / 180.);
+        if (vel > 0.) stat[i] = (hd[i].stel - el0) / 1000. / vel;
+    }
+
+    nwin = (int)(win / delta + 0.5);
+    nstep = (int)(step / delta + 0.5);
+    if (nwin < 2 || nstep < 1 || (nfft = fft_size(nwin)) == 0) {
+        fprintf(stderr, "Invalid window %g/%g for delta %g\n", win, step, delta);
+        exit(-1);
+    }
+    k1 = (int)ceil(f1 * nfft * delta);
+    k = (int)floor(f2 * nfft * delta);
+    if (k > nfft / 2) k = nfft / 2;
+    if (k1 < 1) k1 = 1;
+    if ((nf = k - k1 + 1) < 1) {
+        fprintf(stderr, "No frequency in band %g/%g\n", f1, f2);
+        exit(-1);
+    }
+    nfb = (nf + FBLOCK - 1) / FBLOCK;
+    n = 2 * (int)(smax / ds + 0.5) + 1;
+    nw = (t2 - t1) / delta + 1 < nwin ? 0 : (int)(((t2 - t1) / delta + 1 - nwin) / nstep) + 1;
+    if (nw == 0) {
+        fprintf(stderr, "No window of %g s in the time common to all files\n", win);
+        exit(-1);
+    }
+
+    /* taper and steering vectors */
+    plan = fft_plan(nfft);
+    taper = (float *)malloc(nwin * sizeof(float));
+    exr = (float *)malloc((size_t)nf * nsta * n * sizeof(float));
+    exi = (float *)malloc((size_t)nf * nsta * n * sizeof(float));
+    eyr = (float *)malloc((size_t)nf * nsta * n * sizeof(float));
+    eyi = (float *)malloc((size_t)nf * nsta * n * sizeof(float));
+    xr = (float *)malloc((size_t)nf * nsta * sizeof(float));
+    xi = (float *)malloc((size_t)nf * nsta * sizeof(float));
+    part = (float *)malloc((size_t)nfb * n * n * sizeof(float));
+    power = (float *)malloc((size_t)n * n * sizeof(float));
+    if (plan == NULL || taper == NULL || exr == NULL || exi == NULL
+            || eyr == NULL || eyi == NULL || xr == NULL || xi == NULL
+            || part == NULL || power == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (j=0; j<nwin; j++)
+        taper[j] = (float)(0.5 - 0.5 * cos(2. * M_PI * j / (nwin - 1)));
+    #pragma omp parallel for schedule(static) private(i, j)
+    for (k=0; k<nf; k++) {
+        double wk = 2. * M_PI * (k1 + k) / (nfft * (double)delta);
+        for (i=0; i<nsta; i++) {
+            size_t o = ((size_t)k * nsta + i) * n;
+            for (j=0; j<n; j++) {
+                double s = (j - n / 2) * ds;
+                exr[o+j] = (float)cos(wk * s * x[i]);
+                exi[o+j] = (float)sin(wk * s * x[i]);
+                eyr[o+j] = (float)cos(wk * s * y[i]);
+                eyi[o+j] = (float)sin(wk * s * y[i]);
+            }
+        }
+    }
+
+    if (grid != NULL) {
+        if ((fp = fopen(grid, "wb")) == NULL) {
+            fprintf(stderr, "Error in opening file for writing %s\n", grid);
+            exit(-1);
+        }
+        if (write_grid_head(fp, nw, n, t1 + 0.5 * (nwin - 1) * delta,
+                            nstep * (double)delta, -(n / 2) * ds, ds) != 0) {
+            fprintf(stderr, "Error in writing %s\n", grid);
+            exit(-1);
+        }
+    }
+
+    /* windows of a chunk of samples at a time */
+    kw = (CHUNK - nwin) / nstep + 1;
+    if (kw < 1) kw = 1;
+    for (w=0; w<nw; w+=kw) {
+        int we = (w + kw < nw) ? w + kw : nw;
+        int span = (we - w - 1) * nstep + nwin;
+        double tw = t1 + (double)w * nstep * delta;
+        SACMATRIX *m;
+
+        if ((m = read_sac_matrix(nsta, files, tw, tw + (span + 0.5) * delta,
+                                 delta, SAC_MATRIX_ROWS)) == NULL)
+            exit(-1);
+        for (i=0; i<nsta; i++) {
+            if (m->hd[i].npts == 0) {
+                fprintf(stderr, "Unable to read %s\n", files[i]);
+                exit(-1);
+            }
+        }
+        for (j=w; j<we; j++) {
+            double t = t1 + ((double)j * nstep + 0.5 * (nwin - 1)) * delta;
+            double smag, baz;
+            char s[DATETIME_LENGTH];
+            int best = 0;
+
+            if (spectra(m, (j - w) * nstep, xr, xi) != 0
+                    || beam(xr, xi, part, power) != 0)
+                exit(-1);
+            for (k=1; k<n*n; k++)
+                if (power[k] > power[best]) best = k;
+            smag = hypot((best % n - n / 2) * ds, (best / n - n / 2) * ds);
+            baz = atan2(-(best % n - n / 2) * ds, -(best / n - n / 2) * ds) * 180. / M_PI;
+            if (baz < 0.) baz += 360.;
+            datetime_format(t, s);
+            printf("%s %8.4f %7.2f %6.4f\n", s, smag, baz, power[best]);
+            if (fp != NULL && fwrite(power, sizeof(float), (size_t)n * n, fp) != (size_t)n * n) {
+                fprintf(stderr, "Error in writing %s\n", grid);
+                exit(-1);
+            }
+        }
+        sac_matrix_free(m);
+    }
+
+    if (fp != NULL && fclose(fp) != 0) {
+        fprintf(stderr, "Error in writing %s\n", grid);
+        exit(-1);
+    }
+    return 0;
+}
+
+/*
+ *  spectra: spectra of the window at sample j0 of all channels in the
+ *      band, xr and xi [nf][nsta], corrected for elevations
+ *
+ *  Return: 0 if success, -1 if failed
+ */
+int spectra(const SACMATRIX *m, int j0, float *xr, float *xi)
+{
+    int p, error = 0;
+
+    /* two channels share each complex FFT */
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (p=0; p<nsta; p+=2) {
+        float *z;
+        int q, j, k;
+
+        if ((z = (float *)calloc(2 * nfft, sizeof(float))) == NULL) {
+            #pragma omp atomic write
+            error = -1;
+            continue;
+        }
+        for (q=0; q<2 && p+q<nsta; q++) {
+            const float *d = m->data + (size_t)(p + q) * m->stride + j0;
+            double mean = 0.;
+            for (j=0; j<nwin; j++) mean += d[j];
+            mean /= nwin;
+            for (j=0; j<nwin; j++) z[2*j+q] = (float)(d[j] - mean) * taper[j];
+        }
+        fft_forward(plan, z);
+        for (k=0; k<nf; k++) {
+            int kk = k1 + k, r = nfft - kk;
+            float ar = 0.5f * (z[2*kk] + z[2*r]), ai = 0.5f * (z[2*kk+1] - z[2*r+1]);
+            float br = 0.5f * (z[2*kk+1] + z[2*r+1]), bi = -0.5f * (z[2*kk] - z[2*r]);
+            for (q=0; q<2 && p+q<nsta; q++) {
+                /* advance by the static, exp(i*w*stat) */
+                double wt = 2. * M_PI * kk / (nfft * (double)m->delta) * stat[p+q];
+                float c = (float)cos(wt), s = (float)sin(wt);
+                float vr = q ? br : ar, vi = q ? bi : ai;
+                xr[k*nsta+p+q] = vr * c - vi * s;
+                xi[k*nsta+p+q] = vr * s + vi * c;
+            }
+        }
+        free(z);
+    }
+    if (error) fprintf(stderr, "Error in allocating memory for spectra\n");
+    return error;
+}
+
+/*
+ *  beam: beam power over the grid of slowness, power[n][n] with north
+ *      slowness of rows, relative to nsta times the power of channels
+ *
+ *  The beam of row iy and column ix at frequency k is
+ *      sum_i X[k][i] * ey[k][i][iy] * ex[k][i][ix],
+ *  i.e. the spectra times the north factor by the table of east factors.
+ *  Tasks are tiles of TILE rows by blocks of FBLOCK frequencies, reusing
+ *  the east factors of a frequency for the rows of a tile, and summing
+ *  into part[nfb][n][n].
+ *
+ *  Return: 0 if success, -1 if failed
+ */
+int beam(const float *xr, const float *xi, float *part, float *power)
+{
+    const int ntile = (n + TILE - 1) / TILE;
+    double total = 0.;
+    int t, j, k, error = 0;
+
+    for (k=0; k<nf*nsta; k++)
+        total += (double)xr[k] * xr[k] + (double)xi[k] * xi[k];
+
+    #pragma omp parallel
+    {
+        float *br = (float *)malloc(n * sizeof(float));
+        float *bi = (float *)malloc(n * sizeof(float));
+        float *ar = (float *)malloc(nsta * sizeof(float));
+        float *ai = (float *)malloc(nsta * sizeof(float));
+        const int ok = (br != NULL && bi != NULL && ar != NULL && ai != NULL);
+        if (!ok) {
+            #pragma omp atomic write
+            error = -1;
+        }
+
+        /* every thread takes part in the loop, without work if failed */
+        #pragma omp for schedule(dynamic, 1)
+        for (t=0; t<nfb*ntile; t++) {
+            int fb = t / ntile, y0 = (t % ntile) * TILE;
+            int y1 = (y0 + TILE < n) ? y0 + TILE : n;
+            int ka = fb * FBLOCK, kb = (ka + FBLOCK < nf) ? ka + FBLOCK : nf;
+            float *p = part + (size_t)fb * n * n;
+            int iy, ix, i, kk;
+
+            if (!ok) continue;
+
+            for (iy=y0; iy<y1; iy++)
+                memset(p + (size_t)iy * n, 0, n * sizeof(float));
+            for (kk=ka; kk<kb; kk++) {
+                const float *er = exr + (size_t)kk * nsta * n;
+                const float *ei = exi + (size_t)kk * nsta * n;
+                for (iy=y0; iy<y1; iy++) {
+                    float *row = p + (size_t)iy * n;
+                    for (i=0; i<nsta; i++) {
+                        size_t o = ((size_t)kk * nsta + i) * n + iy;
+                        float vr = xr[kk*nsta+i], vi = xi[kk*nsta+i];
+                        ar[i] = vr * eyr[o] - vi * eyi[o];
+                        ai[i] = vr * eyi[o] + vi * eyr[o];
+                    }
+                    memset(br, 0, n * sizeof(float));
+                    memset(bi, 0, n * sizeof(float));
+                    for (i=0; i<nsta; i++) {
+                        const float *cr = er + (size_t)i * n, *ci = ei + (size_t)i * n;
+                        const float sr = ar[i], si = ai[i];
+                        #pragma omp simd
+                        for (ix=0; ix<n; ix++) {
+                            br[ix] += sr * cr[ix] - si * ci[ix];
+                            bi[ix] += sr * ci[ix] + si * cr[ix];
+                        }
+                    }
+                    #pragma omp simd
+                    for (ix=0; ix<n; ix++)
+                        row[ix] += br[ix] * br[ix] + bi[ix] * bi[ix];
+                }
+            }
+        }
+        free(br);
+        free(bi);
+        free(ar);
+        free(ai);
+    }
+    if (error) {
+        fprintf(stderr, "Error in allocating memory for beams\n");
+        return -1;
+    }
+
+    total = (total > 0.) ? 1. / (nsta * total) : 0.;
+    #pragma omp parallel for schedule(static) private(k)
+    for (j=0; j<n*n; j++) {
+        double s = 0.;
+        for (k=0; k<nfb; k++) s += part[(size_t)k*n*n+j];
+        power[j] = (float)(s * total);
+    }
+    return 0;
+}
+
+/*
+ *  write_grid_head: header of the grid file of sacfk
+ */
+int write_grid_head(FILE *fp, int nwin, int n, double t0, double dt,
+                    double s0, double ds)
+{
+    int size[2];
+    double axis[4];
+
+    size[0] = nwin;
+    size[1] = n;
+    axis[0] = t0;
+    axis[1] = dt;
+    axis[2] = s0;
+    axis[3] = ds;
+    if (fwrite("SAFK", 4, 1, fp) != 1
+            || fwrite(size, sizeof(size), 1, fp) != 1
+            || fwrite(axis, sizeof(axis), 1, fp) != 1)
+        return -1;
+    return 0;
+}
@@ -0,0 +1,363 @@
+/*
+ *  Build and query an index of absolute time intervals covered by SAC files
+ *
+ *  The index keeps, for each channel NET.STA.LOC.CMP, the absolute begin
+ *  and end time of all files sorted by begin time, together with the
+ *  running maximum of end time. A query is a binary search for the last
+ *  file beginning before the end of the window followed by a backward scan
+ *  which stops as soon as no earlier file can reach the window.
+ *
+ *  Index file layout (native byte order):
+ *      SACIDX_MAGIC
+ *      int     nchan, nent, nbytes, pad
+ *      IDXCHAN chan[nchan]     sorted by name
+ *      IDXENT  ent[nent]       grouped by channel, sorted by begin time
+ *      double  maxend[nent]    running maximum of end within a channel
+ *      char    paths[nbytes]   NUL terminated file names
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sacio.h"
+#include "datetime.h"
+
+#define SACIDX_MAGIC "SACIDX1"
+
+typedef struct {
+    char name[SAC_CHANNEL_NAME_LENGTH];
+    int first;      /* first entry of the channel */
+    int count;      /* number of entries of the channel */
+    int pad;
+} IDXCHAN;
+
+typedef struct {
+    double start;   /* absolute time of the first sample */
+    double end;     /* absolute time of the last sample */
+    float delta;
+    int npts;
+    int path;       /* offset of file name in paths */
+    int pad;
+} IDXENT;
+
+/* one file while building the index */
+typedef struct {
+    char name[SAC_CHANNEL_NAME_LENGTH];
+    const char *file;
+    IDXENT ent;
+    int ok;
+} ITEM;
+
+void usage(void);
+int build_index(const char *index, char **files, int nfile);
+int query_index(const char *index, double t1, double t2, const char *pattern);
+int compare_item(const void *a, const void *b);
+
+void usage()
+{
+    fprintf(stderr, "Build and query an index of time intervals of SAC files     \n");
+    fprintf(stderr, "                                                            \n");
+    fprintf(stderr, "Usage:                                                      \n");
+    fprintf(stderr, "  sacidx -B index [-L filelist] [sacfiles]                  \n");
+    fprintf(stderr, "  sacidx -Q index -Tt1/t2 [-Schannel]                       \n");
+    fprintf(stderr, "                                                            \n");
+    fprintf(stderr, "Options:                                                    \n");
+    fprintf(stderr, "  -B   build index from headers of SAC files                \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line  \n");
+    fprintf(stderr, "  -Q   query index                                          \n");
+    fprintf(stderr, "  -T   time window, DATETIME or seconds since 1970          \n");
+    fprintf(stderr, "  -S   channel NET.STA.LOC.CMP, wildcards allowed           \n");
+    fprintf(stderr, "  -h   show usage.                                          \n");
+    fprintf(stderr, "                                                            \n");
+    fprintf(stderr, "Output of query:                                            \n");
+    fprintf(stderr, "  sacfile channel n1 n2                                     \n");
+    fprintf(stderr, "  samples n1 to n2-1 of sacfile fall in the time window.    \n");
+    fprintf(stderr, "  bundles are indexed by members, as bundle.sacb:member.    \n");
+    fprintf(stderr, "                                                            \n");
+    fprintf(stderr, "Examples:                                                   \n");
+    fprintf(stderr, "  sacidx -B archive.idx -L files.lst                        \n");
+    fprintf(stderr, "  sacidx -Q archive.idx -T2010-02-03T10:20:00/2010-02-03T10:30:00 -SIU.*.00.BH?\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c;
+    int error = 0;
+    char *index = NULL;
+    int build = 0;
+    char *list = NULL;
+    char *pattern = NULL;
+    char *p;
+    int window = 0;
+    double t1 = 0., t2 = 0.;
+
+    while ((c=getopt(argc, argv, "B:Q:L:T:S:h")) != -1) {
+        switch (c) {
+            case 'B':
+                build = 1;
+                index = optarg;
+                break;
+            case 'Q':
+                build = 0;
+                index = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'T':
+                if ((p = strchr(optarg, '/')) == NULL) {
+                    error++;
+                    break;
+                }
+                *p = '\0';
+                if (datetime_parse(optarg, &t1) != 0
+                        || datetime_parse(p+1, &t2) != 0) {
+                    fprintf(stderr, "Error in time format\n");
+                    error++;
+                }
+                window = 1;
+                break;
+            case 'S':
+                pattern = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    if (index == NULL || error) {
+        usage();
+        exit(-1);
+    }
+
+    if (build) {
+        char **files = argv + optind;
+        int nfile = argc - optind;
+
+        if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+            exit(-1);
+        if ((nfile = sac_expand_bundles(nfile, files, &files)) < 0)
+            exit(-1);
+        if (nfile == 0) {
+            usage();
+            exit(-1);
+        }
+        return build_index(index, files, nfile);
+    }
+
+    if (!window) {
+        usage();
+        exit(-1);
+    }
+    return query_index(index, t1, t2, pattern);
+}
+
+int compare_item(const void *a, const void *b)
+{
+    const ITEM *x = (const ITEM *)a;
+    const ITEM *y = (const ITEM *)b;
+    int cmp;
+
+    if (x->ok != y->ok) return y->ok - x->ok;
+    if ((cmp = strcmp(x->name, y->name)) != 0) return cmp;
+    if (x->ent.start < y->ent.start) return -1;
+    if (x->ent.start > y->ent.start) return 1;
+    return strcmp(x->file, y->file);
+}
+
+/*
+ *  build_index: read headers of all files and write index
+ */
+int build_index(const char *index, char **files, int nfile)
+{
+    ITEM *item;
+    IDXCHAN *chan;
+    IDXENT *ent;
+    double *maxend;
+    FILE *fp;
+    int i, nent, nchan, nbytes, error = -1;
+
+    if ((item = (ITEM *)calloc(nfile, sizeof(ITEM))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        return -1;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (i=0; i<nfile; i++) {
+        SACHEAD hd;
+        double tref;
+
+        item[i].file = files[i];
+        if (read_sac_head(files[i], &hd) != 0) continue;
+        if (hd.nzyear == SAC_INT_UNDEF) {
+            fprintf(stderr, "Warning: reference time undefined in %s\n", files[i]);
+            continue;
+        }
+        tref = datetime2epoch(hd.nzyear, hd.nzjday, hd.nzhour,
+                              hd.nzmin, hd.nzsec, hd.nzmsec);
+        sac_channel_name(&hd, item[i].name);
+        item[i].ent.start = tref + hd.b;
+        item[i].ent.end = tref + hd.b + (hd.npts - 1) * (double)hd.delta;
+        item[i].ent.delta = hd.delta;
+        item[i].ent.npts = hd.npts;
+        item[i].ok = 1;
+    }
+
+    qsort(item, nfile, sizeof(ITEM), compare_item);
+
+    for (nent=0, nbytes=0; nent<nfile && item[nent].ok; nent++)
+        nbytes += strlen(item[nent].file) + 1;
+
+    chan = (IDXCHAN *)malloc((nent+1)*sizeof(IDXCHAN));
+    ent = (IDXENT *)malloc((nent+1)*sizeof(IDXENT));
+    maxend = (double *)malloc((nent+1)*sizeof(double));
+    if (chan == NULL || ent == NULL || maxend == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        goto done;
+    }
+
+    for (i=0, nchan=0, nbytes=0; i<nent; i++) {
+        ent[i] = item[i].ent;
+        ent[i].path = nbytes;
+        nbytes += strlen(item[i].file) + 1;
+        if (nchan == 0 || strcmp(chan[nchan-1].name, item[i].name) != 0) {
+            strcpy(chan[nchan].name, item[i].name);
+            chan[nchan].first = i;
+            chan[nchan].count = 0;
+            chan[nchan].pad = 0;
+            nchan++;
+            maxend[i] = ent[i].end;
+        } else {
+            maxend[i] = (ent[i].end > maxend[i-1]) ? ent[i].end : maxend[i-1];
+        }
+        chan[nchan-1].count++;
+    }
+
+    if ((fp = fopen(index, "wb")) == NULL) {
+        fprintf(stderr, "Error in opening file for writing %s\n", index);
+        goto done;
+    }
+    fwrite(SACIDX_MAGIC, sizeof(SACIDX_MAGIC), 1, fp);
+    fwrite(&nchan, sizeof(int), 1, fp);
+    fwrite(&nent, sizeof(int), 1, fp);
+    fwrite(&nbytes, sizeof(int), 1, fp);
+    i = 0;
+    fwrite(&i, sizeof(int), 1, fp);
+    fwrite(chan, sizeof(IDXCHAN), nchan, fp);
+    fwrite(ent, sizeof(IDXENT), nent, fp);
+    fwrite(maxend, sizeof(double), nent, fp);
+    for (i=0; i<nent; i++)
+        fwrite(item[i].file, strlen(item[i].file)+1, 1, fp);
+    i = ferror(fp);
+    if (fclose(fp) != 0 || i) {
+        fprintf(stderr, "Error in writing index %s\n", index);
+        goto done;
+    }
+
+    fprintf(stderr, "%d files, %d channels indexed, %d skipped\n",
+            nent, nchan, nfile - nent);
+    error = 0;
+
+done:
+    free(item);
+    free(chan);
+    free(ent);
+    free(maxend);
+    return error;
+}
+
+/*
+ *  query_index: list all files of channels matching pattern which
+ *      overlap the time window [t1, t2]
+ */
+int query_index(const char *index, double t1, double t2, const char *pattern)
+{
+    int fd;
+    struct stat st;
+    char *map;
+    const IDXCHAN *chan;
+    const IDXENT *ent;
+    const double *maxend;
+    const char *paths;
+    int nchan, nent, nbytes;
+    int i, k;
+    size_t off;
+    int head[3];
+
+    if ((fd = open(index, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Unable to open %s\n", index);
+        return -1;
+    }
+    map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    off = sizeof(SACIDX_MAGIC) + 4*sizeof(int);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s\n", index);
+        return -1;
+    }
+    if (st.st_size < (off_t)off
+            || memcmp(map, SACIDX_MAGIC, sizeof(SACIDX_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a SAC index\n", index);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    memcpy(head, map+sizeof(SACIDX_MAGIC), sizeof(head));
+    nchan = head[0];
+    nent = head[1];
+    nbytes = head[2];
+    chan = (const IDXCHAN *)(map + off);
+    ent = (const IDXENT *)((const char *)chan + nchan*sizeof(IDXCHAN));
+    maxend = (const double *)((const char *)ent + nent*sizeof(IDXENT));
+    paths = (const char *)(maxend + nent);
+    if ((off_t)((paths - map) + nbytes) > st.st_size) {
+        fprintf(stderr, "%s is truncated\n", index);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    for (k=0; k<nchan; k++) {
+        int lo, hi;
+
+        if (pattern != NULL && fnmatch(pattern, chan[k].name, 0) != 0)
+            continue;
+
+        /* first entry of the channel starting after t2 */
+        lo = chan[k].first;
+        hi = chan[k].first + chan[k].count;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (ent[mid].start <= t2) lo = mid + 1;
+            else hi = mid;
+        }
+
+        /* scan backward while an earlier entry may still end after t1 */
+        for (hi=lo, i=lo-1; i>=chan[k].first && maxend[i]>=t1; i--)
+            ;
+        for (i=i+1; i<hi; i++) {
+            double n1, n2;
+            if (ent[i].end < t1) continue;
+            /* samples n1 to n2-1 within the window, clamped before
+             * conversion as long windows overflow int */
+            n1 = ceil((t1 - ent[i].start) / ent[i].delta);
+            n2 = floor((t2 - ent[i].start) / ent[i].delta) + 1;
+            if (n1 < 0) n1 = 0;
+            if (n2 > ent[i].npts) n2 = ent[i].npts;
+            if (n1 >= n2) continue;
+            printf("%s %s %d %d\n", paths + ent[i].path, chan[k].name,
+                   (int)n1, (int)n2);
+        }
+    }
+
+    munmap(map, st.st_size);
+    return 0;
+}
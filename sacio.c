@@ -5,11 +5,28 @@
  *      read_sac         read SAC binary data                                  *
  *      read_sac_xy      read SAC binary XY data                               *
  *      read_sac_pdw     read SAC data in a partial data window (cut option)   *
+ *      sac_pdw_head     Compute the partial data window of read_sac_pdw       *
+ *      read_sac_samples Read a range of samples into a given buffer           *
  *      write_sac        Write SAC binary data                                 *
+ *      write_sac_opt    Write SAC binary data, optionally crash-safe          *
+ *      sac_write_commit Sync and rename files written in batch mode           *
+ *      sac_writer_*     Asynchronous writer with I/O threads                  *
  *      write_sac_xy     Write SAC binary XY data                              *
+ *      write_sac_head   Overwrite SAC header of an existing file in place     *
+ *      sac_head_pack    Pack SAC header into its layout on disk               *
  *      new_sac_head     Create a new minimal SAC header                       *
  *      sac_head_index   Find the offset of specified SAC head fields          *
  *      issac            Check if a file in in SAC format                      *
+ *      sac_to_native    Convert a SAC file to native byte order               *
+ *      sac_channel_name Return NET.STA.LOC.CMP of a SAC header                *
+ *      sac_bundle_*     Read and write bundles of SAC files                   *
+ *      sac_expand_bundles Expand bundles into names of their members          *
+ *      sac_read_list    Read names of files from a list                       *
+ *      sac_out_name     Name of output of a file, in place or in a directory  *
+ *      sac_same_file    Whether two names are of the same file                *
+ *                                                                             *
+ *  Data written with SAC_WRITE_PACK are packed losslessly, see pack_data.     *
+ *  Read functions accept bundle.sacb:member as name, see sac_bundle_open.     *
  *                                                                             *
  *  Author: Dongdong Tian @ USTC                                               *
  *                                                                             *
@@ -24,20 +41,160 @@
  *                                                                             *
  ******************************************************************************/
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <pthread.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "sacio.h"
 
+/* running statistics of data, NaN samples left out */
+typedef struct {
+    float   min;
+    float   max;
+    double  sum;
+    size_t  nnan;   /* number of NaN samples */
+} STATS;
+
 /* function prototype for local use */
 static void    byte_swap       (char *pt, size_t n);
 static int     check_sac_nvhdr (const int nvhdr);
 static void    map_chdr_in     (char *memar, char *buff);
 static int     read_head_in    (const char *name, SACHEAD *hd, FILE *strm);
 static void    map_chdr_out    (char *memar, char *buff);
-static int     write_head_out  (const char *name, SACHEAD hd, FILE *strm);
+static int     write_iov       (int fd, struct iovec *iov, int n);
+static char   *temp_name       (const char *name);
+static int     open_temp       (const char *tmp, const char *name);
+static int     sync_dir        (const char *name);
+static int     batch_add       (char *tmp, const char *name);
+static int     batch_commit    (void);
+static void   *writer_main     (void *arg);
+static void    data_stats      (const float *ar, size_t n, STATS *st);
+static void    set_stats       (SACHEAD *hd, const STATS *st);
+static uint32_t *pack_data     (const float *ar, int npts, size_t *sz);
+static int     pack_block      (const float *x, int n, uint32_t *out);
+static int     unpack_block    (const uint32_t *blk, size_t nw, int n, float *out);
+static int     read_packed     (const char *name, FILE *strm, int lswap,
+                                int npts, int s0, int s1, float *out);
+static int     syncfs_path     (const char *name);
+static void    pack_head       (SACHEAD hd, char *buff, int lswap);
+static ssize_t read_block      (int fd, char *buff, size_t n);
+static int     compare_member  (const void *a, const void *b, void *ent);
+static int     bundle_get      (const char *name, SACBUNDLE **b);
+static void    bundle_put      (SACBUNDLE *b);
+static void    pdw_close       (FILE *strm, SACBUNDLE *b);
+
+/* files written with SAC_WRITE_BATCH, waiting for sac_write_commit */
+static struct {
+    char *tmp;
+    char *name;
+} *batch = NULL;
+static int batch_n = 0;
+static int batch_max = 0;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* a write queued in SACWRITER */
+typedef struct {
+    char    *name;
+    SACHEAD hd;
+    float   *ar;
+} WRITEJOB;
+
+struct sac_writer {
+    WRITEJOB        *queue;     /* ring buffer of qsize jobs */
+    int             qsize;
+    int             head;       /* next job to be taken */
+    int             count;      /* jobs in queue */
+    int             busy;       /* jobs being written */
+    int             nerr;       /* failed writes since last flush */
+    int             nwritten;   /* files written since last syncfs */
+    int             durability;
+    char            *last;      /* name of the file written last */
+    int             stop;
+    int             nthread;
+    pthread_t       *thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+    pthread_cond_t  idle;
+};
+
+/* trailer at the end of a bundle */
+typedef struct {
+    char        magic[8];
+    long long   index;
+    long long   count;
+} BTRAILER;
+
+struct sac_bundle {
+    char            *base;      /* mapping of the whole file */
+    size_t          size;
+    const SACBENTRY *ent;
+    int             n;
+    int             *order;     /* members sorted by name */
+};
+
+struct sac_bundle_writer {
+    char        *name;
+    char        *tmp;
+    int         fd;
+    long long   off;
+    SACBENTRY   *ent;
+    int         n;
+    int         nmax;
+    int         error;
+};
+
+struct sac_stream {
+    char            *name;
+    int             writing;
+    int             npts;       /* samples of a stream being read */
+    int             pos;        /* next sample */
+    FILE            *strm;
+    int             lswap;
+    int             packed;
+    SACBUNDLE       *b;         /* bundle of a member being read */
+    int             member;
+    const float     *b_data;
+    int             fd;         /* file being written */
+    int             reserved;   /* samples preallocated */
+    char            *tmp;
+    int             flags;
+    int             error;
+    SACHEAD         hd;
+    STATS           st;
+};
+
+/* bundles opened for reading members by name */
+static struct {
+    char            *path;
+    SACBUNDLE       *b;
+    dev_t           dev;
+    ino_t           ino;
+    off_t           size;
+    time_t          mtime;
+    int             ref;        /* members being read */
+    unsigned long   used;       /* time of last use */
+} bcache[SAC_BUNDLE_CACHE];
+static unsigned long bcache_clock = 0;
+static pthread_mutex_t bcache_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* a SAC structure containing all null values */
 static SACHEAD sac_null = {
@@ -94,7 +251,16 @@ static SACHEAD sac_null = {
 int read_sac_head(const char *name, SACHEAD *hd)
 {
     FILE    *strm;
+    SACBUNDLE *b;
     int     lswap;
+    int     i;
+
+    if ((i = bundle_get(name, &b)) != -2) {     /* member of a bundle */
+        if (i < 0) return -1;
+        lswap = sac_bundle_head(b, i, hd);
+        bundle_put(b);
+        return lswap;
+    }
 
     if ((strm = fopen(name, "rb")) == NULL) {
         fprintf(stderr, "Unable to open %s\n", name);
@@ -123,9 +289,18 @@ int read_sac_head(const char *name, SACHEAD *hd)
 float *read_sac(const char *name, SACHEAD *hd)
 {
     FILE    *strm;
+    SACBUNDLE *b;
     float   *ar;
     int     lswap;
     size_t  sz;
+    int     i;
+
+    if ((i = bundle_get(name, &b)) != -2) {     /* member of a bundle */
+        if (i < 0) return NULL;
+        ar = sac_bundle_read(b, i, hd);
+        bundle_put(b);
+        return ar;
+    }
 
     if ((strm = fopen(name, "rb")) == NULL) {
         fprintf(stderr, "Unable to open %s\n", name);
@@ -148,6 +323,17 @@ float *read_sac(const char *name, SACHEAD *hd)
         return NULL;
     }
 
+    if (hd->unused17 == SAC_DATA_PACKED) {
+        if (read_packed(name, strm, lswap, hd->npts, 0, hd->npts, ar) != 0) {
+            free(ar);
+            fclose(strm);
+            return NULL;
+        }
+        hd->unused17 = SAC_INT_UNDEF;
+        fclose(strm);
+        return ar;
+    }
+
     if (fread((char*)ar, sz, 1, strm) != 1) {
         fprintf(stderr, "Error in reading SAC data %s\n", name);
         free(ar);
@@ -219,29 +405,419 @@ int read_sac_xy(const char *name, SACHEAD *hd, float *xdata, float *ydata)
  *
  */
 int write_sac(const char *name, SACHEAD hd, const float *ar)
+{
+    return write_sac_opt(name, hd, ar, 0);
+}
+
+/*
+ *  write_sac_opt
+ *
+ *  Description:    write binary SAC data with options
+ *
+ *      Header and data are written by a single writev. With
+ *      SAC_WRITE_ATOMIC the file is written to a temporary file in the
+ *      same directory and renamed to name, so that name holds either the
+ *      old or the new file after a crash. The permissions of an existing
+ *      name are kept, but its other hard links keep the old file.
+ *
+ *  IN:
+ *      const char *name    :   file name
+ *      SACHEAD     hd      :   header
+ *      const float *ar     :   float data array
+ *      int         flags   :   bitwise or of
+ *          SAC_WRITE_ATOMIC    write to temporary file and rename
+ *          SAC_WRITE_SYNC      fsync before rename (implies ATOMIC)
+ *          SAC_WRITE_BATCH     defer sync and rename to sac_write_commit,
+ *                              so that many files share one sync
+ *                              (implies ATOMIC)
+ *          SAC_WRITE_STATS     compute depmin, depmax and depmen while
+ *                              writing the data and mark them valid
+ *          SAC_WRITE_PACK      write data losslessly packed, see
+ *                              pack_data (not for IXY files)
+ *
+ *      Without SAC_WRITE_STATS, the mark of valid statistics is removed
+ *      from the header since data may have changed.
+ *
+ *  Return:
+ *      -1  :   fail
+ *      0   :   succeed
+ *
+ */
+int write_sac_opt(const char *name, SACHEAD hd, const float *ar, int flags)
+{
+    char    head[SAC_HEADER_SIZE];
+    struct iovec iov[2];
+    char    *tmp = NULL;
+    const char *path = name;
+    size_t  sz, n, dep0;
+    int     fd;
+    int     error = 0;
+    STATS   st = {FLT_MAX, -FLT_MAX, 0., 0};
+    uint32_t *packed = NULL;
+
+    if (strstr(name, SAC_BUNDLE_EXT ":") != NULL) {
+        fprintf(stderr, "Unable to write into SAC bundle %s\n", name);
+        return -1;
+    }
+    if (flags & (SAC_WRITE_SYNC|SAC_WRITE_BATCH)) flags |= SAC_WRITE_ATOMIC;
+
+    n = (size_t)hd.npts;
+    if (hd.iftype == IXY) n *= 2;
+    sz = n * SAC_DATA_SIZEOF;
+    /* first sample of dependent variable */
+    dep0 = (hd.iftype == IXY) ? (size_t)hd.npts : 0;
+
+    if (!(flags & SAC_WRITE_STATS) && hd.unused16 == SAC_STATS_VALID)
+        hd.unused16 = SAC_INT_UNDEF;
+    if (hd.unused17 == SAC_DATA_PACKED) hd.unused17 = SAC_INT_UNDEF;
+    if (hd.iftype == IXY) flags &= ~SAC_WRITE_PACK;
+
+    /* small data are still in cache when written after statistics */
+    if ((flags & SAC_WRITE_STATS)
+            && (sz <= SAC_STATS_BLOCK || (flags & SAC_WRITE_PACK))) {
+        if (n > dep0) data_stats(ar + dep0, n - dep0, &st);
+        set_stats(&hd, &st);
+        flags &= ~SAC_WRITE_STATS;
+    }
+
+    iov[1].iov_base = (void *)ar;
+    iov[1].iov_len = sz;
+    if (flags & SAC_WRITE_PACK) {
+        if ((packed = pack_data(ar, hd.npts, &iov[1].iov_len)) == NULL) {
+            fprintf(stderr, "Error in allocating memory %s\n", name);
+            return -1;
+        }
+        iov[1].iov_base = packed;
+        hd.unused17 = SAC_DATA_PACKED;
+    }
+
+    pack_head(hd, head, FALSE);
+    iov[0].iov_base = head;
+    iov[0].iov_len = SAC_HEADER_SIZE;
+
+    if (flags & SAC_WRITE_ATOMIC) {
+        if ((tmp = temp_name(name)) == NULL) {
+            fprintf(stderr, "Error in allocating memory %s\n", name);
+            return -1;
+        }
+        path = tmp;
+        fd = open_temp(path, name);
+    } else {
+        fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Error in opening file for writing %s\n", name);
+        free(tmp);
+        free(packed);
+        return -1;
+    }
+
+    if ((flags & SAC_WRITE_STATS) && sz > SAC_STATS_BLOCK) {
+        /* statistics of each block just before it is written,
+         * header with the statistics written last */
+        size_t i, k;
+        off_t off = SAC_HEADER_SIZE;
+        for (i=0; i<n && !error; i+=k) {
+            k = SAC_STATS_BLOCK / SAC_DATA_SIZEOF;
+            if (k > n - i) k = n - i;
+            if (i + k > dep0)
+                data_stats(ar + (i > dep0 ? i : dep0),
+                           i + k - (i > dep0 ? i : dep0), &st);
+            iov[1].iov_base = (void *)(ar + i);
+            iov[1].iov_len = k * SAC_DATA_SIZEOF;
+            if (lseek(fd, off, SEEK_SET) < 0
+                    || write_iov(fd, &iov[1], 1) != 0)
+                error = -1;
+            off += k * SAC_DATA_SIZEOF;
+        }
+        set_stats(&hd, &st);
+        pack_head(hd, head, FALSE);
+        if (!error && pwrite(fd, head, SAC_HEADER_SIZE, 0) != SAC_HEADER_SIZE)
+            error = -1;
+    } else if (write_iov(fd, iov, 2) != 0) {
+        error = -1;
+    }
+    if (error)
+        fprintf(stderr, "Error in writing SAC data for writing %s\n", name);
+    if (!error && (flags & SAC_WRITE_SYNC) && !(flags & SAC_WRITE_BATCH)
+            && fsync(fd) != 0) {
+        fprintf(stderr, "Error in syncing %s\n", name);
+        error = -1;
+    }
+    if (close(fd) != 0 && !error) {
+        fprintf(stderr, "Error in writing SAC data for writing %s\n", name);
+        error = -1;
+    }
+    free(packed);
+
+    if (error) {
+        if (tmp != NULL) unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+
+    if (flags & SAC_WRITE_BATCH)
+        return batch_add(tmp, name);    /* takes ownership of tmp */
+
+    if (tmp != NULL) {
+        if (rename(tmp, name) != 0
+                || ((flags & SAC_WRITE_SYNC) && sync_dir(name) != 0)) {
+            fprintf(stderr, "Error in renaming %s\n", name);
+            unlink(tmp);
+            error = -1;
+        }
+        free(tmp);
+    }
+    return error;
+}
+
+/*
+ *  sac_write_commit
+ *
+ *  Description:    sync and rename all files written with SAC_WRITE_BATCH
+ *                  since the last commit. Data of all files are synced
+ *                  together before any of them is renamed, followed by
+ *                  one sync per directory.
+ *
+ *                  Commit is done automatically every SAC_WRITE_BATCH_MAX
+ *                  files.
+ *
+ *  Return:
+ *      number of files failed to commit
+ *
+ */
+int sac_write_commit(void)
+{
+    int     nerr;
+
+    pthread_mutex_lock(&batch_lock);
+    nerr = batch_commit();
+    pthread_mutex_unlock(&batch_lock);
+    return nerr;
+}
+
+/*
+ *  sac_writer_new
+ *
+ *  Description:    start an asynchronous writer
+ *
+ *  IN:
+ *      int nthread     :   number of I/O threads
+ *      int qsize       :   maximum number of queued writes, submit blocks
+ *                          when the queue is full
+ *      int durability  :   SAC_DURABLE_NONE    no sync
+ *                          SAC_DURABLE_FSYNC   fsync and rename each file
+ *                          SAC_DURABLE_SYNCFS  syncfs every
+ *                                              SAC_WRITER_SYNC_PERIOD files
+ *                                              and at each flush
+ *
+ *  Return: writer, NULL if failed
+ *
+ */
+SACWRITER *sac_writer_new(int nthread, int qsize, int durability)
+{
+    SACWRITER *w;
+    int i;
+
+    if (nthread < 1) nthread = 1;
+    if (qsize < nthread) qsize = nthread;
+
+    if ((w = (SACWRITER *)calloc(1, sizeof(SACWRITER))) == NULL
+            || (w->queue = (WRITEJOB *)malloc(qsize*sizeof(WRITEJOB))) == NULL
+            || (w->thread = (pthread_t *)malloc(nthread*sizeof(pthread_t))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for writer\n");
+        if (w) free(w->queue);
+        free(w);
+        return NULL;
+    }
+    w->qsize = qsize;
+    w->durability = durability;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+    pthread_cond_init(&w->idle, NULL);
+
+    for (i=0; i<nthread; i++) {
+        if (pthread_create(&w->thread[i], NULL, writer_main, w) != 0) break;
+    }
+    w->nthread = i;
+    if (i == 0) {
+        fprintf(stderr, "Error in creating writer threads\n");
+        free(w->thread);
+        free(w->queue);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/*
+ *  sac_writer_submit
+ *
+ *  Description:    queue a write_sac. The writer takes ownership of ar,
+ *                  which is freed once written, so the caller must not
+ *                  use it after submit.
+ *
+ *  Return:
+ *      -1  :   fail, ar is freed
+ *      0   :   succeed
+ *
+ */
+int sac_writer_submit(SACWRITER *w, const char *name, SACHEAD hd, float *ar)
+{
+    WRITEJOB *job;
+    char *copy;
+
+    if ((copy = strdup(name)) == NULL) {
+        fprintf(stderr, "Error in allocating memory %s\n", name);
+        free(ar);
+        return -1;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    while (w->count == w->qsize)
+        pthread_cond_wait(&w->not_full, &w->lock);
+    job = &w->queue[(w->head + w->count) % w->qsize];
+    job->name = copy;
+    job->hd = hd;
+    job->ar = ar;
+    w->count++;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+/*
+ *  sac_writer_flush
+ *
+ *  Description:    wait until all submitted writes are done and, with
+ *                  SAC_DURABLE_SYNCFS, synced.
+ *
+ *  Return: number of failed writes since last flush
+ *
+ */
+int sac_writer_flush(SACWRITER *w)
+{
+    int nerr;
+    char *last = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->count > 0 || w->busy > 0)
+        pthread_cond_wait(&w->idle, &w->lock);
+    nerr = w->nerr;
+    w->nerr = 0;
+    if (w->durability == SAC_DURABLE_SYNCFS && w->nwritten > 0
+            && w->last != NULL) {
+        last = strdup(w->last);
+        w->nwritten = 0;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (last != NULL && syncfs_path(last) != 0) nerr++;
+    free(last);
+    return nerr;
+}
+
+/*
+ *  sac_writer_close
+ *
+ *  Description:    flush and stop the writer
+ *
+ *  Return: number of failed writes since last flush
+ *
+ */
+int sac_writer_close(SACWRITER *w)
+{
+    int i, nerr;
+
+    nerr = sac_writer_flush(w);
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_broadcast(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    for (i=0; i<w->nthread; i++)
+        pthread_join(w->thread[i], NULL);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->not_empty);
+    pthread_cond_destroy(&w->not_full);
+    pthread_cond_destroy(&w->idle);
+    free(w->last);
+    free(w->thread);
+    free(w->queue);
+    free(w);
+    return nerr;
+}
+
+/*
+ *  write_sac_head
+ *
+ *  Description:    overwrite the header of an existing SAC file in place,
+ *                  leaving the data section untouched. The header is written
+ *                  in the byte order of the file on disk, and the mark of
+ *                  packed data is taken from the file, not from hd.
+ *
+ *  IN:
+ *      const char *name    :   file name
+ *      SACHEAD     hd      :   header
+ *
+ *  Return:
+ *      -1  :   fail
+ *      0   :   succeed
+ *
+ */
+int write_sac_head(const char *name, SACHEAD hd)
 {
     FILE    *strm;
-    size_t  sz;
+    int     nvhdr;
+    int     packed;
+    int     lswap;
+    char    buffer[SAC_HEADER_SIZE];
 
-    if ((strm = fopen(name, "wb")) == NULL) {
+    if (strstr(name, SAC_BUNDLE_EXT ":") != NULL) {
+        fprintf(stderr, "Unable to write into SAC bundle %s\n", name);
+        return -1;
+    }
+    if ((strm = fopen(name, "r+b")) == NULL) {
         fprintf(stderr, "Error in opening file for writing %s\n", name);
         return -1;
     }
 
-    if (write_head_out(name, hd, strm) == -1) {
+    if (fseek(strm, SAC_VERSION_LOCATION * SAC_DATA_SIZEOF, SEEK_SET) != 0
+            || fread(&nvhdr, sizeof(int), 1, strm) != 1
+            || (lswap = check_sac_nvhdr(nvhdr)) == -1) {
+        fprintf(stderr, "Warning: %s not in sac format.\n", name);
         fclose(strm);
         return -1;
     }
 
-    sz = (size_t)hd.npts * SAC_DATA_SIZEOF;
-    if (hd.iftype == IXY) sz *= 2;
+    /* data section is not rewritten, so keep its packing mark */
+    if (fseek(strm, offsetof(SACHEAD, unused17), SEEK_SET) != 0
+            || fread(&packed, sizeof(int), 1, strm) != 1) {
+        fprintf(stderr, "Error in reading SAC header %s\n", name);
+        fclose(strm);
+        return -1;
+    }
+    if (lswap == TRUE) byte_swap((char *)&packed, sizeof(int));
+    if (packed == SAC_DATA_PACKED)
+        hd.unused17 = SAC_DATA_PACKED;
+    else if (hd.unused17 == SAC_DATA_PACKED)
+        hd.unused17 = SAC_INT_UNDEF;
 
-    if (fwrite(ar, sz, 1, strm) != 1) {
-        fprintf(stderr, "Error in writing SAC data for writing %s\n", name);
+    pack_head(hd, buffer, lswap);
+
+    if (fseek(strm, 0L, SEEK_SET) != 0
+            || fwrite(buffer, sizeof(buffer), 1, strm) != 1) {
+        fprintf(stderr, "Error in writing SAC header %s\n", name);
         fclose(strm);
         return -1;
     }
-    fclose(strm);
+
+    if (fclose(strm) != 0) {
+        fprintf(stderr, "Error in writing SAC header %s\n", name);
+        return -1;
+    }
     return 0;
 }
 
@@ -313,51 +889,85 @@ int write_sac_xy(const char *name, SACHEAD hd, const float *xdata, const float *
  */
 float *read_sac_pdw(const char *name, SACHEAD *hd, int tmark, float t1, float t2)
 {
-    FILE    *strm;
+    FILE    *strm = NULL;
+    SACBUNDLE *b = NULL;
     int     lswap;
-    float   tref;
     int     nt1, nt2, npts, nn;
     float   *ar, *fpt;
+    int     i;
 
-    if ((strm = fopen(name, "rb")) == NULL) {
-        fprintf(stderr, "Error in opening %s\n", name);
-        return NULL;
-    }
+    if ((i = bundle_get(name, &b)) != -2) {     /* member of a bundle */
+        if (i < 0) return NULL;
+        if (sac_bundle_head(b, i, hd) != 0) {
+            bundle_put(b);
+            return NULL;
+        }
+        lswap = FALSE;
+    } else {
+        if ((strm = fopen(name, "rb")) == NULL) {
+            fprintf(stderr, "Error in opening %s\n", name);
+            return NULL;
+        }
 
-    lswap = read_head_in(name, hd, strm);
+        lswap = read_head_in(name, hd, strm);
 
-    if (lswap == -1) {
-        fclose(strm);
-        return NULL;
+        if (lswap == -1) {
+            fclose(strm);
+            return NULL;
+        }
     }
 
-    nn = (int)((t2-t1)/hd->delta);
-    if (nn<=0 || (ar = (float *)calloc((size_t)nn, SAC_DATA_SIZEOF)) == NULL) {
+    npts = hd->npts;
+    switch (sac_pdw_head(hd, tmark, t1, t2, &nt1)) {
+        case -1:
+            fprintf(stderr, "Errorin allocating memory for reading %s n=%d\n",
+                    name, hd->npts);
+            pdw_close(strm, b);
+            return NULL;
+        case -2:
+            fprintf(stderr, "Time mark undefined in %s\n", name);
+            pdw_close(strm, b);
+            return NULL;
+    }
+    nn = hd->npts;
+    nt2 = nt1 + nn;
+
+    if ((ar = (float *)calloc((size_t)nn, SAC_DATA_SIZEOF)) == NULL) {
         fprintf(stderr, "Errorin allocating memory for reading %s n=%d\n", name, nn);
-        fclose(strm);
+        pdw_close(strm, b);
         return NULL;
     }
 
-    tref = 0.;
-    if (tmark>=-5 && tmark<=9 && tmark!=-1) {
-        tref = *((float *) hd + TMARK + tmark);
-        if (fabs(tref+12345.)<0.1) {
-            fprintf(stderr, "Time mark undefined in %s\n", name);
+    if (nt1>npts || nt2 <0) {   /* return zero filled array */
+        pdw_close(strm, b);
+        return ar;
+    }
+    /* maybe warnings are needed! */
+
+    if (b != NULL) {
+        fpt = (nt1<0) ? ar - nt1 : ar;
+        if (nt1<0) nt1 = 0;
+        if (nt2>npts) nt2 = npts;
+        memcpy(fpt, sac_bundle_data(b, i) + nt1,
+               (size_t)(nt2 - nt1) * SAC_DATA_SIZEOF);
+        bundle_put(b);
+        return ar;
+    }
+
+    if (hd->unused17 == SAC_DATA_PACKED) {
+        /* decode only blocks of the window */
+        fpt = (nt1<0) ? ar - nt1 : ar;
+        if (nt1<0) nt1 = 0;
+        if (nt2>npts) nt2 = npts;
+        if (read_packed(name, strm, lswap, npts, nt1, nt2, fpt) != 0) {
             free(ar);
             fclose(strm);
             return NULL;
         }
+        hd->unused17 = SAC_INT_UNDEF;
+        fclose(strm);
+        return ar;
     }
-    t1 += tref;
-    nt1 = (int)((t1 - hd->b) / hd->delta);
-    nt2 = nt1 + nn;
-    npts = hd->npts;
-    hd->npts = nn;
-    hd->b   = t1;
-    hd->e   = t1 + nn * hd->delta;
-
-    if (nt1>npts || nt2 <0) return ar;    /* return zero filled array */
-    /* maybe warnings are needed! */
 
     if (nt1<0) {
         fpt = ar - nt1;
@@ -382,60 +992,193 @@ float *read_sac_pdw(const char *name, SACHEAD *hd, int tmark, float t1, float t2
     }
     fclose(strm);
 
-    if (lswap == TRUE) byte_swap((char*)ar, (size_t)nn*SAC_DATA_SIZEOF);
+    if (lswap == TRUE) byte_swap((char*)fpt, (size_t)nn*SAC_DATA_SIZEOF);
 
     return ar;
 }
 
 /*
- *  new_sac_head
+ *  read_sac_samples
  *
- *  Description: create a new SAC header with required fields
+ *  Description: read samples s0 to s1-1 of a SAC file into a buffer
+ *      given by caller, e.g. a row of a matrix. Only these samples are
+ *      read from disk.
  *
  *  IN:
- *      float   dt  :   sample interval
- *      int     ns  :   number of points
- *      float   b0  :   starting time
- */
-SACHEAD new_sac_head(float dt, int ns, float b0)
-{
-    SACHEAD hd = sac_null;
-    hd.delta    =   dt;
-    hd.npts     =   ns;
-    hd.b        =   b0;
-    hd.o        =   0.;
-    hd.e        =   b0+(ns-1)*dt;
-    hd.iztype   =   IO;
-    hd.iftype   =   ITIME;
-    hd.leven    =   TRUE;
-    hd.nvhdr    =   SAC_HEADER_MAJOR_VERSION;
-    return hd;
-}
-
-/*
- *  sac_head_index
- *
- *  Description: return the index of a specified sac head field
+ *      const char *name    :   file name
+ *      int         s0      :   first sample, 0 <= s0 <= s1
+ *      int         s1      :   end of samples, s1 <= npts
+ *  OUT:
+ *      float      *out     :   s1-s0 samples
  *
- *  In:
- *      const char *name    :   name of sac head field
- *  Return:
- *      index of a specified field in sac head
+ *  Return: 0 if success, -1 if failed
  *
  */
-int sac_head_index(const char *name)
+int read_sac_samples(const char *name, int s0, int s1, float *out)
 {
-    const char fields[SAC_HEADER_NUMBERS+SAC_HEADER_STRINGS][10] = {
-        "delta",    "depmin",   "depmax",   "scale",    "odelta",
-        "b",        "e",        "o",        "a",        "internal1",
-        "t0",       "t1",       "t2",       "t3",       "t4",
-        "t5",       "t6",       "t7",       "t8",       "t9",
-        "f",        "resp0",    "resp1",    "resp2",    "resp3",
-        "resp4",    "resp5",    "resp6",    "resp7",    "resp8",
-        "resp9",    "stla",     "stlo",     "stel",     "stdp",
-        "evla",     "evlo",     "evel",     "evdp",     "mag",
-        "user0",    "user1",    "user2",    "user3",    "user4",
-        "user5",    "user6",    "user7",    "user8",    "user9",
+    FILE    *strm;
+    SACBUNDLE *b;
+    SACHEAD hd;
+    int     lswap;
+    int     i;
+    size_t  sz = (size_t)(s1 - s0) * SAC_DATA_SIZEOF;
+
+    if ((i = bundle_get(name, &b)) != -2) {     /* member of a bundle */
+        if (i < 0) return -1;
+        lswap = sac_bundle_head(b, i, &hd);
+        if (lswap == 0 && (s0 < 0 || s1 < s0 || s1 > hd.npts)) {
+            fprintf(stderr, "Samples %d to %d out of %s\n", s0, s1, name);
+            lswap = -1;
+        }
+        if (lswap == 0) memcpy(out, sac_bundle_data(b, i) + s0, sz);
+        bundle_put(b);
+        return lswap;
+    }
+
+    if ((strm = fopen(name, "rb")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", name);
+        return -1;
+    }
+    if ((lswap = read_head_in(name, &hd, strm)) == -1) {
+        fclose(strm);
+        return -1;
+    }
+    if (s0 < 0 || s1 < s0 || s1 > hd.npts) {
+        fprintf(stderr, "Samples %d to %d out of %s\n", s0, s1, name);
+        fclose(strm);
+        return -1;
+    }
+
+    if (hd.unused17 == SAC_DATA_PACKED) {
+        i = read_packed(name, strm, lswap, hd.npts, s0, s1, out);
+        fclose(strm);
+        return i;
+    }
+
+    if (sz > 0 && (fseek(strm, (long)s0*SAC_DATA_SIZEOF, SEEK_CUR) != 0
+                   || fread(out, sz, 1, strm) != 1)) {
+        fprintf(stderr, "Error in reading SAC data %s\n", name);
+        fclose(strm);
+        return -1;
+    }
+    fclose(strm);
+
+    if (lswap == TRUE) byte_swap((char *)out, sz);
+    return 0;
+}
+
+/*
+ *  sac_pdw_head
+ *
+ *  Description:
+ *      Compute the partial data window of read_sac_pdw and update npts,
+ *      b and e of the header accordingly.
+ *
+ *  Arguments:
+ *      SACHEAD     *hd     :   SAC header of the whole file, updated
+ *      int         tmark   :   time mark in SAC header, see read_sac_pdw
+ *      float       t1      :   begin time is tmark + t1
+ *      float       t2      :   end time is tmark + t2
+ *      int         *nt1    :   index of the first sample of the window in
+ *                              the file, may be negative or beyond npts
+ *
+ *  Return:
+ *      0   :   succeed
+ *      -1  :   empty window
+ *      -2  :   time mark undefined
+ *
+ */
+int sac_pdw_head(SACHEAD *hd, int tmark, float t1, float t2, int *nt1)
+{
+    float   tref;
+    int     nn;
+
+    nn = (int)((t2-t1)/hd->delta);
+    if (nn<=0) {
+        hd->npts = nn;
+        return -1;
+    }
+
+    tref = 0.;
+    if (tmark>=-5 && tmark<=9 && tmark!=-1) {
+        tref = *((float *) hd + TMARK + tmark);
+        if (fabs(tref+12345.)<0.1) return -2;
+    }
+    t1 += tref;
+    *nt1 = (int)((t1 - hd->b) / hd->delta);
+    /* statistics of the file are not those of the window */
+    if (hd->unused16 == SAC_STATS_VALID) hd->unused16 = SAC_INT_UNDEF;
+    hd->npts = nn;
+    hd->b   = t1;
+    hd->e   = t1 + nn * hd->delta;
+    return 0;
+}
+
+/*
+ *  sac_head_pack
+ *
+ *  Description: pack header into its layout on disk in native byte order
+ *
+ *  IN:
+ *      SACHEAD     hd      :   header
+ *  OUT:
+ *      char       *buff    :   at least SAC_HEADER_SIZE bytes
+ *
+ */
+void sac_head_pack(SACHEAD hd, char *buff)
+{
+    pack_head(hd, buff, FALSE);
+}
+
+/*
+ *  new_sac_head
+ *
+ *  Description: create a new SAC header with required fields
+ *
+ *  IN:
+ *      float   dt  :   sample interval
+ *      int     ns  :   number of points
+ *      float   b0  :   starting time
+ */
+SACHEAD new_sac_head(float dt, int ns, float b0)
+{
+    SACHEAD hd = sac_null;
+    hd.delta    =   dt;
+    hd.npts     =   ns;
+    hd.b        =   b0;
+    hd.o        =   0.;
+    hd.e        =   b0+(ns-1)*dt;
+    hd.iztype   =   IO;
+    hd.iftype   =   ITIME;
+    hd.leven    =   TRUE;
+    hd.nvhdr    =   SAC_HEADER_MAJOR_VERSION;
+    return hd;
+}
+
+/*
+ *  sac_head_index
+ *
+ *  Description: return the index of a specified sac head field
+ *
+ *  In:
+ *      const char *name    :   name of sac head field
+ *  Return:
+ *      index of a specified field in sac head
+ *
+ */
+int sac_head_index(const char *name)
+{
+    const char fields[SAC_HEADER_NUMBERS+SAC_HEADER_STRINGS][10] = {
+        "delta",    "depmin",   "depmax",   "scale",    "odelta",
+        "b",        "e",        "o",        "a",        "internal1",
+        "t0",       "t1",       "t2",       "t3",       "t4",
+        "t5",       "t6",       "t7",       "t8",       "t9",
+        "f",        "resp0",    "resp1",    "resp2",    "resp3",
+        "resp4",    "resp5",    "resp6",    "resp7",    "resp8",
+        "resp9",    "stla",     "stlo",     "stel",     "stdp",
+        "evla",     "evlo",     "evel",     "evdp",     "mag",
+        "user0",    "user1",    "user2",    "user3",    "user4",
+        "user5",    "user6",    "user7",    "user8",    "user9",
         "dist",     "az",       "baz",      "gcarc",    "internal2",
         "internal3","depmen",   "cmpaz",    "cmpinc",   "xminimum",
         "xmaximum", "yminimum", "ymaximum", "unused1",  "unused2",
@@ -462,36 +1205,1110 @@ int sac_head_index(const char *name)
     for (i=0; i<SAC_HEADER_NUMBERS+SAC_HEADER_STRINGS; i++)
         if ((strcasecmp(name, fields[i]) == 0))  return i;
 
-    return -1;
+    return -1;
+}
+
+/*
+ *  issac
+ *
+ *  Description: check if a file is in SAC format
+ *
+ *  In:
+ *      const char *name    :   sac filename
+ *  Return:
+ *      -1 : fail
+ *      TRUE  : is a SAC file
+ *      FALSE  : not a SAC file
+ *
+ */
+int issac(const char *name)
+{
+    FILE *strm;
+    SACBUNDLE *b;
+    int nvhdr;
+    int i;
+
+    if ((i = bundle_get(name, &b)) != -2) {     /* member of a bundle */
+        if (i < 0) return -1;
+        bundle_put(b);
+        return TRUE;
+    }
+
+    if ((strm = fopen(name, "rb")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", name);
+        return -1;
+    }
+
+    if (fseek(strm, SAC_VERSION_LOCATION * SAC_DATA_SIZEOF, SEEK_SET)) return FALSE;
+    if (fread(&nvhdr, sizeof(int), 1, strm) != 1) return FALSE;
+    if (check_sac_nvhdr(nvhdr) == -1) return FALSE;
+    else return TRUE;
+}
+
+/*
+ *  sac_to_native
+ *
+ *  Description: convert a SAC file to native byte order.
+ *
+ *      The file is converted in blocks of SAC_SWAP_BLOCK bytes into a
+ *      temporary file in the same directory, which is synced and renamed
+ *      over the original, so the original is left intact on any failure.
+ *
+ *  In:
+ *      const char *name    :   sac filename
+ *  Return:
+ *      -1 : fail
+ *      TRUE  : converted
+ *      FALSE  : already in native byte order
+ *
+ */
+int sac_to_native(const char *name)
+{
+    int ifd, ofd;
+    int lswap;
+    int nvhdr;
+    struct stat st;
+    char *tmp;
+    char *buf;
+    ssize_t nr;
+    size_t nw;
+    int head = 1;
+    int error = 0;
+
+    if ((ifd = open(name, O_RDONLY)) < 0 || fstat(ifd, &st) != 0) {
+        fprintf(stderr, "Unable to open %s\n", name);
+        if (ifd >= 0) close(ifd);
+        return -1;
+    }
+    if (pread(ifd, &nvhdr, sizeof(int), SAC_VERSION_LOCATION*SAC_DATA_SIZEOF)
+            != sizeof(int) || (lswap = check_sac_nvhdr(nvhdr)) == -1
+            || st.st_size % SAC_DATA_SIZEOF != 0) {
+        fprintf(stderr, "Warning: %s not in sac format.\n", name);
+        close(ifd);
+        return -1;
+    }
+    if (lswap == FALSE) {
+        close(ifd);
+        return FALSE;
+    }
+
+    if ((tmp = (char *)malloc(strlen(name) + 16)) == NULL
+            || posix_memalign((void **)&buf, 4096, SAC_SWAP_BLOCK) != 0) {
+        fprintf(stderr, "Error in allocating memory %s\n", name);
+        free(tmp);
+        close(ifd);
+        return -1;
+    }
+    sprintf(tmp, "%s.swapXXXXXX", name);
+    if ((ofd = mkstemp(tmp)) < 0) {
+        fprintf(stderr, "Error in opening file for writing %s\n", tmp);
+        free(tmp);
+        free(buf);
+        close(ifd);
+        return -1;
+    }
+
+    while (!error && (nr = read_block(ifd, buf, SAC_SWAP_BLOCK)) > 0) {
+        if (head && nr < SAC_HEADER_SIZE) {
+            error = -1;
+            break;
+        }
+        if (head) {
+            /* strings in header are not swapped */
+            byte_swap(buf, SAC_HEADER_NUMBERS_SIZE);
+            byte_swap(buf + SAC_HEADER_SIZE, nr - SAC_HEADER_SIZE);
+            head = 0;
+        } else {
+            byte_swap(buf, nr);
+        }
+        for (nw=0; nw<(size_t)nr; ) {
+            ssize_t n = write(ofd, buf+nw, nr-nw);
+            if (n <= 0) {
+                error = -1;
+                break;
+            }
+            nw += n;
+        }
+    }
+    if (nr < 0) error = -1;
+
+    if (!error && (fchmod(ofd, st.st_mode & 07777) != 0 || fsync(ofd) != 0))
+        error = -1;
+    if (close(ofd) != 0) error = -1;
+    close(ifd);
+    if (!error && rename(tmp, name) != 0) error = -1;
+
+    if (error) {
+        fprintf(stderr, "Error in converting %s\n", name);
+        unlink(tmp);
+    }
+    free(tmp);
+    free(buf);
+    return error ? -1 : TRUE;
+}
+
+/*
+ *  sac_channel_name
+ *
+ *  Description: build channel name NET.STA.LOC.CMP from knetwk, kstnm,
+ *      khole and kcmpnm. Trailing blanks are removed and undefined
+ *      fields are left empty.
+ *
+ *  In:
+ *      const SACHEAD *hd   :   SAC header
+ *  Out:
+ *      char *name          :   at least SAC_CHANNEL_NAME_LENGTH bytes
+ *
+ */
+void sac_channel_name(const SACHEAD *hd, char *name)
+{
+    const char *fields[4];
+    char *p = name;
+    int i, n;
+
+    fields[0] = hd->knetwk;
+    fields[1] = hd->kstnm;
+    fields[2] = hd->khole;
+    fields[3] = hd->kcmpnm;
+
+    for (i=0; i<4; i++) {
+        if (i > 0) *p++ = '.';
+        if (strncmp(fields[i], SAC_CHAR8_UNDEF, 6) == 0) continue;
+        n = (int)strnlen(fields[i], SAC_HEADER_STRING_LENGTH_FILE);
+        while (n > 0 && fields[i][n-1] == ' ') n--;
+        memcpy(p, fields[i], n);
+        p += n;
+    }
+    *p = '\0';
+}
+
+/*
+ *  Bundle of SAC records
+ *
+ *  A bundle holds many SAC files in one file, so that datasets of small
+ *  files need neither an inode nor an open per file:
+ *
+ *      records     SAC files in native byte order, unpacked
+ *      padding     to 8 bytes
+ *      index       SACBENTRY of each member, in order of addition
+ *      trailer     SAC_BUNDLE_MAGIC, offset of index, number of members
+ *
+ *  A bundle is mapped into memory once by sac_bundle_open. Read
+ *  functions accept bundle.sacb:member as file name, with bundles kept
+ *  open in a small cache.
+ */
+
+/*
+ *  sac_bundle_open
+ *
+ *  Description: map a bundle into memory and check its index.
+ *
+ *  In:
+ *      const char *name    :   bundle filename
+ *  Return:
+ *      bundle, NULL if failed
+ *
+ */
+SACBUNDLE *sac_bundle_open(const char *name)
+{
+    SACBUNDLE *b;
+    BTRAILER tr;
+    struct stat st;
+    int fd, i;
+    void *base;
+
+    if ((fd = open(name, O_RDONLY)) < 0) {
+        fprintf(stderr, "Unable to open %s\n", name);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(BTRAILER)) {
+        fprintf(stderr, "Warning: %s not a SAC bundle.\n", name);
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error in mapping %s\n", name);
+        return NULL;
+    }
+
+    memcpy(&tr, (char *)base + st.st_size - sizeof(BTRAILER), sizeof(BTRAILER));
+    if (memcmp(tr.magic, SAC_BUNDLE_MAGIC, sizeof(tr.magic)) != 0
+            || tr.count < 0 || tr.count > INT_MAX || tr.index % 8 != 0
+            || tr.index + tr.count * (long long)sizeof(SACBENTRY)
+                + (long long)sizeof(BTRAILER) != (long long)st.st_size) {
+        fprintf(stderr, "Warning: %s not a SAC bundle.\n", name);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    if ((b = (SACBUNDLE *)malloc(sizeof(SACBUNDLE))) == NULL
+            || (b->order = (int *)malloc((tr.count+1)*sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory %s\n", name);
+        free(b);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    b->base = (char *)base;
+    b->size = st.st_size;
+    b->ent = (const SACBENTRY *)(b->base + tr.index);
+    b->n = (int)tr.count;
+
+    for (i=0; i<b->n; i++) {
+        const SACBENTRY *e = &b->ent[i];
+        long long sz = (long long)e->npts * SAC_DATA_SIZEOF;
+        if (e->iftype == IXY) sz *= 2;
+        if (e->offset < 0 || e->offset % SAC_DATA_SIZEOF != 0
+                || e->length != SAC_HEADER_SIZE + sz
+                || e->offset + e->length > tr.index
+                || memchr(e->name, '\0', SAC_BUNDLE_NAME_LENGTH) == NULL) {
+            fprintf(stderr, "Error in index of SAC bundle %s\n", name);
+            sac_bundle_close(b);
+            return NULL;
+        }
+        b->order[i] = i;
+    }
+    qsort_r(b->order, b->n, sizeof(int), compare_member, (void *)b->ent);
+
+    return b;
+}
+
+/*
+ *  sac_bundle_close: unmap a bundle opened by sac_bundle_open
+ */
+void sac_bundle_close(SACBUNDLE *b)
+{
+    if (b == NULL) return;
+    munmap(b->base, b->size);
+    free(b->order);
+    free(b);
+}
+
+/*
+ *  sac_bundle_count: return number of members of a bundle
+ */
+int sac_bundle_count(const SACBUNDLE *b)
+{
+    return b->n;
+}
+
+/*
+ *  sac_bundle_entry: return index entry of member i, NULL if out of range
+ */
+const SACBENTRY *sac_bundle_entry(const SACBUNDLE *b, int i)
+{
+    if (i < 0 || i >= b->n) return NULL;
+    return &b->ent[i];
+}
+
+/*
+ *  sac_bundle_find
+ *
+ *  Description: find a member of a bundle by name.
+ *
+ *  Return:
+ *      index of member, -1 if not found
+ *
+ */
+int sac_bundle_find(const SACBUNDLE *b, const char *member)
+{
+    int lo = 0, hi = b->n - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strncmp(member, b->ent[b->order[mid]].name,
+                          SAC_BUNDLE_NAME_LENGTH);
+        if (cmp == 0) return b->order[mid];
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return -1;
+}
+
+/*
+ *  sac_bundle_head
+ *
+ *  Description: read header of member i of a bundle.
+ *
+ *  Return: 0 if success, -1 if failed
+ *
+ */
+int sac_bundle_head(const SACBUNDLE *b, int i, SACHEAD *hd)
+{
+    const char *rec;
+
+    if (i < 0 || i >= b->n) return -1;
+    rec = b->base + b->ent[i].offset;
+    memcpy(hd, rec, SAC_HEADER_NUMBERS_SIZE);
+    if (check_sac_nvhdr(hd->nvhdr) != FALSE) return -1;
+    map_chdr_in((char *)(hd)+SAC_HEADER_NUMBERS_SIZE,
+                (char *)rec + SAC_HEADER_NUMBERS_SIZE);
+    return 0;
+}
+
+/*
+ *  sac_bundle_data
+ *
+ *  Description: return data of member i of a bundle without copying.
+ *      The data are valid until the bundle is closed.
+ *
+ */
+const float *sac_bundle_data(const SACBUNDLE *b, int i)
+{
+    if (i < 0 || i >= b->n) return NULL;
+    return (const float *)(b->base + b->ent[i].offset + SAC_HEADER_SIZE);
+}
+
+/*
+ *  sac_bundle_read
+ *
+ *  Description: read header and a copy of data of member i of a bundle.
+ *
+ *  Return: float pointer to the data array, NULL if failed.
+ *
+ */
+float *sac_bundle_read(const SACBUNDLE *b, int i, SACHEAD *hd)
+{
+    float *ar;
+    size_t sz;
+
+    if (sac_bundle_head(b, i, hd) != 0) return NULL;
+    sz = b->ent[i].length - SAC_HEADER_SIZE;
+    if ((ar = (float *)malloc(sz > 0 ? sz : 1)) == NULL) {
+        fprintf(stderr, "Error in allocating memory for reading %s\n",
+                b->ent[i].name);
+        return NULL;
+    }
+    memcpy(ar, sac_bundle_data(b, i), sz);
+    return ar;
+}
+
+/*
+ *  sac_bundle_create
+ *
+ *  Description: start writing a bundle. Members are added by
+ *      sac_bundle_add, and the bundle is completed by sac_bundle_finish.
+ *      It is written to a temporary file which is synced and renamed to
+ *      name when finished.
+ *
+ *  Return:
+ *      bundle writer, NULL if failed
+ *
+ */
+SACBWRITER *sac_bundle_create(const char *name)
+{
+    SACBWRITER *w;
+
+    if ((w = (SACBWRITER *)calloc(1, sizeof(SACBWRITER))) == NULL
+            || (w->name = strdup(name)) == NULL
+            || (w->tmp = temp_name(name)) == NULL) {
+        fprintf(stderr, "Error in allocating memory %s\n", name);
+        if (w != NULL) free(w->name);
+        free(w);
+        return NULL;
+    }
+    if ((w->fd = open_temp(w->tmp, name)) < 0) {
+        fprintf(stderr, "Error in opening file for writing %s\n", name);
+        free(w->tmp);
+        free(w->name);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/*
+ *  sac_bundle_add
+ *
+ *  Description: append a SAC file to a bundle being written.
+ *
+ *  In:
+ *      SACBWRITER  *w      :   bundle writer
+ *      const char *member  :   member name, shorter than
+ *                              SAC_BUNDLE_NAME_LENGTH and unique
+ *      SACHEAD     hd      :   header
+ *      const float *ar     :   data
+ *
+ *  Return: 0 if success, -1 if failed. After a failure the bundle is
+ *      discarded by sac_bundle_finish.
+ *
+ */
+int sac_bundle_add(SACBWRITER *w, const char *member, SACHEAD hd, const float *ar)
+{
+    char head[SAC_HEADER_SIZE];
+    struct iovec iov[2];
+    SACBENTRY *e;
+    size_t sz;
+
+    if (w->error) return -1;
+    if (member[0] == '\0' || strlen(member) >= SAC_BUNDLE_NAME_LENGTH) {
+        fprintf(stderr, "Invalid member name %s of %s\n", member, w->name);
+        w->error = -1;
+        return -1;
+    }
+    if (w->n == w->nmax) {
+        int nmax = w->nmax ? 2*w->nmax : 1024;
+        SACBENTRY *ent = (SACBENTRY *)realloc(w->ent, nmax*sizeof(SACBENTRY));
+        if (ent == NULL) {
+            fprintf(stderr, "Error in allocating memory %s\n", w->name);
+            w->error = -1;
+            return -1;
+        }
+        w->ent = ent;
+        w->nmax = nmax;
+    }
+
+    sz = (size_t)hd.npts * SAC_DATA_SIZEOF;
+    if (hd.iftype == IXY) sz *= 2;
+    if (hd.unused17 == SAC_DATA_PACKED) hd.unused17 = SAC_INT_UNDEF;
+    pack_head(hd, head, FALSE);
+    iov[0].iov_base = head;
+    iov[0].iov_len = SAC_HEADER_SIZE;
+    iov[1].iov_base = (void *)ar;
+    iov[1].iov_len = sz;
+    if (write_iov(w->fd, iov, 2) != 0) {
+        fprintf(stderr, "Error in writing SAC bundle %s\n", w->name);
+        w->error = -1;
+        return -1;
+    }
+
+    e = &w->ent[w->n++];
+    memset(e, 0, sizeof(SACBENTRY));
+    strcpy(e->name, member);
+    e->offset = w->off;
+    e->length = SAC_HEADER_SIZE + sz;
+    e->delta = hd.delta;    e->b = hd.b;    e->e = hd.e;
+    e->stla = hd.stla;      e->stlo = hd.stlo;
+    e->evla = hd.evla;      e->evlo = hd.evlo;
+    e->npts = hd.npts;      e->iftype = hd.iftype;
+    e->nzyear = hd.nzyear;  e->nzjday = hd.nzjday;
+    e->nzhour = hd.nzhour;  e->nzmin = hd.nzmin;
+    e->nzsec = hd.nzsec;    e->nzmsec = hd.nzmsec;
+    sac_channel_name(&hd, e->chan);
+    w->off += e->length;
+    return 0;
+}
+
+/*
+ *  sac_bundle_finish
+ *
+ *  Description: write index of a bundle, sync and rename it to its name,
+ *      and free the writer. A bundle with failed additions or duplicated
+ *      member names is discarded.
+ *
+ *  Return: 0 if success, -1 if failed
+ *
+ */
+int sac_bundle_finish(SACBWRITER *w)
+{
+    static const char zeros[8];
+    struct iovec iov[3];
+    BTRAILER tr;
+    int *order = NULL;
+    int i, error = w->error;
+
+    /* check uniqueness of names */
+    if (!error && (order = (int *)malloc((w->n+1)*sizeof(int))) == NULL)
+        error = -1;
+    if (!error) {
+        for (i=0; i<w->n; i++) order[i] = i;
+        qsort_r(order, w->n, sizeof(int), compare_member, w->ent);
+        for (i=1; i<w->n && !error; i++) {
+            if (strcmp(w->ent[order[i]].name, w->ent[order[i-1]].name) == 0) {
+                fprintf(stderr, "Duplicated member %s of %s\n",
+                        w->ent[order[i]].name, w->name);
+                error = -1;
+            }
+        }
+    }
+    free(order);
+
+    if (!error) {
+        memcpy(tr.magic, SAC_BUNDLE_MAGIC, sizeof(tr.magic));
+        tr.index = (w->off + 7) / 8 * 8;
+        tr.count = w->n;
+        iov[0].iov_base = (void *)zeros;
+        iov[0].iov_len = tr.index - w->off;
+        iov[1].iov_base = w->ent;
+        iov[1].iov_len = (size_t)w->n * sizeof(SACBENTRY);
+        iov[2].iov_base = &tr;
+        iov[2].iov_len = sizeof(tr);
+        if (write_iov(w->fd, iov, 3) != 0 || fsync(w->fd) != 0) {
+            fprintf(stderr, "Error in writing SAC bundle %s\n", w->name);
+            error = -1;
+        }
+    }
+    if (close(w->fd) != 0 && !error) {
+        fprintf(stderr, "Error in writing SAC bundle %s\n", w->name);
+        error = -1;
+    }
+    if (!error && (rename(w->tmp, w->name) != 0 || sync_dir(w->name) != 0)) {
+        fprintf(stderr, "Error in renaming %s\n", w->name);
+        error = -1;
+    }
+    if (error) unlink(w->tmp);
+
+    free(w->ent);
+    free(w->tmp);
+    free(w->name);
+    free(w);
+    return error;
+}
+
+/*
+ *  sac_expand_bundles
+ *
+ *  Description: replace names of whole bundles, i.e. ending with
+ *      SAC_BUNDLE_EXT, by names bundle.sacb:member of all their members.
+ *      Other names are kept.
+ *
+ *  In:
+ *      int     n       :   number of names
+ *      char  **names   :   names of files
+ *  Out:
+ *      char ***out     :   new array of names, to be freed by caller.
+ *                          Names of members are allocated and never freed.
+ *  Return:
+ *      number of names in out, -1 if failed
+ *
+ */
+int sac_expand_bundles(int n, char **names, char ***out)
+{
+    char **list;
+    int nlist = 0, nmax = n + 1;
+    int i, j;
+
+    if ((list = (char **)malloc(nmax*sizeof(char *))) == NULL) return -1;
+
+    for (i=0; i<n; i++) {
+        size_t len = strlen(names[i]);
+        size_t lext = strlen(SAC_BUNDLE_EXT);
+        SACBUNDLE *b;
+
+        if (len < lext || strcmp(names[i] + len - lext, SAC_BUNDLE_EXT) != 0) {
+            list[nlist++] = names[i];
+            continue;
+        }
+        if ((b = sac_bundle_open(names[i])) == NULL) continue;
+        if (nlist + b->n + (n - i) > nmax) {
+            char **tmp;
+            nmax = nlist + b->n + (n - i);
+            if ((tmp = (char **)realloc(list, nmax*sizeof(char *))) == NULL) {
+                sac_bundle_close(b);
+                free(list);
+                return -1;
+            }
+            list = tmp;
+        }
+        for (j=0; j<b->n; j++) {
+            char *s = (char *)malloc(len + strlen(b->ent[j].name) + 2);
+            if (s == NULL) {
+                sac_bundle_close(b);
+                free(list);
+                return -1;
+            }
+            sprintf(s, "%s:%s", names[i], b->ent[j].name);
+            list[nlist++] = s;
+        }
+        sac_bundle_close(b);
+    }
+
+    *out = list;
+    return nlist;
+}
+
+/*
+ *  sac_read_list
+ *
+ *  Description: append names of files in a list, one per line, to files.
+ *      Empty lines are skipped.
+ *
+ *  In:
+ *      const char *list    :   name of list
+ *      char      **files   :   names of files so far, not freed
+ *      int        *nfile   :   number of names so far
+ *  Out:
+ *      int        *nfile   :   number of names in the new array
+ *  Return:
+ *      new array of names, to be freed by caller, NULL if failed
+ *
+ */
+char **sac_read_list(const char *list, char **files, int *nfile)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    char **all, **tmp;
+    int n = *nfile, nmax = n + 1024, i;
+
+    if ((fp = fopen(list, "r")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", list);
+        return NULL;
+    }
+    if ((all = (char **)malloc(nmax*sizeof(char *))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        fclose(fp);
+        return NULL;
+    }
+    if (n > 0) memcpy(all, files, n*sizeof(char *));
+    while ((len = getline(&line, &cap, fp)) != -1) {
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0) continue;
+        if (n == nmax) {
+            nmax *= 2;
+            if ((tmp = (char **)realloc(all, nmax*sizeof(char *))) == NULL)
+                goto error;
+            all = tmp;
+        }
+        if ((all[n] = strdup(line)) == NULL) goto error;
+        n++;
+    }
+    free(line);
+    fclose(fp);
+    *nfile = n;
+    return all;
+
+error:
+    fprintf(stderr, "Error in allocating memory\n");
+    for (i=*nfile; i<n; i++) free(all[i]);
+    free(all);
+    free(line);
+    fclose(fp);
+    return NULL;
+}
+
+/*
+ *  sac_out_name
+ *
+ *  Description: name of the output of a file, i.e. the file itself if dir
+ *      is NULL, or else dir/base.ext, base being the name of the file
+ *      without directories, or the member name for members of bundles.
+ *
+ *  In:
+ *      const char *file    :   name of input
+ *      const char *dir     :   output directory, NULL to overwrite input
+ *      const char *ext     :   extension appended to base, or NULL
+ *      int         size    :   size of out
+ *  Out:
+ *      char       *out     :   name of output
+ *  Return:
+ *      0 if success, -1 if failed
+ *
+ */
+int sac_out_name(const char *file, const char *dir, const char *ext,
+                 char *out, int size)
+{
+    const char *base;
+    int len;
+
+    if (dir == NULL) {
+        if (strstr(file, SAC_BUNDLE_EXT ":") != NULL) {
+            fprintf(stderr, "Unable to overwrite member %s\n", file);
+            return -1;
+        }
+        len = snprintf(out, size, "%s", file);
+    } else {
+        if ((base = strstr(file, SAC_BUNDLE_EXT ":")) != NULL)
+            base += strlen(SAC_BUNDLE_EXT ":");
+        else if ((base = strrchr(file, '/')) != NULL)
+            base++;
+        else
+            base = file;
+        len = snprintf(out, size, "%s/%s%s%s", dir, base,
+                       (ext != NULL) ? "." : "", (ext != NULL) ? ext : "");
+    }
+    if (len < 0 || len >= size) {
+        fprintf(stderr, "File name too long %s\n", file);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ *  sac_same_file
+ *
+ *  Description: whether names a and b are of the same file, also by other
+ *      paths or links, e.g. an output that would replace its input
+ *
+ *  Return: 1 if the same file, 0 if not or either does not exist
+ *
+ */
+int sac_same_file(const char *a, const char *b)
+{
+    struct stat sa, sb;
+
+    if (strcmp(a, b) == 0) return 1;
+    if (stat(a, &sa) != 0 || stat(b, &sb) != 0) return 0;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+/*
+ *  sac_stream_open
+ *
+ *  Description: open a SAC file for reading its data piece by piece by
+ *      sac_stream_read, so that long records need not be held in memory.
+ *      Swapped, packed files and members of bundles are supported, but
+ *      not IXY files.
+ *
+ *  IN:
+ *      const char *name    :   file name
+ *  OUT:
+ *      SACHEAD    *hd      :   SAC header
+ *
+ *  Return: stream, NULL if failed
+ *
+ */
+SACSTREAM *sac_stream_open(const char *name, SACHEAD *hd)
+{
+    SACSTREAM *s;
+
+    if ((s = (SACSTREAM *)calloc(1, sizeof(SACSTREAM))) == NULL
+            || (s->name = strdup(name)) == NULL) {
+        fprintf(stderr, "Error in allocating memory %s\n", name);
+        free(s);
+        return NULL;
+    }
+    s->fd = -1;
+
+    if ((s->member = bundle_get(name, &s->b)) != -2) {  /* member of a bundle */
+        if (s->member < 0 || sac_bundle_head(s->b, s->member, hd) != 0) {
+            if (s->member >= 0) bundle_put(s->b);
+            free(s->name);
+            free(s);
+            return NULL;
+        }
+        s->b_data = sac_bundle_data(s->b, s->member);
+    } else {
+        s->b = NULL;
+        if ((s->strm = fopen(name, "rb")) == NULL) {
+            fprintf(stderr, "Unable to open %s\n", name);
+            free(s->name);
+            free(s);
+            return NULL;
+        }
+        if ((s->lswap = read_head_in(name, hd, s->strm)) == -1) {
+            sac_stream_close(s);
+            return NULL;
+        }
+        s->packed = (hd->unused17 == SAC_DATA_PACKED);
+        hd->unused17 = SAC_INT_UNDEF;
+    }
+    if (hd->iftype == IXY) {
+        fprintf(stderr, "Unable to stream IXY file %s\n", name);
+        sac_stream_close(s);
+        return NULL;
+    }
+    s->npts = hd->npts;
+    return s;
+}
+
+/*
+ *  sac_stream_seek: move to sample k of a stream opened for reading
+ *
+ *  Return: 0 if success, -1 if k is out of data
+ */
+int sac_stream_seek(SACSTREAM *s, int k)
+{
+    if (s->writing || k < 0 || k > s->npts) return -1;
+    s->pos = k;
+    return 0;
+}
+
+/*
+ *  sac_stream_read
+ *
+ *  Description: read next n samples of a stream, fewer at end of data.
+ *
+ *  Return: number of samples read, 0 at end of data, -1 if failed
+ *
+ */
+int sac_stream_read(SACSTREAM *s, float *buf, int n)
+{
+    size_t sz;
+
+    if (s->writing) return -1;
+    if (n > s->npts - s->pos) n = s->npts - s->pos;
+    if (n <= 0) return 0;
+    sz = (size_t)n * SAC_DATA_SIZEOF;
+
+    if (s->b != NULL) {
+        memcpy(buf, s->b_data + s->pos, sz);
+    } else if (s->packed) {
+        if (fseek(s->strm, SAC_HEADER_SIZE, SEEK_SET) != 0
+                || read_packed(s->name, s->strm, s->lswap, s->npts,
+                               s->pos, s->pos + n, buf) != 0)
+            return -1;
+    } else {
+        if (fseek(s->strm, SAC_HEADER_SIZE + (long)s->pos*SAC_DATA_SIZEOF,
+                  SEEK_SET) != 0
+                || fread(buf, sz, 1, s->strm) != 1) {
+            fprintf(stderr, "Error in reading SAC data %s\n", s->name);
+            return -1;
+        }
+        if (s->lswap == TRUE) byte_swap((char *)buf, sz);
+    }
+    s->pos += n;
+    return n;
+}
+
+/*
+ *  sac_stream_create
+ *
+ *  Description: create a SAC file to be written piece by piece by
+ *      sac_stream_write. npts and e of the header are set from the
+ *      samples written when the stream is closed.
+ *
+ *  IN:
+ *      const char *name    :   file name
+ *      SACHEAD     hd      :   header
+ *      int         flags   :   SAC_WRITE_ATOMIC, SAC_WRITE_SYNC and
+ *                              SAC_WRITE_STATS of write_sac_opt
+ *
+ *  Return: stream, NULL if failed
+ *
+ */
+SACSTREAM *sac_stream_create(const char *name, SACHEAD hd, int flags)
+{
+    SACSTREAM *s;
+    const char *path = name;
+
+    if (strstr(name, SAC_BUNDLE_EXT ":") != NULL) {
+        fprintf(stderr, "Unable to write into SAC bundle %s\n", name);
+        return NULL;
+    }
+    if (hd.iftype == IXY) {
+        fprintf(stderr, "Unable to stream IXY file %s\n", name);
+        return NULL;
+    }
+    if ((s = (SACSTREAM *)calloc(1, sizeof(SACSTREAM))) == NULL
+            || (s->name = strdup(name)) == NULL) {
+        fprintf(stderr, "Error in allocating memory %s\n", name);
+        free(s);
+        return NULL;
+    }
+    if (flags & SAC_WRITE_SYNC) flags |= SAC_WRITE_ATOMIC;
+    if (flags & SAC_WRITE_ATOMIC) {
+        if ((s->tmp = temp_name(name)) == NULL) {
+            fprintf(stderr, "Error in allocating memory %s\n", name);
+            free(s->name);
+            free(s);
+            return NULL;
+        }
+        path = s->tmp;
+    }
+
+    if (s->tmp != NULL)
+        s->fd = open_temp(path, name);
+    else
+        s->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (s->fd < 0 || lseek(s->fd, SAC_HEADER_SIZE, SEEK_SET) < 0) {
+        if (s->fd >= 0) close(s->fd);
+        fprintf(stderr, "Error in opening file for writing %s\n", name);
+        free(s->tmp);
+        free(s->name);
+        free(s);
+        return NULL;
+    }
+    s->writing = 1;
+    s->flags = flags;
+    s->hd = hd;
+    s->st.min = FLT_MAX;
+    s->st.max = -FLT_MAX;
+    s->st.sum = 0.;
+    s->st.nnan = 0;
+    return s;
+}
+
+/*
+ *  sac_stream_write: append n samples to a stream created for writing
+ *
+ *  Return: 0 if success, -1 if failed
+ */
+int sac_stream_write(SACSTREAM *s, const float *buf, int n)
+{
+    struct iovec iov;
+
+    if (!s->writing || s->error) return -1;
+    if (n <= 0) return 0;
+    if (s->flags & SAC_WRITE_STATS) data_stats(buf, n, &s->st);
+    iov.iov_base = (void *)buf;
+    iov.iov_len = (size_t)n * SAC_DATA_SIZEOF;
+    if (write_iov(s->fd, &iov, 1) != 0) {
+        fprintf(stderr, "Error in writing SAC data %s\n", s->name);
+        s->error = -1;
+        return -1;
+    }
+    s->pos += n;
+    return 0;
+}
+
+/*
+ *  sac_stream_copy: append n samples read from stream in, from its current
+ *      sample on, to a stream created for writing. Samples of files in
+ *      native byte order are copied by copy_file_range without passing
+ *      through user space, unless statistics are to be computed.
+ *
+ *  Return: 0 if success, -1 if failed
+ */
+int sac_stream_copy(SACSTREAM *s, SACSTREAM *in, int n)
+{
+    float *buf;
+    int k, nb;
+
+    if (!s->writing || s->error || in->writing) return -1;
+    if (n > in->npts - in->pos) n = in->npts - in->pos;
+    if (n <= 0) return 0;
+
+    if (in->b == NULL && !in->packed && in->lswap == FALSE
+            && !(s->flags & SAC_WRITE_STATS)) {
+        int fd = fileno(in->strm);
+        off_t off = SAC_HEADER_SIZE + (off_t)in->pos * SAC_DATA_SIZEOF;
+        size_t left = (size_t)n * SAC_DATA_SIZEOF;
+        while (left > 0) {
+            ssize_t nc = copy_file_range(fd, &off, s->fd, NULL, left, 0);
+            if (nc < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL
+                           || errno == EOPNOTSUPP))
+                break;      /* not supported between these files */
+            if (nc <= 0) {
+                fprintf(stderr, "Error in copying SAC data %s\n", in->name);
+                s->error = -1;
+                return -1;
+            }
+            left -= nc;
+        }
+        k = n - (int)(left / SAC_DATA_SIZEOF);
+        in->pos += k;
+        s->pos += k;
+        n -= k;
+        if (n == 0) return 0;
+    }
+
+    nb = (n < SAC_SWAP_BLOCK / SAC_DATA_SIZEOF) ? n : SAC_SWAP_BLOCK / SAC_DATA_SIZEOF;
+    if ((buf = (float *)malloc((size_t)nb * SAC_DATA_SIZEOF)) == NULL) {
+        fprintf(stderr, "Error in allocating memory %s\n", s->name);
+        s->error = -1;
+        return -1;
+    }
+    while (n > 0) {
+        if ((k = sac_stream_read(in, buf, n < nb ? n : nb)) <= 0
+                || sac_stream_write(s, buf, k) != 0) {
+            free(buf);
+            s->error = -1;
+            return -1;
+        }
+        n -= k;
+    }
+    free(buf);
+    return 0;
+}
+
+/*
+ *  sac_stream_reserve
+ *
+ *  Description: preallocate space of npts samples of a stream created for
+ *      writing, so that its data are laid out contiguously. The file is
+ *      truncated to the samples written by sac_stream_close, if fewer.
+ *
+ *  Return: 0 if success, -1 if not supported by the file system, which
+ *      does no harm to writing
+ *
+ */
+int sac_stream_reserve(SACSTREAM *s, int npts)
+{
+    if (!s->writing || npts <= 0) return -1;
+    if (fallocate(s->fd, 0, SAC_HEADER_SIZE,
+                  (off_t)npts * SAC_DATA_SIZEOF) != 0)
+        return -1;
+    s->reserved = npts;
+    return 0;
 }
 
 /*
- *  issac
+ *  sac_stream_close
  *
- *  Description: check if a file is in SAC format
+ *  Description: close a stream. For a stream being written, the header
+ *      is written with npts, e and optionally statistics of the data,
+ *      and the file is synced and renamed according to its flags.
  *
- *  In:
- *      const char *name    :   sac filename
- *  Return:
- *      -1 : fail
- *      TRUE  : is a SAC file
- *      FALSE  : not a SAC file
+ *  Return: 0 if success, -1 if failed
  *
  */
-int issac(const char *name)
+int sac_stream_close(SACSTREAM *s)
 {
-    FILE *strm;
-    int nvhdr;
+    char head[SAC_HEADER_SIZE];
+    int error = 0;
 
-    if ((strm = fopen(name, "rb")) == NULL) {
-        fprintf(stderr, "Unable to open %s\n", name);
-        return -1;
+    if (s == NULL) return 0;
+
+    if (!s->writing) {
+        if (s->strm != NULL) fclose(s->strm);
+        if (s->b != NULL) bundle_put(s->b);
+        free(s->name);
+        free(s);
+        return 0;
     }
 
-    if (fseek(strm, SAC_VERSION_LOCATION * SAC_DATA_SIZEOF, SEEK_SET)) return FALSE;
-    if (fread(&nvhdr, sizeof(int), 1, strm) != 1) return FALSE;
-    if (check_sac_nvhdr(nvhdr) == -1) return FALSE;
-    else return TRUE;
+    error = s->error;
+    s->hd.npts = s->pos;
+    s->hd.e = s->hd.b + (s->pos - 1) * s->hd.delta;
+    if (s->hd.unused17 == SAC_DATA_PACKED) s->hd.unused17 = SAC_INT_UNDEF;
+    if (s->flags & SAC_WRITE_STATS)
+        set_stats(&s->hd, &s->st);
+    else if (s->hd.unused16 == SAC_STATS_VALID)
+        s->hd.unused16 = SAC_INT_UNDEF;
+    pack_head(s->hd, head, FALSE);
+    if (!error && pwrite(s->fd, head, SAC_HEADER_SIZE, 0) != SAC_HEADER_SIZE) {
+        fprintf(stderr, "Error in writing SAC header %s\n", s->name);
+        error = -1;
+    }
+    if (!error && s->reserved > s->pos
+            && ftruncate(s->fd, SAC_HEADER_SIZE + (off_t)s->pos * SAC_DATA_SIZEOF) != 0) {
+        fprintf(stderr, "Error in truncating %s\n", s->name);
+        error = -1;
+    }
+    if (!error && (s->flags & SAC_WRITE_SYNC) && fsync(s->fd) != 0) {
+        fprintf(stderr, "Error in syncing %s\n", s->name);
+        error = -1;
+    }
+    if (close(s->fd) != 0 && !error) {
+        fprintf(stderr, "Error in writing SAC data %s\n", s->name);
+        error = -1;
+    }
+    if (s->tmp != NULL) {
+        if (error) {
+            unlink(s->tmp);
+        } else if (rename(s->tmp, s->name) != 0
+                || ((s->flags & SAC_WRITE_SYNC) && sync_dir(s->name) != 0)) {
+            fprintf(stderr, "Error in renaming %s\n", s->name);
+            unlink(s->tmp);
+            error = -1;
+        }
+    }
+
+    free(s->tmp);
+    free(s->name);
+    free(s);
+    return error;
+}
+
+/*
+ *  sac_stream_cancel: close a stream, discarding a file being written
+ */
+void sac_stream_cancel(SACSTREAM *s)
+{
+    if (s == NULL) return;
+    if (s->writing) {
+        close(s->fd);
+        unlink(s->tmp != NULL ? s->tmp : s->name);
+        free(s->tmp);
+        free(s->name);
+        free(s);
+        return;
+    }
+    sac_stream_close(s);
 }
 
 /******************************************************************************
@@ -512,19 +2329,35 @@ int issac(const char *name)
  *      For 4 bytes,
  *      byte swapping means taking [0][1][2][3],
  *      and turning it into [3][2][1][0]
+ *
+ *      16 bytes are swapped at a time with SSE2/SSSE3 when available.
  */
 static void byte_swap(char *pt, size_t n)
 {
-    size_t  i   ;
-    char    tmp ;
-    for (i=0; i<n; i+=4) {
-        tmp     =   pt[i+3];
-        pt[i+3] =   pt[i];
-        pt[i]   =   tmp;
-
-        tmp     =   pt[i+2];
-        pt[i+2] =   pt[i+1];
-        pt[i+1] =   tmp;
+    size_t  i = 0;
+    uint32_t w;
+
+#if defined(__SSSE3__)
+    const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+                                      4, 5, 6, 7, 0, 1, 2, 3);
+    for (; i+16<=n; i+=16) {
+        __m128i v = _mm_loadu_si128((__m128i *)(pt+i));
+        _mm_storeu_si128((__m128i *)(pt+i), _mm_shuffle_epi8(v, mask));
+    }
+#elif defined(__SSE2__)
+    for (; i+16<=n; i+=16) {
+        __m128i v = _mm_loadu_si128((__m128i *)(pt+i));
+        /* swap bytes in 16-bit words, then swap 16-bit words */
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, 0xB1);
+        v = _mm_shufflehi_epi16(v, 0xB1);
+        _mm_storeu_si128((__m128i *)(pt+i), v);
+    }
+#endif
+    for (; i+4<=n; i+=4) {
+        memcpy(&w, pt+i, 4);
+        w = (w >> 24) | ((w >> 8) & 0xff00u) | ((w << 8) & 0xff0000u) | (w << 24);
+        memcpy(pt+i, &w, 4);
     }
 }
 
@@ -670,43 +2503,752 @@ static void map_chdr_out(char *memar, char *buff)
     }
 }
 /*
+ *  read_block:
+ *      read n bytes unless end of file is reached
  *
- *  write_head_out
+ *  Return: number of bytes read, -1 if failed
+ */
+static ssize_t read_block(int fd, char *buff, size_t n)
+{
+    size_t  nr = 0;
+    ssize_t k;
+
+    while (nr < n) {
+        if ((k = read(fd, buff+nr, n-nr)) < 0) return -1;
+        if (k == 0) break;
+        nr += k;
+    }
+    return (ssize_t)nr;
+}
+
+/*
+ *  pack_head:
+ *      pack header into its on-disk layout, swapping the numeric part
+ *      if lswap is TRUE.
+ */
+static void pack_head(SACHEAD hd, char *buff, int lswap)
+{
+    memcpy(buff, &hd, SAC_HEADER_NUMBERS_SIZE);
+    if (lswap == TRUE) byte_swap(buff, SAC_HEADER_NUMBERS_SIZE);
+    map_chdr_out((char *)(&hd)+SAC_HEADER_NUMBERS_SIZE,
+                 buff+SAC_HEADER_NUMBERS_SIZE);
+}
+
+/*
+ *  write_iov:
+ *      write all of iov to fd, resuming after partial writes
  *
- *  IN:
- *      const char *name : file name, only for debug
- *      SACHEAD     hd   : header to be written
- *      FILE       *strm : file handler
+ *  Return: 0 if success, -1 if failed
+ */
+static int write_iov(int fd, struct iovec *iov, int n)
+{
+    ssize_t k;
+
+    while (n > 0) {
+        if ((k = writev(fd, iov, n)) < 0) return -1;
+        while (n > 0 && (size_t)k >= iov->iov_len) {
+            k -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + k;
+            iov->iov_len -= k;
+        }
+    }
+    return 0;
+}
+
+/*
+ *  temp_name:
+ *      name of a temporary file in the same directory as name
+ */
+static char *temp_name(const char *name)
+{
+    static unsigned long count = 0;
+    unsigned long id;
+    char *tmp;
+
+    if ((tmp = (char *)malloc(strlen(name) + 48)) == NULL) return NULL;
+    id = __sync_fetch_and_add(&count, 1);
+    sprintf(tmp, "%s.tmp.%ld.%lu", name, (long)getpid(), id);
+    return tmp;
+}
+
+/*
+ *  open_temp:
+ *      create the temporary file tmp to be renamed to name, with the
+ *      permissions of name if it exists, so that they are kept when name
+ *      is replaced. Other links of name keep the old file.
+ */
+static int open_temp(const char *tmp, const char *name)
+{
+    struct stat st;
+    int fd;
+
+    if ((fd = open(tmp, O_WRONLY|O_CREAT|O_EXCL, 0666)) < 0) return -1;
+    if (stat(name, &st) == 0 && fchmod(fd, st.st_mode & 07777) != 0) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ *  sync_dir:
+ *      sync the directory containing name, so that a rename is durable
+ */
+static int sync_dir(const char *name)
+{
+    char *dir;
+    char *p;
+    int fd;
+    int error = 0;
+
+    if ((dir = strdup(name)) == NULL) return -1;
+    if ((p = strrchr(dir, '/')) == NULL) strcpy(dir, ".");
+    else if (p == dir) p[1] = '\0';
+    else *p = '\0';
+
+    if ((fd = open(dir, O_RDONLY)) < 0 || fsync(fd) != 0) error = -1;
+    if (fd >= 0) close(fd);
+    free(dir);
+    return error;
+}
+
+/*
+ *  batch_add:
+ *      queue tmp to be renamed to name at next commit
+ */
+static int batch_add(char *tmp, const char *name)
+{
+    int nerr = 0;
+
+    pthread_mutex_lock(&batch_lock);
+    if (batch_n == batch_max) {
+        int nmax = batch_max ? 2*batch_max : 64;
+        void *p = realloc(batch, nmax*sizeof(*batch));
+        if (p == NULL) {
+            pthread_mutex_unlock(&batch_lock);
+            fprintf(stderr, "Error in allocating memory %s\n", name);
+            unlink(tmp);
+            free(tmp);
+            return -1;
+        }
+        batch = p;
+        batch_max = nmax;
+    }
+    if ((batch[batch_n].name = strdup(name)) == NULL) {
+        pthread_mutex_unlock(&batch_lock);
+        fprintf(stderr, "Error in allocating memory %s\n", name);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    batch[batch_n].tmp = tmp;
+    batch_n++;
+    if (batch_n >= SAC_WRITE_BATCH_MAX) nerr = batch_commit();
+    pthread_mutex_unlock(&batch_lock);
+
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  batch_commit:
+ *      sync and rename all queued files, called with batch_lock held
  *
- *  Return:
- *      -1  :   failed.
- *       0  :   success.
+ *  Return: number of files failed
  */
-static int write_head_out(const char *name, SACHEAD hd, FILE *strm)
+static int batch_commit(void)
 {
-    char *buffer;
+    int i, fd;
+    int nerr = 0;
+    int synced = 0;
 
-    if (sizeof(float) != SAC_DATA_SIZEOF || sizeof(int) != SAC_DATA_SIZEOF) {
-        fprintf(stderr, "Mismatch in size of basic data type!\n");
+    if (batch_n == 0) return 0;
+
+#ifdef __linux__
+    /* one syncfs covers all files on the same filesystem */
+    if ((fd = open(batch[0].tmp, O_RDONLY)) >= 0) {
+        synced = (syncfs(fd) == 0);
+        close(fd);
+    }
+    for (i=1; synced && i<batch_n; i++) {
+        struct stat s0, s1;
+        if (stat(batch[0].tmp, &s0) != 0 || stat(batch[i].tmp, &s1) != 0
+                || s0.st_dev != s1.st_dev)
+            synced = 0;
+    }
+#endif
+    for (i=0; i<batch_n; i++) {
+        int error = 0;
+        if (!synced) {
+            if ((fd = open(batch[i].tmp, O_RDONLY)) < 0 || fsync(fd) != 0)
+                error = -1;
+            if (fd >= 0) close(fd);
+        }
+        if (error || rename(batch[i].tmp, batch[i].name) != 0) {
+            fprintf(stderr, "Error in committing %s\n", batch[i].name);
+            unlink(batch[i].tmp);
+            free(batch[i].name);
+            batch[i].name = NULL;
+            nerr++;
+        }
+        free(batch[i].tmp);
+    }
+
+    /* sync each directory once */
+    for (i=0; i<batch_n; i++) {
+        int j;
+        char *p;
+        size_t len;
+
+        if (batch[i].name == NULL) continue;
+        p = strrchr(batch[i].name, '/');
+        len = p ? (size_t)(p - batch[i].name) : 0;
+        for (j=0; j<i; j++) {
+            char *q;
+            if (batch[j].name == NULL) continue;
+            q = strrchr(batch[j].name, '/');
+            if ((q ? (size_t)(q - batch[j].name) : 0) == len
+                    && strncmp(batch[i].name, batch[j].name, len) == 0)
+                break;
+        }
+        if (j == i && sync_dir(batch[i].name) != 0) nerr++;
+    }
+    for (i=0; i<batch_n; i++) free(batch[i].name);
+
+    batch_n = 0;
+    return nerr;
+}
+
+/*
+ *  writer_main:
+ *      I/O thread of SACWRITER
+ */
+static void *writer_main(void *arg)
+{
+    SACWRITER *w = (SACWRITER *)arg;
+    WRITEJOB job;
+    int flags;
+    int error;
+    int sync;
+
+    flags = (w->durability == SAC_DURABLE_FSYNC) ? SAC_WRITE_SYNC : 0;
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (w->count == 0 && !w->stop)
+            pthread_cond_wait(&w->not_empty, &w->lock);
+        if (w->count == 0 && w->stop) {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        job = w->queue[w->head];
+        w->head = (w->head + 1) % w->qsize;
+        w->count--;
+        w->busy++;
+        pthread_cond_signal(&w->not_full);
+        pthread_mutex_unlock(&w->lock);
+
+        error = write_sac_opt(job.name, job.hd, job.ar, flags);
+        free(job.ar);
+
+        sync = 0;
+        pthread_mutex_lock(&w->lock);
+        if (error) w->nerr++;
+        if (w->durability == SAC_DURABLE_SYNCFS
+                && ++w->nwritten >= SAC_WRITER_SYNC_PERIOD) {
+            w->nwritten = 0;
+            sync = 1;
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        if (sync && syncfs_path(job.name) != 0) error = -1;
+
+        pthread_mutex_lock(&w->lock);
+        if (sync && error) w->nerr++;
+        free(w->last);
+        w->last = job.name;
+        w->busy--;
+        if (w->count == 0 && w->busy == 0)
+            pthread_cond_broadcast(&w->idle);
+        pthread_mutex_unlock(&w->lock);
+    }
+    return NULL;
+}
+
+/*
+ *  syncfs_path:
+ *      sync the filesystem containing name, or everything where syncfs
+ *      is not available
+ */
+static int syncfs_path(const char *name)
+{
+#ifdef __linux__
+    int fd, error;
+
+    if ((fd = open(name, O_RDONLY)) < 0) return -1;
+    error = syncfs(fd);
+    close(fd);
+    return error ? -1 : 0;
+#else
+    sync();
+    return 0;
+#endif
+}
+
+/*
+ *  data_stats:
+ *      update running minimum, maximum and sum with n samples, counting
+ *      NaN samples, e.g. of gaps, instead of adding them
+ */
+static void data_stats(const float *ar, size_t n, STATS *st)
+{
+    size_t  i, nnan = 0;
+    float   mn = st->min;
+    float   mx = st->max;
+    double  sum = 0.;
+
+    #pragma omp simd reduction(min:mn) reduction(max:mx) reduction(+:sum)
+    for (i=0; i<n; i++) {
+        mn = ar[i] < mn ? ar[i] : mn;
+        mx = ar[i] > mx ? ar[i] : mx;
+        sum += ar[i];
+    }
+    /* sum again without NaN, only for blocks having them */
+    if (sum != sum) {
+        sum = 0.;
+        for (i=0; i<n; i++) {
+            if (ar[i] != ar[i]) nnan++;
+            else sum += ar[i];
+        }
+    }
+    st->min = mn;
+    st->max = mx;
+    st->sum += sum;
+    st->nnan += nnan;
+}
+
+/*
+ *  set_stats:
+ *      set depmin, depmax and depmen of samples other than NaN and mark
+ *      them valid, or mark them not valid if all samples are NaN
+ */
+static void set_stats(SACHEAD *hd, const STATS *st)
+{
+    if (hd->npts <= 0) return;
+    if ((size_t)hd->npts <= st->nnan) {
+        if (hd->unused16 == SAC_STATS_VALID) hd->unused16 = SAC_INT_UNDEF;
+        return;
+    }
+    hd->depmin = st->min;
+    hd->depmax = st->max;
+    hd->depmen = (float)(st->sum / (hd->npts - st->nnan));
+    hd->unused16 = SAC_STATS_VALID;
+}
+
+/*
+ *  Packed data
+ *
+ *  Data section of a file with unused17 == SAC_DATA_PACKED, in 32-bit
+ *  words of the byte order of the file:
+ *
+ *      nblock, bsize               number of blocks, samples per block
+ *      off[nblock+1]               offset of each block in words from the
+ *                                  start of data section, off[nblock] is
+ *                                  the end of the last block
+ *      blocks
+ *
+ *  Each block starts with a word holding its mode in bits 0-7 and the
+ *  width of packed values in bits 8-15:
+ *
+ *      SAC_PACK_RAW    n floats follow.
+ *      SAC_PACK_DELTA  all samples are integers exactly representable by
+ *                      floats. The first sample follows as int, then the
+ *                      zigzag encoded differences of successive samples
+ *                      packed with width bits each, least significant bit
+ *                      first, in ((n-1)*width+31)/32 words plus one zero
+ *                      word so that decoding can always read two words.
+ *
+ *  Being all words, a packed file can be byte swapped as a whole.
+ */
+
+/*
+ *  pack_data:
+ *      pack npts samples, return packed data section and its size in
+ *      bytes, NULL if failed
+ */
+static uint32_t *pack_data(const float *ar, int npts, size_t *sz)
+{
+    uint32_t *buf;
+    int nblock, i, n;
+    size_t nw;
+
+    nblock = (npts + SAC_PACK_BLOCK - 1) / SAC_PACK_BLOCK;
+    /* at most one word more than raw data per block */
+    buf = (uint32_t *)malloc(((size_t)npts + 2*nblock + 3) * sizeof(uint32_t));
+    if (buf == NULL) return NULL;
+
+    buf[0] = nblock;
+    buf[1] = SAC_PACK_BLOCK;
+    nw = 2 + nblock + 1;
+    for (i=0; i<nblock; i++) {
+        n = npts - i*SAC_PACK_BLOCK;
+        if (n > SAC_PACK_BLOCK) n = SAC_PACK_BLOCK;
+        buf[2+i] = nw;
+        nw += pack_block(ar + (size_t)i*SAC_PACK_BLOCK, n, buf + nw);
+    }
+    buf[2+nblock] = nw;
+
+    *sz = nw * sizeof(uint32_t);
+    return buf;
+}
+
+/*
+ *  pack_block:
+ *      pack n samples into out, which has room for n+1 words
+ *
+ *  Return: number of words written
+ */
+static int pack_block(const float *x, int n, uint32_t *out)
+{
+    int32_t v[SAC_PACK_BLOCK];
+    uint32_t z, zmax = 0;
+    uint64_t acc = 0;
+    int i, k, nbit = 0;
+    int width, nw;
+    int isint = 1;
+
+    for (i=0; i<n; i++) {
+        float f;
+        if (!(x[i] >= -16777216.f && x[i] <= 16777216.f)) {
+            isint = 0;
+            break;
+        }
+        v[i] = (int32_t)x[i];
+        f = (float)v[i];
+        if (memcmp(&f, &x[i], sizeof(float)) != 0) {   /* also -0.0 */
+            isint = 0;
+            break;
+        }
+    }
+
+    if (isint) {
+        for (i=n-1; i>0; i--) {
+            int32_t d = v[i] - v[i-1];
+            z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+            if (z > zmax) zmax = z;
+        }
+        for (width=0; width<32 && (zmax >> width) != 0; width++)
+            ;
+        nw = 2 + (int)(((int64_t)(n-1)*width + 31) / 32) + 1;
+    }
+
+    if (!isint || nw > n) {
+        out[0] = SAC_PACK_RAW;
+        memcpy(out+1, x, n*sizeof(float));
+        return n + 1;
+    }
+
+    out[0] = SAC_PACK_DELTA | (width << 8);
+    out[1] = (uint32_t)v[0];
+    for (i=1, k=2; i<n; i++) {
+        int32_t d = v[i] - v[i-1];
+        z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+        acc |= (uint64_t)z << nbit;
+        nbit += width;
+        if (nbit >= 32) {
+            out[k++] = (uint32_t)acc;
+            acc >>= 32;
+            nbit -= 32;
+        }
+    }
+    if (nbit > 0) out[k++] = (uint32_t)acc;
+    out[k++] = 0;
+    return k;
+}
+
+/*
+ *  unpack_block:
+ *      decode n samples from block of nw words
+ *
+ *  Return: 0 if success, -1 if block is corrupted
+ */
+static int unpack_block(const uint32_t *blk, size_t nw, int n, float *out)
+{
+    int32_t d[SAC_PACK_BLOCK];
+    const uint32_t *p;
+    uint64_t mask, acc;
+    int32_t prev;
+    int width, nbit, i;
+
+    if (nw < 1) return -1;
+    width = (blk[0] >> 8) & 0xff;
+
+    switch (blk[0] & 0xff) {
+        case SAC_PACK_RAW:
+            if (nw < (size_t)n + 1) return -1;
+            memcpy(out, blk+1, n*sizeof(float));
+            return 0;
+        case SAC_PACK_DELTA:
+            if (width > 32 || nw < 2 + ((size_t)(n-1)*width + 31)/32 + 1)
+                return -1;
+            break;
+        default:
+            return -1;
+    }
+
+    /* unpack differences, refilling a 64-bit buffer by whole words */
+    p = blk + 2;
+    mask = ((uint64_t)1 << width) - 1;
+    acc = 0;
+    nbit = 0;
+    for (i=1; i<n; i++) {
+        uint32_t z;
+        if (nbit < width) {
+            acc |= (uint64_t)*p++ << nbit;
+            nbit += 32;
+        }
+        z = (uint32_t)(acc & mask);
+        acc >>= width;
+        nbit -= width;
+        d[i] = (int32_t)((z >> 1) ^ (0u - (z & 1)));
+    }
+
+    prev = (int32_t)blk[1];
+    out[0] = (float)prev;
+    i = 1;
+#if defined(__SSE2__)
+    /* prefix sums of four differences at a time */
+    {
+        __m128i acc = _mm_set1_epi32(prev);
+        for (; i+4<=n; i+=4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(d+i));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi32(v, acc);
+            _mm_storeu_ps(out+i, _mm_cvtepi32_ps(v));
+            acc = _mm_shuffle_epi32(v, 0xFF);
+        }
+        prev = _mm_cvtsi128_si32(acc);
+    }
+#endif
+    for (; i<n; i++) {
+        prev += d[i];
+        out[i] = (float)prev;
+    }
+    return 0;
+}
+
+/*
+ *  read_packed:
+ *      decode samples s0 to s1-1 of packed data section starting at the
+ *      current position of strm into out
+ *
+ *  Return: 0 if success, -1 if failed
+ */
+static int read_packed(const char *name, FILE *strm, int lswap,
+                       int npts, int s0, int s1, float *out)
+{
+    uint32_t info[2];
+    uint32_t *off = NULL;
+    uint32_t *buf = NULL;
+    long base;
+    int nblock, bsize, b0, b1, b;
+    size_t nw;
+    int error = 0;
+
+    if (s1 <= s0) return 0;
+
+    base = ftell(strm);
+    if (fread(info, sizeof(info), 1, strm) != 1) {
+        fprintf(stderr, "Error in reading SAC data %s\n", name);
+        return -1;
+    }
+    if (lswap == TRUE) byte_swap((char *)info, sizeof(info));
+    nblock = (int)info[0];
+    bsize = (int)info[1];
+    if (bsize <= 0 || bsize > SAC_PACK_BLOCK
+            || nblock != (npts + bsize - 1) / bsize) {
+        fprintf(stderr, "Error in packed SAC data %s\n", name);
         return -1;
     }
 
-    if (fwrite(&hd, SAC_HEADER_NUMBERS_SIZE, 1, strm) != 1) {
-        fprintf(stderr, "Error in writing SAC data for writing %s\n", name);
+    b0 = s0 / bsize;
+    b1 = (s1 - 1) / bsize;
+    if ((off = (uint32_t *)malloc((nblock+1)*sizeof(uint32_t))) == NULL
+            || fread(off, sizeof(uint32_t), nblock+1, strm) != (size_t)nblock+1) {
+        fprintf(stderr, "Error in reading SAC data %s\n", name);
+        free(off);
         return -1;
     }
+    if (lswap == TRUE) byte_swap((char *)off, (nblock+1)*sizeof(uint32_t));
+    if (off[b1+1] < off[b0]) {
+        fprintf(stderr, "Error in packed SAC data %s\n", name);
+        free(off);
+        return -1;
+    }
+
+    nw = off[b1+1] - off[b0];
+    if ((buf = (uint32_t *)malloc(nw*sizeof(uint32_t))) == NULL
+            || fseek(strm, base + (long)off[b0]*sizeof(uint32_t), SEEK_SET) != 0
+            || fread(buf, sizeof(uint32_t), nw, strm) != nw) {
+        fprintf(stderr, "Error in reading SAC data %s\n", name);
+        free(buf);
+        free(off);
+        return -1;
+    }
+    if (lswap == TRUE) byte_swap((char *)buf, nw*sizeof(uint32_t));
+
+    for (b=b0; b<=b1 && !error; b++) {
+        float tmp[SAC_PACK_BLOCK];
+        int first = b * bsize;
+        int n = (npts - first < bsize) ? npts - first : bsize;
+        int i0 = (s0 > first) ? s0 - first : 0;
+        int i1 = (s1 < first + n) ? s1 - first : n;
+        const uint32_t *blk = buf + (off[b] - off[b0]);
+        size_t bw = off[b+1] - off[b];
+
+        if (off[b+1] < off[b] || off[b+1] > off[b1+1]) {
+            error = -1;
+        } else if (i0 == 0 && i1 == n) {
+            error = unpack_block(blk, bw, n, out + (first - s0));
+        } else if ((error = unpack_block(blk, bw, n, tmp)) == 0) {
+            memcpy(out + (first + i0 - s0), tmp + i0, (i1 - i0)*sizeof(float));
+        }
+    }
+    if (error) fprintf(stderr, "Error in packed SAC data %s\n", name);
+
+    free(buf);
+    free(off);
+    return error;
+}
+
+/*
+ *  compare_member:
+ *      compare names of members of index ent, for qsort_r
+ */
+static int compare_member(const void *a, const void *b, void *ent)
+{
+    const SACBENTRY *e = (const SACBENTRY *)ent;
+
+    return strncmp(e[*(const int *)a].name, e[*(const int *)b].name,
+                   SAC_BUNDLE_NAME_LENGTH);
+}
 
-    if ((buffer = (char *)malloc(SAC_HEADER_STRINGS_SIZE)) == NULL){
+/*
+ *  bundle_get:
+ *      open bundle of member name bundle.sacb:member from the cache of
+ *      bundles, which is refreshed when the file has changed
+ *
+ *  Return:
+ *      index of member with *b to be released by bundle_put,
+ *      -1 if failed, -2 if name is not a member of a bundle
+ */
+static int bundle_get(const char *name, SACBUNDLE **b)
+{
+    const char *sep = strstr(name, SAC_BUNDLE_EXT ":");
+    char *path;
+    struct stat st;
+    int i, slot = -1, idx;
+
+    if (sep == NULL) return -2;
+    sep += strlen(SAC_BUNDLE_EXT);
+    if ((path = strndup(name, sep - name)) == NULL) {
         fprintf(stderr, "Error in allocating memory %s\n", name);
         return -1;
     }
-    map_chdr_out((char *)(&hd)+SAC_HEADER_NUMBERS_SIZE, buffer);
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        free(path);
+        return -1;
+    }
 
-    if (fwrite(buffer, SAC_HEADER_STRINGS_SIZE, 1, strm) != 1) {
-        fprintf(stderr, "Error in writing SAC data for writing %s\n", name);
+    *b = NULL;
+    pthread_mutex_lock(&bcache_lock);
+    for (i=0; i<SAC_BUNDLE_CACHE; i++) {
+        if (bcache[i].b == NULL || strcmp(bcache[i].path, path) != 0) continue;
+        if (bcache[i].dev == st.st_dev && bcache[i].ino == st.st_ino
+                && bcache[i].size == st.st_size
+                && bcache[i].mtime == st.st_mtime) {
+            *b = bcache[i].b;
+            slot = i;
+        } else if (bcache[i].ref == 0) {    /* changed, drop it */
+            sac_bundle_close(bcache[i].b);
+            free(bcache[i].path);
+            bcache[i].b = NULL;
+        }
+        break;
+    }
+    if (*b == NULL && (*b = sac_bundle_open(path)) != NULL) {
+        /* cache it in an empty or least recently used slot */
+        for (i=0; i<SAC_BUNDLE_CACHE; i++) {
+            if (bcache[i].b == NULL) {
+                slot = i;
+                break;
+            }
+            if (bcache[i].ref == 0
+                    && (slot < 0 || bcache[i].used < bcache[slot].used))
+                slot = i;
+        }
+        if (slot >= 0) {
+            if (bcache[slot].b != NULL) {
+                sac_bundle_close(bcache[slot].b);
+                free(bcache[slot].path);
+            }
+            bcache[slot].path = path;
+            bcache[slot].b = *b;
+            bcache[slot].dev = st.st_dev;
+            bcache[slot].ino = st.st_ino;
+            bcache[slot].size = st.st_size;
+            bcache[slot].mtime = st.st_mtime;
+            bcache[slot].ref = 0;
+            path = NULL;
+        }
+    }
+    if (slot >= 0) {
+        bcache[slot].ref++;
+        bcache[slot].used = ++bcache_clock;
+    }
+    pthread_mutex_unlock(&bcache_lock);
+    free(path);
+
+    if (*b == NULL) return -1;
+    if ((idx = sac_bundle_find(*b, sep + 1)) < 0) {
+        fprintf(stderr, "Unable to open %s\n", name);
+        bundle_put(*b);
         return -1;
     }
-    free(buffer);
+    return idx;
+}
 
-    return 0;
+/*
+ *  bundle_put:
+ *      release bundle from bundle_get, closing it if it is not cached
+ */
+static void bundle_put(SACBUNDLE *b)
+{
+    int i;
+
+    pthread_mutex_lock(&bcache_lock);
+    for (i=0; i<SAC_BUNDLE_CACHE; i++) {
+        if (bcache[i].b == b) {
+            bcache[i].ref--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bcache_lock);
+    if (i == SAC_BUNDLE_CACHE) sac_bundle_close(b);
+}
+
+/*
+ *  pdw_close:
+ *      close file or release bundle opened by read_sac_pdw
+ */
+static void pdw_close(FILE *strm, SACBUNDLE *b)
+{
+    if (strm != NULL) fclose(strm);
+    if (b != NULL) bundle_put(b);
 }
@@ -357,26 +357,128 @@ typedef struct sac_head {
 /* Size of string headers on disk */
 #define SAC_HEADER_STRINGS_SIZE ( SAC_HEADER_STRINGS * SAC_HEADER_STRING_LENGTH_FILE )
 
+/* Size of SAC header on disk */
+#define SAC_HEADER_SIZE ( SAC_HEADER_NUMBERS_SIZE + SAC_HEADER_STRINGS_SIZE )
+
+/* Options of write_sac_opt */
+#define SAC_WRITE_ATOMIC    1   /* write to temporary file and rename */
+#define SAC_WRITE_SYNC      2   /* fsync before rename */
+#define SAC_WRITE_BATCH     4   /* defer sync and rename to sac_write_commit */
+#define SAC_WRITE_STATS     8   /* compute depmin, depmax and depmen */
+#define SAC_WRITE_PACK      16  /* pack data losslessly */
+/* Size of blocks of data written after computing their statistics */
+#define SAC_STATS_BLOCK     ( 256 << 10 )
+/* unused16 is set to SAC_STATS_VALID when depmin, depmax and depmen are
+ * computed from data by write_sac_opt with SAC_WRITE_STATS */
+#define SAC_STATS_VALID     0x53544154
+/* unused17 is set to SAC_DATA_PACKED when data section is packed */
+#define SAC_DATA_PACKED     0x5041434B
+/* Number of samples per block of packed data */
+#define SAC_PACK_BLOCK      4096
+/* Modes of blocks of packed data */
+#define SAC_PACK_RAW        0   /* raw floats */
+#define SAC_PACK_DELTA      1   /* bit packed differences of integers */
+/* Number of files committed together in batch mode */
+#define SAC_WRITE_BATCH_MAX 4096
+
+/* Durability policy of SACWRITER */
+#define SAC_DURABLE_NONE    0   /* no sync */
+#define SAC_DURABLE_FSYNC   1   /* fsync and rename each file */
+#define SAC_DURABLE_SYNCFS  2   /* syncfs periodically and at flush */
+/* Number of files between two syncfs of SACWRITER */
+#define SAC_WRITER_SYNC_PERIOD 1024
+
+/* Size of blocks used while converting byte order of files */
+#define SAC_SWAP_BLOCK  ( 4 << 20 )
+
 /* SAC Header Version Number */
 #define SAC_HEADER_MAJOR_VERSION 6
 /* offset of nvhdr relative to struct SACHEAD */
 #define SAC_VERSION_LOCATION 76
 
+/* Size of a channel name NET.STA.LOC.CMP built by sac_channel_name */
+#define SAC_CHANNEL_NAME_LENGTH ( 4 * SAC_HEADER_STRING_LENGTH )
+
 /* offset of T0 relative to pointer to struct SACHEAD */
 #define TMARK   10
 
 /* offset of USER0 relative to pointer to struct SACHEAD */
 #define USERN   40
 
+/* asynchronous writer, see sac_writer_new */
+typedef struct sac_writer SACWRITER;
+
+/* Bundle of SAC records, see sac_bundle_open.
+ * A member is named by bundle.sacb:member in all read functions. */
+#define SAC_BUNDLE_EXT          ".sacb"
+#define SAC_BUNDLE_MAGIC        "SACBNDL1"
+/* Maximum length of member names, including the terminating '\0' */
+#define SAC_BUNDLE_NAME_LENGTH  64
+/* Number of bundles kept open for reading members by name */
+#define SAC_BUNDLE_CACHE        16
+
+/* entry of the index of a bundle, with a copy of key header fields */
+typedef struct sac_bundle_entry {
+    char        name[SAC_BUNDLE_NAME_LENGTH];   /* member name */
+    long long   offset;     /* offset of the SAC record in the bundle */
+    long long   length;     /* size of the SAC record */
+    float       delta, b, e;
+    float       stla, stlo, evla, evlo;
+    int         npts, iftype;
+    int         nzyear, nzjday, nzhour, nzmin, nzsec, nzmsec;
+    char        chan[SAC_CHANNEL_NAME_LENGTH];  /* NET.STA.LOC.CMP */
+} SACBENTRY;
+
+typedef struct sac_bundle SACBUNDLE;
+typedef struct sac_bundle_writer SACBWRITER;
+typedef struct sac_stream SACSTREAM;
+
 /* function prototype of basic SAC I/O */
 int read_sac_head(const char *name, SACHEAD *hd);
 float *read_sac(const char *name, SACHEAD *hd);
 int read_sac_xy(const char *name, SACHEAD *hd, float *xdata, float *ydata);
 float *read_sac_pdw(const char *name, SACHEAD *hd, int tmark, float t1, float t2);
+int sac_pdw_head(SACHEAD *hd, int tmark, float t1, float t2, int *nt1);
+int read_sac_samples(const char *name, int s0, int s1, float *out);
 int write_sac(const char *name, SACHEAD hd, const float *ar);
+int write_sac_opt(const char *name, SACHEAD hd, const float *ar, int flags);
+int sac_write_commit(void);
+SACWRITER *sac_writer_new(int nthread, int qsize, int durability);
+int sac_writer_submit(SACWRITER *w, const char *name, SACHEAD hd, float *ar);
+int sac_writer_flush(SACWRITER *w);
+int sac_writer_close(SACWRITER *w);
 int write_sac_xy(const char *name, SACHEAD hd, const float *xdata, const float *ydata);
+int write_sac_head(const char *name, SACHEAD hd);
+void sac_head_pack(SACHEAD hd, char *buff);
 SACHEAD new_sac_head(float dt, int ns, float b0);
 int sac_head_index(const char *name);
 int issac(const char *name);
+int sac_to_native(const char *name);
+void sac_channel_name(const SACHEAD *hd, char *name);
+SACBUNDLE *sac_bundle_open(const char *name);
+void sac_bundle_close(SACBUNDLE *b);
+int sac_bundle_count(const SACBUNDLE *b);
+const SACBENTRY *sac_bundle_entry(const SACBUNDLE *b, int i);
+int sac_bundle_find(const SACBUNDLE *b, const char *member);
+int sac_bundle_head(const SACBUNDLE *b, int i, SACHEAD *hd);
+const float *sac_bundle_data(const SACBUNDLE *b, int i);
+float *sac_bundle_read(const SACBUNDLE *b, int i, SACHEAD *hd);
+SACBWRITER *sac_bundle_create(const char *name);
+int sac_bundle_add(SACBWRITER *w, const char *member, SACHEAD hd, const float *ar);
+int sac_bundle_finish(SACBWRITER *w);
+int sac_expand_bundles(int n, char **names, char ***out);
+char **sac_read_list(const char *list, char **files, int *nfile);
+int sac_out_name(const char *file, const char *dir, const char *ext,
+                 char *out, int size);
+int sac_same_file(const char *a, const char *b);
+SACSTREAM *sac_stream_open(const char *name, SACHEAD *hd);
+int sac_stream_seek(SACSTREAM *s, int k);
+int sac_stream_read(SACSTREAM *s, float *buf, int n);
+SACSTREAM *sac_stream_create(const char *name, SACHEAD hd, int flags);
+int sac_stream_write(SACSTREAM *s, const float *buf, int n);
+int sac_stream_copy(SACSTREAM *s, SACSTREAM *in, int n);
+int sac_stream_reserve(SACSTREAM *s, int npts);
+int sac_stream_close(SACSTREAM *s);
+void sac_stream_cancel(SACSTREAM *s);
 
 #endif /* sacio.h */
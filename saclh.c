@@ -28,10 +28,12 @@ void usage()
     fprintf(stderr, "                                                       \n");
     fprintf(stderr, "Note:                                                  \n");
     fprintf(stderr, "  1. SAC head fields should be seperated by commas.    \n");
+    fprintf(stderr, "  2. sacfiles may be bundles or bundle.sacb:member.    \n");
     fprintf(stderr, "                                                       \n");
     fprintf(stderr, "Examples:                                              \n");
     fprintf(stderr, "  saclh -H evla,evlo,stla,stlo seis1 seis2             \n");
     fprintf(stderr, "  saclh -H evla -N seis                                \n");
+    fprintf(stderr, "  saclh -H kstnm,kcmpnm event.sacb                     \n");
 }
 
 int main(int argc, char *argv[])
@@ -76,11 +78,19 @@ int main(int argc, char *argv[])
 
     int j;
     SACHEAD hd;
+    char **files;
+    int nfile;
 
-    for (i=optind; i<argc; i++) {   /* loop over files */
-        if ((read_sac_head(argv[i], &hd)) != 0) continue;
+    /* whole bundles are replaced by their members */
+    if ((nfile = sac_expand_bundles(argc-optind, argv+optind, &files)) < 0) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+
+    for (i=0; i<nfile; i++) {   /* loop over files */
+        if ((read_sac_head(files[i], &hd)) != 0) continue;
 
-        if (noname==0) printf("%s ", argv[i]);
+        if (noname==0) printf("%s ", files[i]);
         for (j=0; j<cnt; j++) {
             if (head[j] < SAC_HEADER_FLOATS) {
                 float *pt = &hd.delta;
@@ -0,0 +1,196 @@
+/*******************************************************************************
+ *                                sacmatrix.c                                  *
+ *  Read many SAC files into one matrix on a common absolute time grid:       *
+ *      read_sac_matrix  read time window of files into a matrix               *
+ *      sac_matrix_free  free a matrix from read_sac_matrix                    *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sacio.h"
+#include "sacmatrix.h"
+#include "datetime.h"
+
+/* samples per tile while interleaving channels */
+#define TILE    64
+
+static float *alloc_matrix(size_t n);
+static void interleave(SACMATRIX *m, const float *rows, int stride);
+
+/*
+ *  read_sac_matrix
+ *
+ *  Description: read the time window t1 <= t < t2 of files into a matrix
+ *      with one channel per file, aligned on absolute time computed from
+ *      reference time and b of each file. Each file is placed at the
+ *      nearest sample of the grid, so that a file is shifted by at most
+ *      half a sample. Only the samples inside the window are read, and
+ *      files are read in parallel directly into their rows.
+ *
+ *      Files which can not be read, have no reference time or whose
+ *      delta differs from delta by more than half a sample over the
+ *      window are left empty with a warning. They are not resampled.
+ *
+ *  IN:
+ *      int     nfile   :   number of files
+ *      char  **files   :   names of files
+ *      double  t1      :   begin of window, seconds since 1970
+ *      double  t2      :   end of window, seconds since 1970
+ *      float   delta   :   sampling interval, 0 for that of the first
+ *                          file which can be read
+ *      int     layout  :   SAC_MATRIX_ROWS or SAC_MATRIX_INTERLEAVED
+ *
+ *  Return:
+ *      matrix to be freed by sac_matrix_free, NULL if failed
+ *
+ */
+SACMATRIX *read_sac_matrix(int nfile, char **files, double t1, double t2,
+                           float delta, int layout)
+{
+    SACMATRIX *m;
+    float *rows;
+    int stride;
+    int i;
+
+    if ((m = (SACMATRIX *)calloc(1, sizeof(SACMATRIX))) == NULL
+            || (m->hd = (SACHEAD *)calloc(nfile+1, sizeof(SACHEAD))) == NULL
+            || (m->i0 = (int *)calloc(nfile+1, sizeof(int))) == NULL
+            || (m->i1 = (int *)calloc(nfile+1, sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for matrix\n");
+        sac_matrix_free(m);
+        return NULL;
+    }
+    m->nchan = nfile;
+    m->layout = layout;
+    m->t0 = t1;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (i=0; i<nfile; i++) {
+        if (read_sac_head(files[i], &m->hd[i]) != 0) m->hd[i].npts = 0;
+    }
+
+    for (i=0; i<nfile && delta<=0.; i++)
+        if (m->hd[i].npts > 0) delta = m->hd[i].delta;
+    if (delta <= 0. || t2 <= t1) {
+        fprintf(stderr, "Empty window of matrix\n");
+        sac_matrix_free(m);
+        return NULL;
+    }
+    m->delta = delta;
+    m->npts = (int)((t2 - t1) / delta);
+
+    /* rows of 16 floats, i.e. SAC_MATRIX_ALIGN bytes */
+    stride = (m->npts + 15) / 16 * 16;
+    if ((rows = alloc_matrix((size_t)nfile * stride)) == NULL) {
+        fprintf(stderr, "Error in allocating memory for matrix\n");
+        sac_matrix_free(m);
+        return NULL;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (i=0; i<nfile; i++) {
+        SACHEAD *hd = &m->hd[i];
+        float *row = rows + (size_t)i * stride;
+        double tb, k;
+        int c0 = 0, c1 = 0;
+
+        if (hd->npts <= 0 || hd->iftype == IXY) {
+            hd->npts = 0;
+        } else if (hd->nzyear == SAC_INT_UNDEF) {
+            fprintf(stderr, "Warning: reference time undefined in %s\n", files[i]);
+            hd->npts = 0;
+        } else if (fabs(hd->delta - delta) * m->npts > 0.5 * delta) {
+            fprintf(stderr, "Warning: delta of %s differs from %g\n", files[i], delta);
+            hd->npts = 0;
+        } else {
+            tb = datetime2epoch(hd->nzyear, hd->nzjday, hd->nzhour,
+                                hd->nzmin, hd->nzsec, hd->nzmsec) + hd->b;
+            /* column of sample 0 of file, compared with the window before
+             * conversion, as files far out of it overflow int */
+            k = floor((tb - t1) / delta + 0.5);
+            if (k < m->npts && k + hd->npts > 0) {
+                c0 = (k > 0) ? (int)k : 0;
+                c1 = (k + hd->npts < m->npts) ? (int)k + hd->npts : m->npts;
+                if (read_sac_samples(files[i], c0 - (int)k, c1 - (int)k,
+                                     row + c0) != 0) {
+                    hd->npts = 0;
+                    c0 = c1 = 0;
+                }
+            }
+        }
+        /* zeros outside data, also first touch of the row */
+        memset(row, 0, (size_t)c0 * sizeof(float));
+        memset(row + c1, 0, (size_t)(stride - c1) * sizeof(float));
+        m->i0[i] = c0;
+        m->i1[i] = c1;
+    }
+
+    if (layout == SAC_MATRIX_INTERLEAVED) {
+        m->stride = (nfile + 15) / 16 * 16;
+        if ((m->data = alloc_matrix((size_t)m->npts * m->stride)) == NULL) {
+            fprintf(stderr, "Error in allocating memory for matrix\n");
+            free(rows);
+            sac_matrix_free(m);
+            return NULL;
+        }
+        interleave(m, rows, stride);
+        free(rows);
+    } else {
+        m->layout = SAC_MATRIX_ROWS;
+        m->stride = stride;
+        m->data = rows;
+    }
+    return m;
+}
+
+/*
+ *  sac_matrix_free: free a matrix from read_sac_matrix
+ */
+void sac_matrix_free(SACMATRIX *m)
+{
+    if (m == NULL) return;
+    free(m->data);
+    free(m->hd);
+    free(m->i0);
+    free(m->i1);
+    free(m);
+}
+
+/*
+ *  alloc_matrix: allocate n floats aligned to SAC_MATRIX_ALIGN
+ */
+static float *alloc_matrix(size_t n)
+{
+    void *p;
+
+    if (posix_memalign(&p, SAC_MATRIX_ALIGN, (n > 0 ? n : 1) * sizeof(float)) != 0)
+        return NULL;
+    return (float *)p;
+}
+
+/*
+ *  interleave:
+ *      transpose rows into m->data, in tiles of samples so that each
+ *      thread writes its own part of the matrix
+ */
+static void interleave(SACMATRIX *m, const float *rows, int stride)
+{
+    int j0;
+
+    #pragma omp parallel for schedule(static)
+    for (j0=0; j0<m->npts; j0+=TILE) {
+        int j1 = (j0 + TILE < m->npts) ? j0 + TILE : m->npts;
+        int ch, j;
+
+        for (ch=0; ch<m->nchan; ch++) {
+            const float *row = rows + (size_t)ch * stride;
+            for (j=j0; j<j1; j++)
+                m->data[(size_t)j * m->stride + ch] = row[j];
+        }
+        for (j=j0; j<j1; j++)
+            memset(m->data + (size_t)j * m->stride + m->nchan, 0,
+                   (size_t)(m->stride - m->nchan) * sizeof(float));
+    }
+}
@@ -0,0 +1,36 @@
+/*
+ *  sacmatrix.h
+ *
+ *  Read many SAC files into one matrix on a common absolute time grid.
+ *
+ */
+#ifndef _SACMATRIX_H
+#define _SACMATRIX_H
+
+#include "sacio.h"
+
+/* Layout of SACMATRIX */
+#define SAC_MATRIX_ROWS         0   /* data[ch*stride + j] */
+#define SAC_MATRIX_INTERLEAVED  1   /* data[j*stride + ch] */
+/* Alignment of matrix and rows in bytes */
+#define SAC_MATRIX_ALIGN        64
+
+typedef struct sac_matrix {
+    int     nchan;      /* number of files */
+    int     npts;       /* number of samples of each channel */
+    int     layout;     /* SAC_MATRIX_ROWS or SAC_MATRIX_INTERLEAVED */
+    int     stride;     /* floats between rows, or between samples of a
+                           channel if interleaved, multiple of 16 */
+    double  t0;         /* epoch time of sample 0 */
+    float   delta;      /* sampling interval */
+    float   *data;      /* SAC_MATRIX_ALIGN aligned, zero where not filled */
+    int     *i0;        /* samples i0[ch] to i1[ch]-1 of channel ch are */
+    int     *i1;        /*   filled with data, i0 == i1 if none */
+    SACHEAD *hd;        /* header of each file, npts 0 if not read */
+} SACMATRIX;
+
+SACMATRIX *read_sac_matrix(int nfile, char **files, double t1, double t2,
+                           float delta, int layout);
+void sac_matrix_free(SACMATRIX *m);
+
+#endif
@@ -30,17 +30,21 @@ void usage() {
     fprintf(stderr, "  -M4   return maximum peak-to-peak amplitude             \n");
     fprintf(stderr, "  -T    specify time window.                              \n");
     fprintf(stderr, "  -h    show usage.                                       \n");
+    fprintf(stderr, "                                                          \n");
+    fprintf(stderr, "  sacfiles may be bundles or bundle.sacb:member.          \n");
 }
 
 int main(int argc, char *argv[])
 {
     int c;
-    int mode;
+    int mode = 0;
     int error;
     int cut = 0;   /* cut a time window or not */
     int tmark;
     float t0, t1;
     int i;
+    char **files;
+    int nfile;
 
     error = 0;
     while ((c=getopt(argc, argv, "M:T:h")) != -1) {
@@ -70,18 +74,37 @@ int main(int argc, char *argv[])
         exit(-1);
     }
 
+    /* whole bundles are replaced by their members */
+    if ((nfile = sac_expand_bundles(argc-optind, argv+optind, &files)) < 0) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
 
-    for (i=optind; i<argc; i++) {  /* loop over files */
+    for (i=0; i<nfile; i++) {  /* loop over files */
         float *data;
         SACHEAD hd;
         int j;
+        float value = 0.;
+
+        /* depmin and depmax are enough if written with valid statistics */
+        if (!cut && read_sac_head(files[i], &hd) == 0
+                && hd.unused16 == SAC_STATS_VALID && hd.iftype != IXY) {
+            if (mode == 0)      value = hd.depmax;
+            else if (mode == 1) value = hd.depmin;
+            else if (mode == 2) value = fmax(fabs(hd.depmax), fabs(hd.depmin));
+            else if (mode == 3) value = (fabs(hd.depmin) > fabs(hd.depmax)) ?
+                                         hd.depmin : hd.depmax;
+            else                value = fabs(hd.depmax - hd.depmin);
+            printf("%s %g\n", files[i], value);
+            continue;
+        }
 
-        if (cut) data = read_sac_pdw(argv[i], &hd, tmark, t0, t1);
-        else     data = read_sac(argv[i], &hd);
+        if (cut) data = read_sac_pdw(files[i], &hd, tmark, t0, t1);
+        else     data = read_sac(files[i], &hd);
+        if (data == NULL) continue;
 
-        float value;
         if (mode == 0) {  /* maximum amplitude */
-            value = FLT_MIN;  /* initialization */
+            value = -FLT_MAX;  /* initialization */
             for (j=0; j<hd.npts; j++) {
                 if (data[j] > value)  value = data[j];
             }
@@ -101,7 +124,7 @@ int main(int argc, char *argv[])
                 if (fabs(data[j]) > fabs(value)) value = data[j];
             }
         } else if (mode == 4) { /* maximum peak-to-peak amplitude */
-            float value_pos = FLT_MIN;
+            float value_pos = -FLT_MAX;
             float value_neg = FLT_MAX;
             for (j=0; j<hd.npts; j++) {
                 if (data[j] > value_pos)  value_pos = data[j];
@@ -110,7 +133,8 @@ int main(int argc, char *argv[])
             value = fabs(value_pos - value_neg);
         }
 
-        printf("%s %g\n", argv[i], value);
+        printf("%s %g\n", files[i], value);
+        free(data);
     }
 
     return 0;
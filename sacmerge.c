@@ -0,0 +1,346 @@
+/*
+ *  Merge segments of SAC files of each channel into one SAC file
+ *
+ *  Segments are grouped by channel and ordered by their absolute start
+ *  times. The output of a channel is preallocated and written block by
+ *  block, each block filled by reading only the samples of segments in
+ *  it, so that memory is one block per channel being merged however long
+ *  the output is. Channels are merged in parallel.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include "sacio.h"
+#include "datetime.h"
+
+/* policies of gaps and overlaps */
+#define GAP_ZERO        0
+#define GAP_INTERP      1
+#define GAP_NAN         2
+#define OVERLAP_FIRST   0
+#define OVERLAP_LAST    1
+
+/* samples of a block of output */
+#define BLOCK   (1 << 20)
+
+/* segment to be merged */
+typedef struct {
+    int     ifile;
+    SACHEAD hd;
+    char    chan[SAC_CHANNEL_NAME_LENGTH];
+    double  tb;         /* epoch time of first sample */
+    long    idx;        /* sample of the output of the first sample */
+} ITEM;
+
+void usage(void);
+int compare_item(const void *a, const void *b);
+int merge(char **files, ITEM *item, int n);
+int sample_at(char **files, const ITEM *item, int n, long k, float *v);
+
+/* options */
+int gap = GAP_ZERO;
+int overlap = OVERLAP_FIRST;
+char *dir = ".";
+
+void usage()
+{
+    fprintf(stderr, "Merge segments of SAC files of each channel into one SAC   \n");
+    fprintf(stderr, "file                                                       \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacmerge [-Gzero|interp|nan] [-Ofirst|last] [-D dir]     \n");
+    fprintf(stderr, "           [-L filelist] [sacfiles]                        \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -G   fill gaps between segments by zeros, linear         \n");
+    fprintf(stderr, "       interpolation or NaN, default zero                  \n");
+    fprintf(stderr, "  -O   overlapped samples are taken from the earlier or    \n");
+    fprintf(stderr, "       the later segment, default first                    \n");
+    fprintf(stderr, "  -D   directory of output files, default is .             \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. channels are NET.STA.LOC.CMP of knetwk, kstnm, khole  \n");
+    fprintf(stderr, "     and kcmpnm, and the reference time must be set.       \n");
+    fprintf(stderr, "  2. segments are placed at the nearest sample of the      \n");
+    fprintf(stderr, "     first, and skipped if their delta differs.            \n");
+    fprintf(stderr, "  3. outputs are dir/NET.STA.LOC.CMP.YYYY.DDD.HHMMSS.SAC   \n");
+    fprintf(stderr, "     by the first sample, with the header of the first     \n");
+    fprintf(stderr, "     segment and the reference time at the first sample.   \n");
+    fprintf(stderr, "  4. a channel whose output would be one of its inputs is  \n");
+    fprintf(stderr, "     skipped; give another dir by -D.                      \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacmerge -D day IU.ANMO.00.BHZ.*.SAC                     \n");
+    fprintf(stderr, "  sacmerge -Ginterp -Olast -D day -L segments.lst          \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j;
+    int error = 0;
+    char *list = NULL;
+    char **files;
+    int nfile, nitem = 0, nchan = 0, nout = 0, nerr = 0;
+    ITEM *item;
+    int *chan;
+
+    while ((c=getopt(argc, argv, "G:O:D:L:h")) != -1) {
+        switch (c) {
+            case 'G':
+                if (strcmp(optarg, "zero") == 0)
+                    gap = GAP_ZERO;
+                else if (strcmp(optarg, "interp") == 0)
+                    gap = GAP_INTERP;
+                else if (strcmp(optarg, "nan") == 0)
+                    gap = GAP_NAN;
+                else
+                    error = 1;
+                break;
+            case 'O':
+                if (strcmp(optarg, "first") == 0)
+                    overlap = OVERLAP_FIRST;
+                else if (strcmp(optarg, "last") == 0)
+                    overlap = OVERLAP_LAST;
+                else
+                    error = 1;
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || error) {
+        usage();
+        exit(-1);
+    }
+
+    if ((item = (ITEM *)malloc(nfile * sizeof(ITEM))) == NULL
+            || (chan = (int *)malloc((nfile + 1) * sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (i=0; i<nfile; i++) {
+        ITEM *it = &item[i];
+        it->ifile = i;
+        if (read_sac_head(files[i], &it->hd) != 0) {
+            it->hd.npts = 0;
+        } else if (it->hd.iftype == IXY || it->hd.nzyear == SAC_INT_UNDEF) {
+            fprintf(stderr, "Warning: IXY or reference time undefined in %s\n", files[i]);
+            it->hd.npts = 0;
+        }
+        if (it->hd.npts <= 0) continue;
+        sac_channel_name(&it->hd, it->chan);
+        it->tb = datetime2epoch(it->hd.nzyear, it->hd.nzjday, it->hd.nzhour,
+                                it->hd.nzmin, it->hd.nzsec, it->hd.nzmsec) + it->hd.b;
+    }
+    for (i=0; i<nfile; i++) {
+        if (item[i].hd.npts > 0)
+            item[nitem++] = item[i];
+        else
+            nerr++;
+    }
+    qsort(item, nitem, sizeof(ITEM), compare_item);
+
+    /* items chan[j] to chan[j+1]-1 are of channel j */
+    for (i=0; i<nitem; i++)
+        if (i == 0 || strcmp(item[i].chan, item[i-1].chan) != 0) chan[nchan++] = i;
+    chan[nchan] = nitem;
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr, nout)
+    for (j=0; j<nchan; j++) {
+        if (merge(files, item + chan[j], chan[j+1] - chan[j]) != 0)
+            nerr++;
+        else
+            nout++;
+    }
+
+    printf("%d files merged into %d files\n", nitem, nout);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  merge: merge n segments of a channel sorted by time
+ */
+int merge(char **files, ITEM *item, int n)
+{
+    const float delta = item[0].hd.delta;
+    const double t0 = item[0].tb;
+    char out[PATH_MAX];
+    int year, jday, month, day, hour, minute, second, msec;
+    int i, j, m = 0, error = 0;
+    long total = 0, k0;
+    float *buf, prev = 0.f;
+    unsigned char *mask;
+    SACHEAD hd;
+    SACSTREAM *s;
+    double shift;
+
+    /* place segments, skipping those of another delta */
+    for (i=0; i<n; i++) {
+        ITEM *it = &item[i];
+        it->idx = lround((it->tb - t0) / delta);
+        if (fabs(it->hd.delta - delta) * (it->idx + it->hd.npts) > 0.5 * delta) {
+            fprintf(stderr, "Warning: delta of %s differs from %g, skipped\n",
+                    files[it->ifile], delta);
+            continue;
+        }
+        item[m++] = *it;
+        if (it->idx + it->hd.npts > total) total = it->idx + it->hd.npts;
+    }
+    n = m;
+    if (total > INT_MAX) {
+        fprintf(stderr, "Too many samples of %s\n", item[0].chan);
+        return -1;
+    }
+
+    /* header of the first segment, referenced to its first sample */
+    hd = item[0].hd;
+    epoch2datetime(t0, &year, &jday, &month, &day, &hour, &minute, &second, &msec);
+    shift = datetime2epoch(hd.nzyear, hd.nzjday, hd.nzhour, hd.nzmin, hd.nzsec, hd.nzmsec)
+          - datetime2epoch(year, jday, hour, minute, second, msec);
+    hd.nzyear = year;
+    hd.nzjday = jday;
+    hd.nzhour = hour;
+    hd.nzmin = minute;
+    hd.nzsec = second;
+    hd.nzmsec = msec;
+    hd.b += (float)shift;
+    /* o, a, t0-t9 and f */
+    for (j=TMARK-3; j<=TMARK+10; j++) {
+        float *v = (float *)&hd + j;
+        if (j != TMARK-1 && *v != SAC_FLOAT_UNDEF) *v += (float)shift;
+    }
+    if (snprintf(out, PATH_MAX, "%s/%s.%04d.%03d.%02d%02d%02d.SAC", dir, item[0].chan,
+                 year, jday, hour, minute, second) >= PATH_MAX) {
+        fprintf(stderr, "File name too long %s/%s\n", dir, item[0].chan);
+        return -1;
+    }
+    /* an output onto an input, e.g. its first segment, would replace it */
+    for (i=0; i<n; i++) {
+        if (sac_same_file(out, files[item[i].ifile])) {
+            fprintf(stderr, "Output %s is the input %s, skipped\n",
+                    out, files[item[i].ifile]);
+            return -1;
+        }
+    }
+
+    buf = (float *)malloc(BLOCK * sizeof(float));
+    mask = (unsigned char *)malloc(BLOCK);
+    if (buf == NULL || mask == NULL) {
+        fprintf(stderr, "Error in allocating memory for %s\n", out);
+        free(buf);
+        free(mask);
+        return -1;
+    }
+    if ((s = sac_stream_create(out, hd, SAC_WRITE_ATOMIC|SAC_WRITE_STATS)) == NULL) {
+        free(buf);
+        free(mask);
+        return -1;
+    }
+    sac_stream_reserve(s, (int)total);
+
+    for (k0=0; k0<total && error==0; k0+=BLOCK) {
+        const long k1 = (k0 + BLOCK < total) ? k0 + BLOCK : total;
+        const int nb = (int)(k1 - k0);
+        int g0, g1;
+
+        /* later segments overwrite earlier ones, in order of the policy */
+        memset(mask, 0, nb);
+        for (j=0; j<n && error==0; j++) {
+            const ITEM *it = &item[(overlap == OVERLAP_LAST) ? j : n - 1 - j];
+            long a = (it->idx > k0) ? it->idx : k0;
+            long b = (it->idx + it->hd.npts < k1) ? it->idx + it->hd.npts : k1;
+            if (a >= b) continue;
+            if (read_sac_samples(files[it->ifile], (int)(a - it->idx),
+                                 (int)(b - it->idx), buf + (a - k0)) != 0)
+                error = -1;
+            memset(mask + (a - k0), 1, b - a);
+        }
+
+        /* fill gaps */
+        for (g0=0; g0<nb && error==0; g0=g1) {
+            long ge = total;
+            float next = 0.f;
+            if (mask[g0]) {
+                g1 = g0 + 1;
+                continue;
+            }
+            for (g1=g0; g1<nb && !mask[g1]; g1++)
+                ;
+            if (gap == GAP_INTERP) {
+                /* gap ends at the first segment after its start */
+                for (j=0; j<n; j++)
+                    if (item[j].idx >= k0 + g0 && item[j].idx < ge) ge = item[j].idx;
+                if (sample_at(files, item, n, ge, &next) != 0) error = -1;
+                if (g0 > 0) prev = buf[g0-1];
+            }
+            for (i=g0; i<g1; i++) {
+                if (gap == GAP_INTERP)
+                    buf[i] = prev + (next - prev) * (float)(k0 + i - (k0 + g0) + 1)
+                           / (float)(ge - (k0 + g0) + 1);
+                else
+                    buf[i] = (gap == GAP_NAN) ? NAN : 0.f;
+            }
+        }
+        if (error == 0 && sac_stream_write(s, buf, nb) != 0) error = -1;
+        prev = buf[nb-1];
+    }
+
+    free(buf);
+    free(mask);
+    if (error) {
+        sac_stream_cancel(s);
+        return -1;
+    }
+    return sac_stream_close(s);
+}
+
+/*
+ *  sample_at: sample k of the output by the policy of overlaps
+ */
+int sample_at(char **files, const ITEM *item, int n, long k, float *v)
+{
+    int j;
+
+    for (j=0; j<n; j++) {
+        const ITEM *it = &item[(overlap == OVERLAP_LAST) ? n - 1 - j : j];
+        if (k >= it->idx && k < it->idx + it->hd.npts)
+            return read_sac_samples(files[it->ifile], (int)(k - it->idx),
+                                    (int)(k - it->idx + 1), v);
+    }
+    return -1;
+}
+
+/*
+ *  compare_item: order segments by channel, start time, then by name
+ */
+int compare_item(const void *a, const void *b)
+{
+    const ITEM *x = (const ITEM *)a;
+    const ITEM *y = (const ITEM *)b;
+    int c = strcmp(x->chan, y->chan);
+
+    if (c != 0) return c;
+    if (x->tb != y->tb) return (x->tb < y->tb) ? -1 : 1;
+    return x->ifile - y->ifile;
+}
@@ -0,0 +1,596 @@
+/*
+ *  Cross-correlate ambient noise of all station pairs and stack over days
+ *
+ *  Records are grouped by day and cut to the common time window of the
+ *  day. Each record is read once, normalized in time, cut into segments,
+ *  and the whitened spectra of its segments are kept in memory or in a
+ *  memory-mapped scratch file. Cross spectra of all pairs of the day are
+ *  then summed over segments in parallel tasks of blocks of stations and
+ *  bins, which keep the spectra and sums in cache. Sums are stacked over
+ *  days in the frequency domain, and each pair is transformed back once.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "sacio.h"
+#include "datetime.h"
+#include "fft.h"
+
+/* stations and bins of a task summing cross spectra */
+#define BLOCK   16
+#define BINS    256
+
+/* record of a station on a day */
+typedef struct {
+    char    chan[SAC_CHANNEL_NAME_LENGTH];
+    int     ifile;
+    int     ista;       /* index of the channel among all channels */
+    long    day;        /* day since 1970 of the middle of the record */
+    double  t0;         /* time of the first sample since 1970 */
+    SACHEAD hd;
+} REC;
+
+void usage(void);
+int compare_chan(const void *a, const void *b);
+int compare_day(const void *a, const void *b);
+int spectra(const char *file, double t0, int nseg, float *spec);
+int normalize(float *x, int n);
+void cross(const float *spec, const int *ista, int ns, int nseg);
+int write_pair(const REC *r1, const REC *r2, const float *s, int count);
+float *scratch_alloc(size_t n);
+void scratch_free(float *p, size_t n);
+
+/* options */
+double maxlag = 0.;         /* largest lag in seconds */
+double seglen = 3600.;      /* length of segments in seconds */
+double f1 = 0., f2 = 0.;    /* band of whitening */
+int onebit = 0;             /* one-bit normalization */
+double ramwin = 0.;         /* window of running absolute mean */
+char *scratch = NULL;       /* scratch file of spectra */
+char *dir = ".";
+
+/* derived from the first record */
+double delta;
+int nlen, nlag, nfft, k1, nbin, nsta;
+float *taper;
+const FFTPLAN *plan;
+
+/* cross spectra of pairs stacked over days, and segments stacked */
+float **acc;
+int *count;
+
+void usage()
+{
+    fprintf(stderr, "Cross-correlate ambient noise of all station pairs and     \n");
+    fprintf(stderr, "stack over days                                            \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacnoise -Tmaxlag [-Sseglen] [-Wf1/f2] [-N1|-Nwindow]    \n");
+    fprintf(stderr, "           [-Xscratch] [-D dir] [-L filelist] [sacfiles]   \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -T   largest lag of correlations in seconds              \n");
+    fprintf(stderr, "  -S   length of segments in seconds, default 3600         \n");
+    fprintf(stderr, "  -W   band of spectral whitening in Hz, default is all    \n");
+    fprintf(stderr, "       frequencies                                         \n");
+    fprintf(stderr, "  -N   temporal normalization, 1 for one-bit, or window in \n");
+    fprintf(stderr, "       seconds of running absolute mean, default is none   \n");
+    fprintf(stderr, "  -X   keep spectra of a day in a memory-mapped scratch    \n");
+    fprintf(stderr, "       file, which is removed after use                    \n");
+    fprintf(stderr, "  -D   directory of output files, default is .             \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. records are grouped by day of their middle and by     \n");
+    fprintf(stderr, "     channel NET.STA.LOC.CMP, and must have the same delta \n");
+    fprintf(stderr, "     and a defined reference time.                         \n");
+    fprintf(stderr, "  2. records of a day are cut to their common time window, \n");
+    fprintf(stderr, "     which is cut into segments of seglen.                 \n");
+    fprintf(stderr, "  3. whitening keeps the phase, with amplitude of 1 in the \n");
+    fprintf(stderr, "     band and cosine tapers over its outer tenths.         \n");
+    fprintf(stderr, "  4. correlations are written to dir/CHAN1_CHAN2.SAC with  \n");
+    fprintf(stderr, "     CHAN1 before CHAN2, positive lags for arrivals later  \n");
+    fprintf(stderr, "     at CHAN2, CHAN1 as the event, CHAN2 as the station,   \n");
+    fprintf(stderr, "     and number of stacked segments in user0.              \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacnoise -T300 -W0.01/0.5 -N1 -D ccf -L days.lst         \n");
+    fprintf(stderr, "  sacnoise -T100 -S1800 -N20 -Xscratch.bin 2023.*/*.LHZ    \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j, d0, d1;
+    int error = 0;
+    char *list = NULL;
+    char **files;
+    int nfile, nrec, nday = 0, npair, nout = 0, nerr = 0;
+    long long p;
+    REC *rec, *sta;
+    int *ok;
+
+    while ((c=getopt(argc, argv, "T:S:W:N:X:D:L:h")) != -1) {
+        switch (c) {
+            case 'T':
+                maxlag = atof(optarg);
+                break;
+            case 'S':
+                seglen = atof(optarg);
+                break;
+            case 'W':
+                if (sscanf(optarg, "%lf/%lf", &f1, &f2) != 2 || f1 < 0. || f2 <= f1)
+                    error = 1;
+                break;
+            case 'N':
+                if (strcmp(optarg, "1") == 0)
+                    onebit = 1;
+                else if ((ramwin = atof(optarg)) <= 0.)
+                    error = 1;
+                break;
+            case 'X':
+                scratch = optarg;
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || error || maxlag <= 0. || seglen <= 0.) {
+        usage();
+        exit(-1);
+    }
+
+    if ((rec = (REC *)malloc(nfile*sizeof(REC))) == NULL
+            || (ok = (int *)calloc(nfile, sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+
+    /* read headers, channel and day of records */
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+:nerr)
+    for (i=0; i<nfile; i++) {
+        rec[i].ifile = i;
+        if (read_sac_head(files[i], &rec[i].hd) != 0) {
+            nerr++;
+            continue;
+        }
+        if (rec[i].hd.nzyear == SAC_INT_UNDEF || rec[i].hd.npts <= 0) {
+            fprintf(stderr, "Skip %s without reference time or data\n", files[i]);
+            nerr++;
+            continue;
+        }
+        sac_channel_name(&rec[i].hd, rec[i].chan);
+        rec[i].t0 = datetime_ref(&rec[i].hd) + rec[i].hd.b;
+        rec[i].day = (long)floor((rec[i].t0
+                    + 0.5 * (rec[i].hd.npts - 1) * rec[i].hd.delta) / 86400.);
+        ok[i] = 1;
+    }
+    for (i=0, nrec=0; i<nfile; i++) {
+        if (!ok[i]) continue;
+        if (nrec > 0 && fabs(rec[i].hd.delta - rec[0].hd.delta) > 1e-4 * rec[0].hd.delta) {
+            fprintf(stderr, "Skip %s with delta %g of %g\n", files[i],
+                    rec[i].hd.delta, rec[0].hd.delta);
+            nerr++;
+            continue;
+        }
+        rec[nrec++] = rec[i];
+    }
+    if (nrec == 0) exit(-1);
+
+    /* index of channels, and one record of each for headers of outputs */
+    qsort(rec, nrec, sizeof(REC), compare_chan);
+    if ((sta = (REC *)malloc(nrec*sizeof(REC))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (i=0, nsta=0; i<nrec; i++) {
+        if (i == 0 || strcmp(rec[i].chan, rec[i-1].chan) != 0) nsta++;
+        rec[i].ista = nsta - 1;
+    }
+    for (i=0; i<nrec; i++) sta[rec[i].ista] = rec[i];
+    qsort(rec, nrec, sizeof(REC), compare_day);
+
+    /* segments, lags, and bins in the band */
+    delta = rec[0].hd.delta;
+    nlen = (int)lrint(seglen / delta);
+    nlag = (int)lrint(maxlag / delta);
+    if (nlen < 2 || nlag < 1 || (nfft = fft_size(nlen + nlag)) == 0
+            || (plan = fft_plan(nfft)) == NULL) {
+        fprintf(stderr, "Invalid segments of %g s or lags of %g s\n", seglen, maxlag);
+        exit(-1);
+    }
+    k1 = (f2 > 0.) ? (int)ceil(f1 * nfft * delta) : 1;
+    j = (f2 > 0.) ? (int)floor(f2 * nfft * delta) : nfft/2 - 1;
+    if (k1 < 1) k1 = 1;
+    if (j > nfft/2 - 1) j = nfft/2 - 1;
+    if ((nbin = j - k1 + 1) <= 0) {
+        fprintf(stderr, "No frequency in band %g/%g Hz\n", f1, f2);
+        exit(-1);
+    }
+    if ((taper = (float *)malloc(nbin * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (i=0; i<nbin; i++) {
+        int w = nbin / 10 + 1, e = (i < nbin - 1 - i) ? i : nbin - 1 - i;
+        taper[i] = (f2 > 0. && e < w) ? (float)(0.5 - 0.5 * cos(M_PI * (e + 1) / (w + 1))) : 1.f;
+    }
+
+    npair = nsta * (nsta - 1) / 2;
+    if (npair == 0) {
+        fprintf(stderr, "No pair of channels\n");
+        exit(-1);
+    }
+    if ((acc = (float **)calloc(npair, sizeof(float *))) == NULL
+            || (count = (int *)calloc(npair, sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (p=0; p<npair; p++) {
+        if ((acc[p] = (float *)calloc(2 * nbin, sizeof(float))) == NULL) {
+            fprintf(stderr, "Error in allocating memory for %d pairs\n", npair);
+            exit(-1);
+        }
+    }
+
+    /* days */
+    for (d0=0; d0<nrec; d0=d1) {
+        double tb, te;
+        int ns, nseg;
+        int *ista;
+        float *spec;
+        size_t size;
+
+        for (d1=d0+1; d1<nrec && rec[d1].day == rec[d0].day; d1++)
+            ;
+        /* one record of a channel a day */
+        for (i=d0+1, ns=d0+1; i<d1; i++) {
+            if (rec[i].ista == rec[ns-1].ista) {
+                fprintf(stderr, "Skip %s of channel of %s on the same day\n",
+                        files[rec[i].ifile], files[rec[ns-1].ifile]);
+                nerr++;
+                continue;
+            }
+            rec[ns++] = rec[i];
+        }
+        ns -= d0;
+        if (ns < 2) continue;
+
+        tb = rec[d0].t0;
+        te = rec[d0].t0 + (rec[d0].hd.npts - 1) * delta;
+        for (i=d0+1; i<d0+ns; i++) {
+            if (rec[i].t0 > tb) tb = rec[i].t0;
+            if (rec[i].t0 + (rec[i].hd.npts - 1) * delta < te)
+                te = rec[i].t0 + (rec[i].hd.npts - 1) * delta;
+        }
+        if ((nseg = (int)(floor((te - tb) / delta + 1e-3) + 1) / nlen) < 1) {
+            fprintf(stderr, "Skip day %ld without a common segment\n", rec[d0].day);
+            continue;
+        }
+
+        size = (size_t)ns * nseg * nbin * 2;
+        if ((ista = (int *)malloc(ns * sizeof(int))) == NULL
+                || (spec = scratch_alloc(size)) == NULL) {
+            fprintf(stderr, "Error in allocating memory for spectra\n");
+            exit(-1);
+        }
+
+        /* spectra of each record, read once */
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+        for (i=0; i<ns; i++) {
+            ista[i] = rec[d0+i].ista;
+            if (spectra(files[rec[d0+i].ifile], tb - rec[d0+i].t0, nseg,
+                        spec + (size_t)i * nseg * nbin * 2) != 0) {
+                memset(spec + (size_t)i * nseg * nbin * 2, 0,
+                       (size_t)nseg * nbin * 2 * sizeof(float));
+                nerr++;
+            }
+        }
+
+        cross(spec, ista, ns, nseg);
+        scratch_free(spec, size);
+        free(ista);
+        nday++;
+    }
+
+    /* pairs back to time domain */
+    #pragma omp parallel for schedule(dynamic, 16) private(j) reduction(+:nout,nerr)
+    for (i=0; i<nsta; i++) {
+        for (j=i+1; j<nsta; j++) {
+            long long q = (long long)i * nsta - (long long)i * (i + 1) / 2 + (j - i - 1);
+            if (count[q] == 0) continue;
+            if (write_pair(&sta[i], &sta[j], acc[q], count[q]) == 0)
+                nout++;
+            else
+                nerr++;
+        }
+    }
+
+    printf("%d pairs of %d channels stacked over %d days\n", nout, nsta, nday);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  spectra
+ *
+ *  Description: whitened spectra of nseg segments of a record, starting
+ *      at t0 seconds after its first sample, after removal of the mean
+ *      and temporal normalization. Two segments share each FFT as real
+ *      and imaginary parts.
+ *
+ *  Return: 0 if success, -1 if failed
+ *
+ */
+int spectra(const char *file, double t0, int nseg, float *spec)
+{
+    SACHEAD hd;
+    float *data, *x, *z;
+    int off, n = nseg * nlen;
+    int s, q, k;
+    double mean = 0.;
+
+    if ((data = read_sac(file, &hd)) == NULL) return -1;
+    off = (int)lrint(t0 / delta);
+    if (off < 0) off = 0;
+    if (off + n > hd.npts) {
+        fprintf(stderr, "Short record %s\n", file);
+        free(data);
+        return -1;
+    }
+    x = data + off;
+    for (k=0; k<n; k++) mean += x[k];
+    mean /= n;
+    for (k=0; k<n; k++) x[k] -= (float)mean;
+    if (normalize(x, n) != 0) {
+        free(data);
+        return -1;
+    }
+
+    if ((z = (float *)malloc(2 * nfft * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for %s\n", file);
+        free(data);
+        return -1;
+    }
+    for (s=0; s<nseg; s+=2) {
+        memset(z, 0, 2 * nfft * sizeof(float));
+        for (q=0; q<2 && s+q<nseg; q++)
+            for (k=0; k<nlen; k++) z[2*k+q] = x[(s+q)*nlen+k];
+        fft_forward(plan, z);
+        /* separate the two spectra by symmetry, and whiten them */
+        for (k=k1; k<k1+nbin; k++) {
+            int r = nfft - k;
+            float ar = 0.5f * (z[2*k] + z[2*r]);
+            float ai = 0.5f * (z[2*k+1] - z[2*r+1]);
+            float br = 0.5f * (z[2*k+1] + z[2*r+1]);
+            float bi = -0.5f * (z[2*k] - z[2*r]);
+            float *a = spec + ((size_t)s * nbin + (k - k1)) * 2;
+            float *b = a + nbin * 2;
+            float amp = sqrtf(ar * ar + ai * ai);
+            amp = (amp > 0.f) ? taper[k-k1] / amp : 0.f;
+            a[0] = ar * amp;
+            a[1] = ai * amp;
+            if (s + 1 < nseg) {
+                amp = sqrtf(br * br + bi * bi);
+                amp = (amp > 0.f) ? taper[k-k1] / amp : 0.f;
+                b[0] = br * amp;
+                b[1] = bi * amp;
+            }
+        }
+    }
+    free(z);
+    free(data);
+    return 0;
+}
+
+/*
+ *  normalize: one-bit or running absolute mean normalization of n samples
+ *
+ *  Return: 0 if success, -1 if failed
+ */
+int normalize(float *x, int n)
+{
+    float *w;
+    double sum = 0.;
+    int h = (int)lrint(0.5 * ramwin / delta);
+    int k;
+
+    if (onebit) {
+        for (k=0; k<n; k++) x[k] = (x[k] > 0.f) ? 1.f : ((x[k] < 0.f) ? -1.f : 0.f);
+        return 0;
+    }
+    if (ramwin <= 0.) return 0;
+
+    /* weights by running sums over 2h+1 samples, cut at the ends */
+    if ((w = (float *)malloc(n * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for normalization\n");
+        return -1;
+    }
+    for (k=0; k<h && k<n; k++) sum += fabs(x[k]);
+    for (k=0; k<n; k++) {
+        if (k + h < n) sum += fabs(x[k+h]);
+        if (k - h - 1 >= 0) sum -= fabs(x[k-h-1]);
+        w[k] = (float)(sum / ((k + h < n ? k + h : n - 1) - (k - h > 0 ? k - h : 0) + 1));
+    }
+    for (k=0; k<n; k++) x[k] = (w[k] > 0.f) ? x[k] / w[k] : 0.f;
+    free(w);
+    return 0;
+}
+
+/*
+ *  cross
+ *
+ *  Description: add conj(S1)*S2 of segments of a day to the sums of
+ *      pairs of its ns records. Blocks of BLOCK records and BINS bins are
+ *      summed by one task, so that the spectra of both blocks stay in
+ *      cache while each sum of a pair is added over all segments.
+ */
+void cross(const float *spec, const int *ista, int ns, int nseg)
+{
+    int nb = (ns + BLOCK - 1) / BLOCK;
+    int task;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (task=0; task<nb*nb; task++) {
+        int bi = task / nb, bj = task % nb;
+        int i, j, s, k, c0, nc;
+        if (bj < bi) continue;
+        for (c0=0; c0<nbin; c0+=BINS) {
+            nc = (nbin - c0 < BINS) ? nbin - c0 : BINS;
+            for (i=bi*BLOCK; i<(bi+1)*BLOCK && i<ns; i++) {
+                for (j=(bj == bi ? i + 1 : bj*BLOCK); j<(bj+1)*BLOCK && j<ns; j++) {
+                    long long q = (long long)ista[i] * nsta
+                        - (long long)ista[i] * (ista[i] + 1) / 2 + (ista[j] - ista[i] - 1);
+                    float *a = acc[q] + 2 * c0;
+                    for (s=0; s<nseg; s++) {
+                        const float *x = spec + (((size_t)i * nseg + s) * nbin + c0) * 2;
+                        const float *y = spec + (((size_t)j * nseg + s) * nbin + c0) * 2;
+                        #pragma omp simd
+                        for (k=0; k<nc; k++) {
+                            a[2*k]   += x[2*k] * y[2*k]   + x[2*k+1] * y[2*k+1];
+                            a[2*k+1] += x[2*k] * y[2*k+1] - x[2*k+1] * y[2*k];
+                        }
+                    }
+                    if (c0 == 0) count[q] += nseg;
+                }
+            }
+        }
+    }
+}
+
+/*
+ *  write_pair: correlation of a pair from its stacked cross spectrum
+ */
+int write_pair(const REC *r1, const REC *r2, const float *s, int count)
+{
+    char out[PATH_MAX];
+    SACHEAD hd;
+    float *z, *y;
+    int k, m;
+
+    if (snprintf(out, sizeof(out), "%s/%s_%s.SAC", dir, r1->chan, r2->chan)
+            >= (int)sizeof(out)) {
+        fprintf(stderr, "File name too long %s/%s_%s.SAC\n", dir, r1->chan, r2->chan);
+        return -1;
+    }
+    z = (float *)calloc(2 * nfft, sizeof(float));
+    y = (float *)malloc((2 * nlag + 1) * sizeof(float));
+    if (z == NULL || y == NULL) {
+        fprintf(stderr, "Error in allocating memory for %s\n", out);
+        free(z);
+        free(y);
+        return -1;
+    }
+    for (k=0; k<nbin; k++) {
+        int r = nfft - (k1 + k);
+        z[2*(k1+k)]   = s[2*k] / count;
+        z[2*(k1+k)+1] = s[2*k+1] / count;
+        z[2*r]   = z[2*(k1+k)];
+        z[2*r+1] = -z[2*(k1+k)+1];
+    }
+    fft_inverse(plan, z);
+    for (m=0; m<=2*nlag; m++)
+        y[m] = z[2*((m - nlag + nfft) % nfft)];
+
+    hd = new_sac_head((float)delta, 2 * nlag + 1, (float)(-nlag * delta));
+    hd.stla = r2->hd.stla;
+    hd.stlo = r2->hd.stlo;
+    hd.stel = r2->hd.stel;
+    hd.evla = r1->hd.stla;
+    hd.evlo = r1->hd.stlo;
+    hd.evel = r1->hd.stel;
+    memcpy(hd.knetwk, r2->hd.knetwk, sizeof(hd.knetwk));
+    memcpy(hd.kstnm, r2->hd.kstnm, sizeof(hd.kstnm));
+    memcpy(hd.khole, r2->hd.khole, sizeof(hd.khole));
+    memcpy(hd.kcmpnm, r2->hd.kcmpnm, sizeof(hd.kcmpnm));
+    snprintf(hd.kevnm, sizeof(hd.kevnm), "%.16s", r1->chan);
+    hd.user0 = (float)count;
+
+    k = write_sac(out, hd, y);
+    free(z);
+    free(y);
+    return k;
+}
+
+/*
+ *  scratch_alloc: n floats in memory, or mapped from the scratch file
+ */
+float *scratch_alloc(size_t n)
+{
+    void *p;
+    int fd;
+
+    if (scratch == NULL) return (float *)malloc(n * sizeof(float));
+
+    if ((fd = open(scratch, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        fprintf(stderr, "Unable to open scratch file %s\n", scratch);
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)(n * sizeof(float))) != 0
+            || (p = mmap(NULL, n * sizeof(float), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Unable to map scratch file %s\n", scratch);
+        close(fd);
+        unlink(scratch);
+        return NULL;
+    }
+    /* the mapping outlives the file */
+    close(fd);
+    unlink(scratch);
+    return (float *)p;
+}
+
+/*
+ *  scratch_free: free spectra from scratch_alloc
+ */
+void scratch_free(float *p, size_t n)
+{
+    if (scratch == NULL)
+        free(p);
+    else
+        munmap(p, n * sizeof(float));
+}
+
+/*
+ *  compare_chan: order records by channel, then by time
+ */
+int compare_chan(const void *a, const void *b)
+{
+    const REC *x = (const REC *)a;
+    const REC *y = (const REC *)b;
+    int c = strcmp(x->chan, y->chan);
+
+    if (c != 0) return c;
+    return (x->t0 > y->t0) - (x->t0 < y->t0);
+}
+
+/*
+ *  compare_day: order records by day, then by channel
+ */
+int compare_day(const void *a, const void *b)
+{
+    const REC *x = (const REC *)a;
+    const REC *y = (const REC *)b;
+
+    if (x->day != y->day) return (x->day > y->day) - (x->day < y->day);
+    return (x->ista > y->ista) - (x->ista < y->ista);
+}
@@ -0,0 +1,103 @@
+/*
+ *  Pack SAC files into a bundle
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sacio.h"
+
+void usage(void);
+
+void usage()
+{
+    fprintf(stderr, "Pack SAC files into a bundle                             \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Usage:                                                   \n");
+    fprintf(stderr, "  sacpack [-L filelist] bundle.sacb [sacfiles]           \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Options:                                                 \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line\n");
+    fprintf(stderr, "  -h   show usage.                                       \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Notes:                                                   \n");
+    fprintf(stderr, "  1. members are named by the file names without         \n");
+    fprintf(stderr, "     directory, which must be unique.                    \n");
+    fprintf(stderr, "  2. members of input bundles are copied, so bundles can \n");
+    fprintf(stderr, "     be merged.                                          \n");
+    fprintf(stderr, "  3. data are stored in native byte order, unpacked.     \n");
+    fprintf(stderr, "  4. members are read by bundle.sacb:member, and whole   \n");
+    fprintf(stderr, "     bundles are accepted by saclh and sacmax.           \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Examples:                                                \n");
+    fprintf(stderr, "  sacpack event.sacb 20100101/*.SAC                      \n");
+    fprintf(stderr, "  sacpack -L event.lst event.sacb                        \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i;
+    char *list = NULL;
+    char *bundle;
+    char **files;
+    int nfile;
+    SACBWRITER *w;
+    int nerr = 0;
+
+    while ((c=getopt(argc, argv, "L:h")) != -1) {
+        switch (c) {
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    if (argc - optind < 1) {
+        usage();
+        exit(-1);
+    }
+    bundle = argv[optind];
+    files = argv + optind + 1;
+    nfile = argc - optind - 1;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if ((nfile = sac_expand_bundles(nfile, files, &files)) <= 0) {
+        fprintf(stderr, "No SAC files to pack\n");
+        exit(-1);
+    }
+
+    if ((w = sac_bundle_create(bundle)) == NULL) exit(-1);
+    for (i=0; i<nfile; i++) {
+        SACHEAD hd;
+        float *data;
+        char *member;
+
+        /* name of member is what follows the bundle or the directory */
+        if ((member = strstr(files[i], SAC_BUNDLE_EXT ":")) != NULL)
+            member += strlen(SAC_BUNDLE_EXT ":");
+        else if ((member = strrchr(files[i], '/')) != NULL)
+            member++;
+        else
+            member = files[i];
+
+        if ((data = read_sac(files[i], &hd)) == NULL) {
+            nerr++;
+            continue;
+        }
+        if (sac_bundle_add(w, member, hd, data) != 0) nerr++;
+        free(data);
+    }
+    if (sac_bundle_finish(w) != 0) {
+        fprintf(stderr, "%s not written\n", bundle);
+        exit(-1);
+    }
+
+    printf("%d files packed into %s, %d failed\n", nfile - nerr, bundle, nerr);
+    return nerr ? -1 : 0;
+}
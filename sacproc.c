@@ -0,0 +1,102 @@
+/*
+ *  Preprocess SAC files by a pipeline of stages
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include "sacio.h"
+#include "pipeline.h"
+
+void usage(void);
+
+void usage()
+{
+    fprintf(stderr, "Preprocess SAC files by a pipeline of stages               \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacproc -Pstages [-D dir] [-L filelist] [sacfiles]       \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -P   stages separated by commas, run in order:           \n");
+    fprintf(stderr, "         rmean          remove mean                        \n");
+    fprintf(stderr, "         rtrend         remove linear trend                \n");
+    fprintf(stderr, "         taper[/width]  Hanning taper at both ends,        \n");
+    fprintf(stderr, "                        width 0.05 by default              \n");
+    fprintf(stderr, "         scale/value    multiply by value                  \n");
+    fprintf(stderr, "         int            integrate, trapezoidal rule        \n");
+    fprintf(stderr, "         diff           differentiate, backward difference \n");
+    fprintf(stderr, "  -D   directory of output files, default is to overwrite  \n");
+    fprintf(stderr, "       input files                                         \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. stages are run in as few passes over the data as      \n");
+    fprintf(stderr, "     possible, long files are streamed.                    \n");
+    fprintf(stderr, "  2. int and diff keep npts, with the first sample 0,      \n");
+    fprintf(stderr, "     and update idep.                                      \n");
+    fprintf(stderr, "  3. depmin, depmax and depmen are updated.                \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacproc -Prmean,rtrend,taper/0.05 seis*                  \n");
+    fprintf(stderr, "  sacproc -Prtrend,taper,scale/1e-9,int -D vel -L acc.lst  \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i;
+    char *list = NULL;
+    char *spec = NULL;
+    char *dir = NULL;
+    char **files;
+    int nfile;
+    int nerr = 0;
+    PIPELINE *p;
+
+    while ((c=getopt(argc, argv, "P:D:L:h")) != -1) {
+        switch (c) {
+            case 'P':
+                spec = optarg;
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || spec == NULL) {
+        usage();
+        exit(-1);
+    }
+    if ((p = pipeline_new(spec)) == NULL) exit(-1);
+
+    #pragma omp parallel for schedule(dynamic, 4) reduction(+:nerr)
+    for (i=0; i<nfile; i++) {
+        char out[PATH_MAX];
+
+        if (sac_out_name(files[i], dir, NULL, out, sizeof(out)) != 0) {
+            nerr++;
+            continue;
+        }
+        if (pipeline_file(p, files[i], out, SAC_WRITE_ATOMIC) != 0) nerr++;
+    }
+
+    printf("%d of %d files processed\n", nfile - nerr, nfile);
+    pipeline_free(p);
+    return nerr ? -1 : 0;
+}
@@ -0,0 +1,455 @@
+/*
+ *  Compute power spectral densities of SAC files by Welch's method
+ *
+ *  Files are cut into records, e.g. hours, and the PSD of each record is
+ *  averaged over overlapping windowed segments. PSDs of all records of a
+ *  group of files are computed in parallel, each record read alone, and
+ *  windows and FFT plans are shared by all files of the same delta.
+ *  Outputs are averaged PSDs or spectrograms of files, or histograms of
+ *  PSDs in dB of channels over all their files.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include "sacio.h"
+#include "datetime.h"
+#include "psd.h"
+
+/* outputs */
+#define MODE_PSD    0
+#define MODE_SPG    1
+#define MODE_PDF    2
+
+/* values of PSDs of a group of files computed together */
+#define GROUP_SIZE  (1 << 25)
+
+/* file to be processed */
+typedef struct {
+    int     ifile;
+    SACHEAD hd;
+    char    chan[SAC_CHANNEL_NAME_LENGTH];
+    int     ichan;      /* index of channel for histograms */
+    int     nlen;       /* samples of a record */
+    int     nrec;
+    int     nover;      /* samples of overlap of segments */
+    const PSDWINDOW *w;
+    float   *rows;      /* nrec PSDs */
+    int     error;
+} ITEM;
+
+/* histogram of a channel */
+typedef struct {
+    char    chan[SAC_CHANNEL_NAME_LENGTH];
+    int     nf;
+    double  df;
+    int     nrec;
+    int     *count;     /* ndb rows of nf */
+} HIST;
+
+void usage(void);
+int compare_chan(const void *a, const void *b);
+int write_psd(const char *name, int type, int nrow, int ncol, double y0,
+              double dy, double f0, double df, const float *data);
+int write_file(char **files, ITEM *item);
+void add_hist(HIST *h, const ITEM *item);
+
+/* options */
+double seglen = 0.;
+double overlap = 0.5;
+int wtype = PSD_HANN;
+double reclen = 0.;
+int mode = MODE_PSD;
+double dbmin = -200., dbmax = -50., dbstep = 1.;
+char *dir = ".";
+int ndb;
+
+void usage()
+{
+    fprintf(stderr, "Compute power spectral densities of SAC files by Welch's   \n");
+    fprintf(stderr, "method                                                     \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacpsd -Sseglen [-Ooverlap] [-Wwindow] [-Trecord]        \n");
+    fprintf(stderr, "         [-Mpsd|spg|pdf] [-Bdbmin/dbmax/dbstep] [-D dir]   \n");
+    fprintf(stderr, "         [-L filelist] [sacfiles]                          \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -S   length of segments in seconds                       \n");
+    fprintf(stderr, "  -O   overlap of segments as fraction, default 0.5        \n");
+    fprintf(stderr, "  -W   window of segments, hann, hamming or boxcar,        \n");
+    fprintf(stderr, "       default hann                                        \n");
+    fprintf(stderr, "  -T   length of records in seconds, default is the whole  \n");
+    fprintf(stderr, "       file                                                \n");
+    fprintf(stderr, "  -M   output, psd for PSD of each file averaged over its  \n");
+    fprintf(stderr, "       records, spg for spectrogram of PSDs of records of  \n");
+    fprintf(stderr, "       each file, pdf for histogram of PSDs of records of  \n");
+    fprintf(stderr, "       each channel in dB, default psd                     \n");
+    fprintf(stderr, "  -B   bins of histogram in dB, default -200/-50/1         \n");
+    fprintf(stderr, "  -D   directory of output files, default is .             \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. PSDs are one-sided in unit^2/Hz, segments are         \n");
+    fprintf(stderr, "     demeaned, windowed and zero padded to a power of 2.   \n");
+    fprintf(stderr, "  2. samples after the last whole record are not used.     \n");
+    fprintf(stderr, "  3. outputs are dir/file.psd, dir/file.spg or             \n");
+    fprintf(stderr, "     dir/NET.STA.LOC.CMP.pdf in native byte order:         \n");
+    fprintf(stderr, "       char[4] \"SPSD\", int type (0 psd, 1 spg, 2 pdf),     \n");
+    fprintf(stderr, "       int nrow, int ncol, double y0, dy, f0, df,          \n");
+    fprintf(stderr, "       float data[nrow][ncol]                              \n");
+    fprintf(stderr, "     with rows at y0+i*dy, and frequencies f0+j*df. Rows   \n");
+    fprintf(stderr, "     of spg are records at seconds since 1970, with PSDs   \n");
+    fprintf(stderr, "     in dB. Rows of pdf are centers of bins in dB, with    \n");
+    fprintf(stderr, "     fractions of records in each bin.                     \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacpsd -S100 2023.001.BHZ                                \n");
+    fprintf(stderr, "  sacpsd -S900 -O0.75 -T3600 -Mpdf -D qc -L year.lst       \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j, g0, g1;
+    int error = 0;
+    char *list = NULL;
+    char **files;
+    int nfile, nitem, nchan = 0, nerr = 0;
+    ITEM *item;
+    HIST *hist = NULL;
+
+    while ((c=getopt(argc, argv, "S:O:W:T:M:B:D:L:h")) != -1) {
+        switch (c) {
+            case 'S':
+                seglen = atof(optarg);
+                break;
+            case 'O':
+                overlap = atof(optarg);
+                break;
+            case 'W':
+                if (strcmp(optarg, "hann") == 0)
+                    wtype = PSD_HANN;
+                else if (strcmp(optarg, "hamming") == 0)
+                    wtype = PSD_HAMMING;
+                else if (strcmp(optarg, "boxcar") == 0)
+                    wtype = PSD_BOXCAR;
+                else
+                    error = 1;
+                break;
+            case 'T':
+                reclen = atof(optarg);
+                break;
+            case 'M':
+                if (strcmp(optarg, "psd") == 0)
+                    mode = MODE_PSD;
+                else if (strcmp(optarg, "spg") == 0)
+                    mode = MODE_SPG;
+                else if (strcmp(optarg, "pdf") == 0)
+                    mode = MODE_PDF;
+                else
+                    error = 1;
+                break;
+            case 'B':
+                if (sscanf(optarg, "%lf/%lf/%lf", &dbmin, &dbmax, &dbstep) != 3
+                        || dbstep <= 0. || dbmax <= dbmin)
+                    error = 1;
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || error || seglen <= 0. || overlap < 0. || overlap >= 1.
+            || reclen < 0.) {
+        usage();
+        exit(-1);
+    }
+    ndb = (int)ceil((dbmax - dbmin) / dbstep - 1e-9);
+
+    if ((item = (ITEM *)malloc(nfile*sizeof(ITEM))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+
+    /* headers, records and windows of files */
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+:nerr)
+    for (i=0; i<nfile; i++) {
+        SACHEAD *hd = &item[i].hd;
+        int nseg;
+        item[i].ifile = i;
+        item[i].nrec = 0;
+        item[i].rows = NULL;
+        item[i].error = 0;
+        if (read_sac_head(files[i], hd) != 0) {
+            nerr++;
+            continue;
+        }
+        if (hd->iftype == IXY) {
+            fprintf(stderr, "Warning: IXY file %s skipped\n", files[i]);
+            nerr++;
+            continue;
+        }
+        nseg = (int)lrint(seglen / hd->delta);
+        item[i].nlen = (reclen > 0.) ? (int)lrint(reclen / hd->delta) : hd->npts;
+        if (nseg < 2 || item[i].nlen < nseg || hd->npts < item[i].nlen) {
+            fprintf(stderr, "Skip %s shorter than a segment or record\n", files[i]);
+            nerr++;
+            continue;
+        }
+        if ((item[i].w = psd_window(wtype, nseg)) == NULL) {
+            nerr++;
+            continue;
+        }
+        item[i].nrec = hd->npts / item[i].nlen;
+        item[i].nover = (int)lrint(overlap * nseg);
+        if (item[i].nover >= nseg) item[i].nover = nseg - 1;
+        sac_channel_name(hd, item[i].chan);
+    }
+    for (i=0, nitem=0; i<nfile; i++)
+        if (item[i].nrec > 0) item[nitem++] = item[i];
+
+    /* channels of histograms */
+    if (mode == MODE_PDF && nitem > 0) {
+        qsort(item, nitem, sizeof(ITEM), compare_chan);
+        if ((hist = (HIST *)calloc(nitem, sizeof(HIST))) == NULL) {
+            fprintf(stderr, "Error in allocating memory\n");
+            exit(-1);
+        }
+        for (i=0; i<nitem; i++) {
+            int nf = psd_nfreq(item[i].w);
+            double df = 1. / ((nf - 1) * 2. * item[i].hd.delta);
+            if (nchan == 0 || strcmp(item[i].chan, hist[nchan-1].chan) != 0) {
+                strcpy(hist[nchan].chan, item[i].chan);
+                hist[nchan].nf = nf;
+                hist[nchan].df = df;
+                if ((hist[nchan].count = (int *)calloc((size_t)ndb * nf, sizeof(int))) == NULL) {
+                    fprintf(stderr, "Error in allocating memory\n");
+                    exit(-1);
+                }
+                nchan++;
+            } else if (nf != hist[nchan-1].nf || fabs(df - hist[nchan-1].df) > 1e-6 * df) {
+                fprintf(stderr, "Skip %s with frequencies differing from %s\n",
+                        files[item[i].ifile], hist[nchan-1].chan);
+                item[i].error = 1;
+                nerr++;
+            }
+            item[i].ichan = nchan - 1;
+        }
+    }
+
+    /* groups of files, with records of all files of a group in parallel */
+    for (g0=0; g0<nitem; g0=g1) {
+        size_t size = 0;
+        int ntask, t;
+        int *task;
+
+        for (g1=g0; g1<nitem && (g1 == g0 || size < GROUP_SIZE); g1++)
+            size += (size_t)item[g1].nrec * psd_nfreq(item[g1].w);
+        for (i=g0, ntask=0; i<g1; i++) ntask += item[i].nrec;
+        if ((task = (int *)malloc(2 * ntask * sizeof(int))) == NULL) {
+            fprintf(stderr, "Error in allocating memory\n");
+            exit(-1);
+        }
+        /* task is a record of a file */
+        for (i=g0, ntask=0; i<g1; i++) {
+            if (item[i].error) continue;
+            if ((item[i].rows = (float *)malloc((size_t)item[i].nrec
+                        * psd_nfreq(item[i].w) * sizeof(float))) == NULL) {
+                fprintf(stderr, "Error in allocating memory for %s\n", files[item[i].ifile]);
+                item[i].error = 1;
+                nerr++;
+                continue;
+            }
+            for (j=0; j<item[i].nrec; j++) {
+                task[2*ntask] = i;
+                task[2*ntask+1] = j;
+                ntask++;
+            }
+        }
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (t=0; t<ntask; t++) {
+            ITEM *it = item + task[2*t];
+            int r = task[2*t+1];
+            float *x;
+            if ((x = (float *)malloc(it->nlen * sizeof(float))) == NULL
+                    || read_sac_samples(files[it->ifile], r * it->nlen,
+                                        (r + 1) * it->nlen, x) != 0
+                    || psd_welch(it->w, x, it->nlen, it->nover, it->hd.delta,
+                                 it->rows + (size_t)r * psd_nfreq(it->w)) <= 0) {
+                #pragma omp atomic write
+                it->error = 1;
+            }
+            free(x);
+        }
+        free(task);
+
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+        for (i=g0; i<g1; i++) {
+            if (item[i].rows == NULL) continue;
+            if (item[i].error)
+                nerr++;
+            else if (mode != MODE_PDF && write_file(files, &item[i]) != 0)
+                nerr++;
+        }
+        /* channels are sorted, so files of a channel are added in turn */
+        if (mode == MODE_PDF) {
+            for (i=g0; i<g1; i++)
+                if (item[i].rows != NULL && !item[i].error)
+                    add_hist(&hist[item[i].ichan], &item[i]);
+        }
+        for (i=g0; i<g1; i++) {
+            free(item[i].rows);
+            item[i].rows = NULL;
+        }
+    }
+
+    /* histograms of channels */
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+    for (i=0; i<nchan; i++) {
+        char out[PATH_MAX];
+        float *f;
+        size_t k, n = (size_t)ndb * hist[i].nf;
+        if (hist[i].nrec == 0) continue;
+        if ((f = (float *)malloc(n * sizeof(float))) == NULL) {
+            fprintf(stderr, "Error in allocating memory\n");
+            nerr++;
+            continue;
+        }
+        for (k=0; k<n; k++) f[k] = (float)hist[i].count[k] / hist[i].nrec;
+        if (snprintf(out, sizeof(out), "%s/%s.pdf", dir, hist[i].chan) >= (int)sizeof(out)
+                || write_psd(out, MODE_PDF, ndb, hist[i].nf, dbmin + 0.5 * dbstep,
+                             dbstep, 0., hist[i].df, f) != 0)
+            nerr++;
+        free(f);
+        free(hist[i].count);
+    }
+
+    printf("%d of %d files processed\n", nfile - nerr, nfile);
+    free(hist);
+    free(item);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  write_file: averaged PSD or spectrogram of a file in dB
+ */
+int write_file(char **files, ITEM *item)
+{
+    char out[PATH_MAX];
+    int nf = psd_nfreq(item->w);
+    double t0 = datetime_ref(&item->hd) + item->hd.b;
+    double df = 1. / ((nf - 1) * 2. * item->hd.delta);
+    int r, k, nrow;
+
+    if (sac_out_name(files[item->ifile], dir, (mode == MODE_PSD) ? "psd" : "spg",
+                     out, sizeof(out)) != 0)
+        return -1;
+    if (mode == MODE_PSD) {
+        /* average of power of records, in place of the first */
+        for (r=1; r<item->nrec; r++)
+            for (k=0; k<nf; k++) item->rows[k] += item->rows[(size_t)r*nf+k];
+        for (k=0; k<nf; k++) item->rows[k] /= item->nrec;
+        nrow = 1;
+    } else {
+        nrow = item->nrec;
+    }
+    for (k=0; k<nrow*nf; k++)
+        item->rows[k] = (item->rows[k] > 0.f) ? 10.f * log10f(item->rows[k]) : -INFINITY;
+
+    return write_psd(out, mode, nrow, nf, t0,
+                     (mode == MODE_PSD) ? (double)item->nrec * item->nlen * item->hd.delta
+                                        : item->nlen * item->hd.delta,
+                     0., df, item->rows);
+}
+
+/*
+ *  add_hist: add PSDs of records of a file to the histogram of its channel
+ */
+void add_hist(HIST *h, const ITEM *item)
+{
+    int nf = h->nf;
+    int k;
+
+    #pragma omp parallel for schedule(static)
+    for (k=0; k<nf; k++) {
+        int r, b;
+        for (r=0; r<item->nrec; r++) {
+            float p = item->rows[(size_t)r*nf+k];
+            if (p <= 0.f) continue;
+            b = (int)floor((10. * log10(p) - dbmin) / dbstep);
+            if (b >= 0 && b < ndb) h->count[(size_t)b*nf+k]++;
+        }
+    }
+    h->nrec += item->nrec;
+}
+
+/*
+ *  write_psd: write PSDs in the binary format of sacpsd
+ */
+int write_psd(const char *name, int type, int nrow, int ncol, double y0,
+              double dy, double f0, double df, const float *data)
+{
+    FILE *fp;
+    int size[3];
+    double axis[4];
+
+    size[0] = type;
+    size[1] = nrow;
+    size[2] = ncol;
+    axis[0] = y0;
+    axis[1] = dy;
+    axis[2] = f0;
+    axis[3] = df;
+    if ((fp = fopen(name, "wb")) == NULL) {
+        fprintf(stderr, "Error in opening file for writing %s\n", name);
+        return -1;
+    }
+    if (fwrite("SPSD", 4, 1, fp) != 1
+            || fwrite(size, sizeof(size), 1, fp) != 1
+            || fwrite(axis, sizeof(axis), 1, fp) != 1
+            || fwrite(data, sizeof(float), (size_t)nrow * ncol, fp) != (size_t)nrow * ncol) {
+        fprintf(stderr, "Error in writing %s\n", name);
+        fclose(fp);
+        return -1;
+    }
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error in writing %s\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ *  compare_chan: order files by channel, then by time
+ */
+int compare_chan(const void *a, const void *b)
+{
+    const ITEM *x = (const ITEM *)a;
+    const ITEM *y = (const ITEM *)b;
+    double tx, ty;
+    int c = strcmp(x->chan, y->chan);
+
+    if (c != 0) return c;
+    tx = datetime_ref(&x->hd) + x->hd.b;
+    ty = datetime_ref(&y->hd) + y->hd.b;
+    if (tx != ty) return (tx > ty) - (tx < ty);
+    return (x->ifile > y->ifile) - (x->ifile < y->ifile);
+}
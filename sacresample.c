@@ -0,0 +1,106 @@
+/*
+ *  Resample SAC files to a given sampling interval
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include "sacio.h"
+#include "resample.h"
+
+void usage(void);
+
+void usage()
+{
+    fprintf(stderr, "Resample SAC files to a given sampling interval            \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacresample -Idelta [-D dir] [-L filelist] [sacfiles]    \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -I   new sampling interval                               \n");
+    fprintf(stderr, "  -D   directory of output files, default is to overwrite  \n");
+    fprintf(stderr, "       input files                                         \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. the ratio of new to old delta must be down/up with    \n");
+    fprintf(stderr, "     up no more than 1000, e.g. 0.025 to 0.01 is 2/5.      \n");
+    fprintf(stderr, "  2. data are low-pass filtered at 0.9 of the lower        \n");
+    fprintf(stderr, "     Nyquist frequency, integer decimation is filtering    \n");
+    fprintf(stderr, "     evaluated every down samples.                         \n");
+    fprintf(stderr, "  3. b is kept, delta, npts, e, depmin, depmax and depmen  \n");
+    fprintf(stderr, "     are updated.                                          \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacresample -I0.05 seis*                                 \n");
+    fprintf(stderr, "  sacresample -I0.01 -D 100hz -L day.lst                   \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i;
+    char *list = NULL;
+    char *dir = NULL;
+    char **files;
+    int nfile, nerr = 0;
+    double delta = 0.;
+
+    while ((c=getopt(argc, argv, "I:D:L:h")) != -1) {
+        switch (c) {
+            case 'I':
+                delta = atof(optarg);
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || delta <= 0.) {
+        usage();
+        exit(-1);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+    for (i=0; i<nfile; i++) {
+        char out[PATH_MAX];
+        const RESAMPLER *r;
+        SACHEAD hd;
+        int up, down;
+
+        if (sac_out_name(files[i], dir, NULL, out, sizeof(out)) != 0) {
+            nerr++;
+            continue;
+        }
+
+        if (read_sac_head(files[i], &hd) != 0
+                || resample_ratio(hd.delta, delta, &up, &down) != 0
+                || (r = resample_plan(up, down)) == NULL) {
+            nerr++;
+            continue;
+        }
+        /* nothing to do in place at the same delta */
+        if (up == down && dir == NULL) continue;
+        if (resample_file(r, files[i], out, SAC_WRITE_ATOMIC) != 0) nerr++;
+    }
+
+    printf("%d of %d files resampled\n", nfile - nerr, nfile);
+    return nerr ? -1 : 0;
+}
@@ -0,0 +1,156 @@
+/*
+ *  Remove instrument responses from SAC files by pole-zero files
+ *
+ *  Inverse responses are evaluated once for each pole-zero file and size
+ *  of FFT, and shared by all files of that response, so that thousands of
+ *  traces of a few dozen instruments cost a few dozen evaluations. Files
+ *  are processed in parallel.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "sacio.h"
+#include "pipeline.h"
+#include "response.h"
+
+void usage(void);
+
+void usage()
+{
+    fprintf(stderr, "Remove instrument responses from SAC files by pole-zero    \n");
+    fprintf(stderr, "files                                                      \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacresp -Ppzfile|pzdir -Ff1/f2/f3/f4 [-Tdisp|vel|acc]    \n");
+    fprintf(stderr, "          [-D dir] [-L filelist] [sacfiles]                \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -P   SAC pole-zero file of all files, or directory of    \n");
+    fprintf(stderr, "       pole-zero files named NET.STA.LOC.CMP.pz by knetwk, \n");
+    fprintf(stderr, "       kstnm, khole and kcmpnm of each file                \n");
+    fprintf(stderr, "  -F   frequencies of the cosine taper of the pre-filter   \n");
+    fprintf(stderr, "  -T   output displacement, velocity or acceleration,      \n");
+    fprintf(stderr, "       default disp                                        \n");
+    fprintf(stderr, "  -D   directory of output files, default is to overwrite  \n");
+    fprintf(stderr, "       input files                                         \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. pole-zero files give the response to displacement,    \n");
+    fprintf(stderr, "     and outputs are in their units, e.g. m, m/s or m/s^2. \n");
+    fprintf(stderr, "  2. trend is removed and 5%% of each end tapered before    \n");
+    fprintf(stderr, "     deconvolution.                                        \n");
+    fprintf(stderr, "  3. idep is set to IDISP, IVEL or IACC, and scale to 1.   \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacresp -PSAC_PZs_IU_ANMO_BHZ_00 -F0.005/0.01/8/10 *.BHZ \n");
+    fprintf(stderr, "  sacresp -Ppz -F0.01/0.02/4/5 -Tvel -D vel -L day.lst     \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i;
+    int error = 0;
+    char *list = NULL;
+    char *dir = NULL;
+    char *pz = NULL;
+    char **files;
+    int nfile, pzdir, nerr = 0;
+    int type = RESPONSE_DISP;
+    double freq[4] = {0., 0., 0., 0.};
+    struct stat st;
+    PIPELINE *p;
+
+    while ((c=getopt(argc, argv, "P:F:T:D:L:h")) != -1) {
+        switch (c) {
+            case 'P':
+                pz = optarg;
+                break;
+            case 'F':
+                if (sscanf(optarg, "%lf/%lf/%lf/%lf", &freq[0], &freq[1],
+                           &freq[2], &freq[3]) != 4 || freq[0] < 0.
+                        || freq[1] <= freq[0] || freq[2] < freq[1] || freq[3] <= freq[2])
+                    error = 1;
+                break;
+            case 'T':
+                if (strcmp(optarg, "disp") == 0)
+                    type = RESPONSE_DISP;
+                else if (strcmp(optarg, "vel") == 0)
+                    type = RESPONSE_VEL;
+                else if (strcmp(optarg, "acc") == 0)
+                    type = RESPONSE_ACC;
+                else
+                    error = 1;
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || error || pz == NULL || freq[3] <= 0.) {
+        usage();
+        exit(-1);
+    }
+    if (stat(pz, &st) != 0) {
+        fprintf(stderr, "Unable to find pole-zero file %s\n", pz);
+        exit(-1);
+    }
+    pzdir = S_ISDIR(st.st_mode);
+    if ((p = pipeline_new("rtrend,taper/0.05")) == NULL) exit(-1);
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+    for (i=0; i<nfile; i++) {
+        char out[PATH_MAX], name[PATH_MAX];
+        char chan[SAC_CHANNEL_NAME_LENGTH];
+        const RESPONSE *r;
+        SACHEAD hd;
+        float *data;
+
+        if (sac_out_name(files[i], dir, NULL, out, sizeof(out)) != 0
+                || (data = read_sac(files[i], &hd)) == NULL) {
+            nerr++;
+            continue;
+        }
+        if (pzdir) {
+            sac_channel_name(&hd, chan);
+            snprintf(name, sizeof(name), "%s/%s.pz", pz, chan);
+        }
+        if (hd.iftype == IXY) {
+            fprintf(stderr, "Warning: IXY file %s skipped\n", files[i]);
+            nerr++;
+        } else if (pipeline_run(p, &hd, data) != 0
+                || (r = response_get(pzdir ? name : pz, hd.npts, hd.delta,
+                                     type, freq)) == NULL
+                || response_remove(r, data, hd.npts) != 0) {
+            nerr++;
+        } else {
+            hd.idep = (type == RESPONSE_DISP) ? IDISP : (type == RESPONSE_VEL) ? IVEL : IACC;
+            hd.scale = 1.f;
+            if (write_sac_opt(out, hd, data, SAC_WRITE_ATOMIC|SAC_WRITE_STATS) != 0)
+                nerr++;
+        }
+        free(data);
+    }
+
+    printf("%d of %d files corrected\n", nfile - nerr, nfile);
+    pipeline_free(p);
+    return nerr ? -1 : 0;
+}
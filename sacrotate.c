@@ -0,0 +1,371 @@
+/*
+ *  Rotate horizontal components of SAC files to radial and transverse
+ *
+ *  Files are paired by directory, network, station, location and the
+ *  channel name without its last character. The two components of a
+ *  pair are cut to their common time window, aligned on the nearest
+ *  sample, and rotated chunk by chunk while being read, so records of
+ *  any length are rotated in bounded memory. Pairs are rotated in
+ *  parallel.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <limits.h>
+#include "sacio.h"
+#include "datetime.h"
+
+/* samples per chunk of a stream */
+#define CHUNK   65536
+
+/* component of a file to be paired */
+typedef struct {
+    char    *key;       /* directory and channel without orientation */
+    int     ifile;
+    SACHEAD hd;
+} COMP;
+
+void usage(void);
+int compare_key(const void *a, const void *b);
+int horizontal(const SACHEAD *hd);
+int out_name(const char *file, const char *cmp, char c, char *out);
+int rotate_pair(char **files, COMP *c1, COMP *c2);
+
+/* options */
+int fixed = 0;      /* rotate to a given azimuth instead of baz+180 */
+double azimuth;
+
+void usage()
+{
+    fprintf(stderr, "Rotate horizontal components of SAC files to radial and    \n");
+    fprintf(stderr, "transverse                                                 \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacrotate [-Aazimuth] [-L filelist] [sacfiles]           \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -A   rotate to a given azimuth instead of baz+180        \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. files in the same directory with the same knetwk,     \n");
+    fprintf(stderr, "     kstnm, khole and kcmpnm but its last character,       \n");
+    fprintf(stderr, "     e.g. BHN and BHE, are paired. Their cmpaz must be     \n");
+    fprintf(stderr, "     defined and differ by 90 degrees.                     \n");
+    fprintf(stderr, "  2. components are cut to their common time window.       \n");
+    fprintf(stderr, "  3. outputs are named by replacing kcmpnm in the file     \n");
+    fprintf(stderr, "     name by that of R and T, e.g. BHR and BHT, or by      \n");
+    fprintf(stderr, "     appending .R and .T, and cmpaz is updated.            \n");
+    fprintf(stderr, "  4. outputs of members of bundles are written to the      \n");
+    fprintf(stderr, "     directory of the bundle.                              \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacrotate 20100101/*.BH[NE].SAC                          \n");
+    fprintf(stderr, "  sacrotate -A0 -L horizontals.lst                         \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j;
+    int error = 0;
+    char *list = NULL;
+    char **files;
+    int nfile, ncomp, npair = 0, nrot = 0;
+    COMP *comp;
+    int *ok;
+
+    while ((c=getopt(argc, argv, "A:L:h")) != -1) {
+        switch (c) {
+            case 'A':
+                if (sscanf(optarg, "%lf", &azimuth) != 1) error = 1;
+                fixed = 1;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || error) {
+        usage();
+        exit(-1);
+    }
+
+    if ((comp = (COMP *)malloc(nfile*sizeof(COMP))) == NULL
+            || (ok = (int *)calloc(nfile, sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+
+    /* read headers, and key of horizontal components */
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (i=0; i<nfile; i++) {
+        const char *sep = strrchr(files[i], '/');
+        char chan[SAC_CHANNEL_NAME_LENGTH];
+        int n;
+
+        comp[i].ifile = i;
+        comp[i].key = NULL;
+        if (read_sac_head(files[i], &comp[i].hd) != 0
+                || !horizontal(&comp[i].hd)) continue;
+        n = (sep == NULL) ? 0 : (int)(sep - files[i]) + 1;
+        sac_channel_name(&comp[i].hd, chan);
+        chan[strlen(chan)-1] = '\0';    /* without orientation code */
+        if ((comp[i].key = (char *)malloc(n + strlen(chan) + 1)) == NULL)
+            continue;
+        memcpy(comp[i].key, files[i], n);
+        strcpy(comp[i].key + n, chan);
+        ok[i] = 1;
+    }
+    for (i=0, ncomp=0; i<nfile; i++)
+        if (ok[i]) comp[ncomp++] = comp[i];
+    qsort(comp, ncomp, sizeof(COMP), compare_key);
+
+    /* pairs of components, by index of the first of them */
+    for (i=0; i<ncomp; i=j) {
+        for (j=i+1; j<ncomp && strcmp(comp[j].key, comp[i].key) == 0; j++)
+            ;
+        if (j - i != 2) {
+            fprintf(stderr, "Warning: %d horizontal components for %s, skipped\n",
+                    j - i, comp[i].key);
+            continue;
+        }
+        ok[npair++] = i;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nrot)
+    for (i=0; i<npair; i++) {
+        int k = ok[i];
+        if (rotate_pair(files, &comp[k], &comp[k+1]) == 0) nrot++;
+    }
+
+    printf("%d of %d pairs rotated\n", nrot, npair);
+    for (i=0; i<ncomp; i++) free(comp[i].key);
+    free(comp);
+    free(ok);
+    return (nrot < npair) ? -1 : 0;
+}
+
+/*
+ *  rotate_pair
+ *
+ *  Description: rotate the common time window of two horizontal
+ *      components to R and T, streaming both files.
+ *
+ *  Return: 0 if success, -1 if failed
+ */
+int rotate_pair(char **files, COMP *c1, COMP *c2)
+{
+    char chan[SAC_CHANNEL_NAME_LENGTH], cmp[SAC_HEADER_STRING_LENGTH];
+    char name[2][PATH_MAX];
+    SACSTREAM *in[2] = {NULL, NULL}, *out[2] = {NULL, NULL};
+    SACHEAD hd[2], hr, ht;
+    COMP *tmp;
+    double d, t0[2], start, end, theta, cs, sn;
+    float delta, *x = NULL, *y = NULL;
+    int s[2], npts, n, k, j;
+    int error = 0;
+
+    /* the second component is 90 degrees clockwise from the first */
+    d = fmod(c2->hd.cmpaz - c1->hd.cmpaz + 720., 360.);
+    if (fabs(d - 270.) < 1.) {
+        tmp = c1;
+        c1 = c2;
+        c2 = tmp;
+    } else if (fabs(d - 90.) >= 1.) {
+        fprintf(stderr, "Warning: %s and %s not orthogonal, skipped\n",
+                files[c1->ifile], files[c2->ifile]);
+        return -1;
+    }
+    hd[0] = c1->hd;
+    hd[1] = c2->hd;
+    delta = hd[0].delta;
+    if (fabs(hd[1].delta - delta) > 1e-4 * delta) {
+        fprintf(stderr, "Warning: delta of %s and %s differ, skipped\n",
+                files[c1->ifile], files[c2->ifile]);
+        return -1;
+    }
+    if (fixed) {
+        theta = azimuth;
+    } else if (hd[0].baz != SAC_FLOAT_UNDEF) {
+        theta = hd[0].baz + 180.;
+    } else {
+        fprintf(stderr, "Warning: baz of %s undefined, skipped\n",
+                files[c1->ifile]);
+        return -1;
+    }
+
+    /* common time window, aligned on the nearest samples */
+    for (k=0; k<2; k++) t0[k] = datetime_ref(&hd[k]) + hd[k].b;
+    start = (t0[0] > t0[1]) ? t0[0] : t0[1];
+    end = t0[0] + (hd[0].npts - 1) * (double)delta;
+    d = t0[1] + (hd[1].npts - 1) * (double)delta;
+    if (d < end) end = d;
+    npts = (int)floor((end - start) / delta + 1e-3) + 1;
+    for (k=0; k<2; k++) {
+        s[k] = (int)floor((start - t0[k]) / delta + 0.5);
+        if (s[k] < 0) s[k] = 0;
+        if (npts > hd[k].npts - s[k]) npts = hd[k].npts - s[k];
+    }
+    if (npts <= 0) {
+        fprintf(stderr, "Warning: no common data of %s and %s, skipped\n",
+                files[c1->ifile], files[c2->ifile]);
+        return -1;
+    }
+
+    /* headers and names of R and T */
+    sac_channel_name(&hd[0], chan);
+    strcpy(cmp, strrchr(chan, '.') + 1);
+    hr = hd[0];
+    hr.b = hd[0].b + s[0] * delta;
+    hr.npts = npts;
+    hr.cmpinc = 90.;
+    hr.cmpaz = (float)fmod(fmod(theta, 360.) + 360., 360.);
+    ht = hr;
+    ht.cmpaz = (float)fmod(hr.cmpaz + 90., 360.);
+    n = (int)strlen(cmp);
+    if (n == 0) n = 1;
+    snprintf(hr.kcmpnm, sizeof(hr.kcmpnm), "%.*sR", n - 1, cmp);
+    snprintf(ht.kcmpnm, sizeof(ht.kcmpnm), "%.*sT", n - 1, cmp);
+    if (out_name(files[c1->ifile], cmp, 'R', name[0]) != 0
+            || out_name(files[c1->ifile], cmp, 'T', name[1]) != 0) {
+        fprintf(stderr, "Warning: file name %s too long, skipped\n",
+                files[c1->ifile]);
+        return -1;
+    }
+
+    theta = (theta - hd[0].cmpaz) * M_PI / 180.;
+    cs = cos(theta);
+    sn = sin(theta);
+
+    if ((x = (float *)malloc(2*CHUNK*sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        return -1;
+    }
+    y = x + CHUNK;
+    if ((in[0] = sac_stream_open(files[c1->ifile], &hd[0])) == NULL
+            || (in[1] = sac_stream_open(files[c2->ifile], &hd[1])) == NULL
+            || sac_stream_seek(in[0], s[0]) != 0
+            || sac_stream_seek(in[1], s[1]) != 0
+            || (out[0] = sac_stream_create(name[0], hr,
+                        SAC_WRITE_ATOMIC|SAC_WRITE_STATS)) == NULL
+            || (out[1] = sac_stream_create(name[1], ht,
+                        SAC_WRITE_ATOMIC|SAC_WRITE_STATS)) == NULL)
+        error = -1;
+
+    for (k=0; k<npts && !error; k+=n) {
+        n = (npts - k < CHUNK) ? npts - k : CHUNK;
+        if (sac_stream_read(in[0], x, n) != n
+                || sac_stream_read(in[1], y, n) != n) {
+            fprintf(stderr, "Error in reading %s or %s\n",
+                    files[c1->ifile], files[c2->ifile]);
+            error = -1;
+            break;
+        }
+        #pragma omp simd
+        for (j=0; j<n; j++) {
+            float r =  cs * x[j] + sn * y[j];
+            float t = -sn * x[j] + cs * y[j];
+            x[j] = r;
+            y[j] = t;
+        }
+        if (sac_stream_write(out[0], x, n) != 0
+                || sac_stream_write(out[1], y, n) != 0)
+            error = -1;
+    }
+
+    /* outputs of a failed rotation are discarded, keeping older files */
+    for (k=0; k<2; k++) {
+        sac_stream_close(in[k]);
+        if (error)
+            sac_stream_cancel(out[k]);
+        else if (sac_stream_close(out[k]) != 0)
+            error = -1;
+    }
+    free(x);
+    return error;
+}
+
+/*
+ *  horizontal: check if a header is of a horizontal component
+ */
+int horizontal(const SACHEAD *hd)
+{
+    char chan[SAC_CHANNEL_NAME_LENGTH];
+    size_t n;
+
+    if (hd->iftype == IXY || hd->cmpaz == SAC_FLOAT_UNDEF) return 0;
+    if (hd->cmpinc != SAC_FLOAT_UNDEF && fabs(hd->cmpinc - 90.) > 1.) return 0;
+    sac_channel_name(hd, chan);
+    n = strlen(chan);
+    if (n == 0 || chan[n-1] == '.' || chan[n-1] == 'Z') return 0;
+    return 1;
+}
+
+/*
+ *  out_name
+ *
+ *  Description: name of output of component c, file name with the last
+ *      cmp replaced by cmp with c as its last character, or with .c
+ *      appended. Members of bundles are written to the directory of the
+ *      bundle.
+ *
+ *  Return: 0 if success, -1 if the name is too long
+ */
+int out_name(const char *file, const char *cmp, char c, char *out)
+{
+    const char *base, *p, *q;
+    size_t nd, n = strlen(cmp);
+
+    if ((p = strstr(file, SAC_BUNDLE_EXT ":")) != NULL) {
+        for (q=p; q>file && q[-1] != '/'; q--)
+            ;
+        nd = (size_t)(q - file);
+        base = p + strlen(SAC_BUNDLE_EXT ":");
+    } else {
+        q = strrchr(file, '/');
+        nd = (q == NULL) ? 0 : (size_t)(q - file) + 1;
+        base = file + nd;
+    }
+    if (nd + strlen(base) + 3 > PATH_MAX) return -1;
+
+    memcpy(out, file, nd);
+    out += nd;
+    for (p=NULL, q=base; n>0 && (q=strstr(q, cmp)) != NULL; q++)
+        p = q;
+    if (p != NULL) {
+        memcpy(out, base, p - base);
+        memcpy(out + (p - base), cmp, n - 1);
+        out[p - base + n - 1] = c;
+        strcpy(out + (p - base) + n, p + n);
+    } else {
+        sprintf(out, "%s.%c", base, c);
+    }
+    return 0;
+}
+
+/*
+ *  compare_key: order components by key, then by file
+ */
+int compare_key(const void *a, const void *b)
+{
+    const COMP *x = (const COMP *)a;
+    const COMP *y = (const COMP *)b;
+    int k = strcmp(x->key, y->key);
+
+    if (k != 0) return k;
+    return (x->ifile > y->ifile) - (x->ifile < y->ifile);
+}
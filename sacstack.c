@@ -0,0 +1,290 @@
+/*
+ *  Stack SAC files aligned on a time mark
+ *
+ *  Files are split into chunks of consecutive files. Each chunk is summed
+ *  in order by one thread into its accumulators, which are folded into the
+ *  stack in the order of chunks as they finish, so that the stack does not
+ *  depend on the number of threads or their scheduling, and memory is one
+ *  set of accumulators per thread.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include "sacio.h"
+#include "fft.h"
+
+/* methods of stacking */
+#define LINEAR  0
+#define NROOT   1
+#define PWS     2
+
+/* minimum files per chunk, and maximum number of chunks */
+#define CHUNK_MIN   16
+#define CHUNK_MAX   256
+
+void usage(void);
+int stack_chunk(char **files, int nfile, int npts, double *sum);
+
+/* options */
+int tmark;
+float t1, t2;
+int method = LINEAR;
+double power = 2.;
+float delta;
+int ncomp;      /* number of accumulators per sample */
+
+void usage()
+{
+    fprintf(stderr, "Stack SAC files aligned on a time mark                     \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacstack -Ttmark/t1/t2 -O outfile [-Mmethod] [-Pvalue]   \n");
+    fprintf(stderr, "           [-L filelist] [sacfiles]                        \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -T   time window tmark+t1 to tmark+t2 of each file       \n");
+    fprintf(stderr, "  -O   output SAC file                                     \n");
+    fprintf(stderr, "  -M0  linear stack (default)                              \n");
+    fprintf(stderr, "  -M1  nth-root stack, n given by -P (default 2)           \n");
+    fprintf(stderr, "  -M2  phase-weighted stack, power of the phase coherence  \n");
+    fprintf(stderr, "       given by -P (default 2)                             \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. tmark: -5(b), -4(e), -3(o), -2(a), 0-9(Tn),           \n");
+    fprintf(stderr, "     others(t=0), the same as read_sac_pdw.                \n");
+    fprintf(stderr, "  2. data out of a file are taken as zeros.                \n");
+    fprintf(stderr, "  3. files whose delta differs from that of the first      \n");
+    fprintf(stderr, "     file, or whose window has another number of samples,  \n");
+    fprintf(stderr, "     are skipped.                                          \n");
+    fprintf(stderr, "  4. the header of the first file is kept, with b=t1 and   \n");
+    fprintf(stderr, "     user0 set to the number of stacked files.             \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacstack -T0/-10/60 -O stack.sac rf/*.SAC                \n");
+    fprintf(stderr, "  sacstack -T0/-10/60 -M2 -P2 -O pws.sac -L rf.lst         \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j;
+    int error = 0;
+    char *list = NULL;
+    char *out = NULL;
+    char **files;
+    int nfile, npts;
+    int nchunk, chunk;
+    double *total;
+    int nstack = 0;
+    float *stack;
+    SACHEAD hd;
+    int window = 0;
+
+    while ((c=getopt(argc, argv, "T:O:M:P:L:h")) != -1) {
+        switch (c) {
+            case 'T':
+                if (sscanf(optarg, "%d/%f/%f", &tmark, &t1, &t2) != 3) error = 1;
+                window = 1;
+                break;
+            case 'O':
+                out = optarg;
+                break;
+            case 'M':
+                method = atoi(optarg);
+                if (method < LINEAR || method > PWS) error = 1;
+                break;
+            case 'P':
+                power = atof(optarg);
+                if (power <= 0.) error = 1;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || !window || out == NULL || error) {
+        usage();
+        exit(-1);
+    }
+
+    /* sampling interval and length of window of the first file */
+    for (i=0; i<nfile && read_sac_head(files[i], &hd) != 0; i++)
+        ;
+    if (i == nfile) exit(-1);
+    delta = hd.delta;
+    npts = (int)((t2 - t1) / delta);
+    if (npts <= 0) {
+        fprintf(stderr, "Empty time window\n");
+        exit(-1);
+    }
+    if (method == PWS && npts < 2) {
+        fprintf(stderr, "Time window too short for phase-weighted stack\n");
+        exit(-1);
+    }
+    if (method == PWS && (npts > INT_MAX/2 || fft_size(2*npts) == 0)) {
+        fprintf(stderr, "Time window too long for phase-weighted stack\n");
+        exit(-1);
+    }
+
+    /* sum, and sum of phasors for PWS */
+    ncomp = (method == PWS) ? 3 : 1;
+    chunk = (nfile + CHUNK_MAX - 1) / CHUNK_MAX;
+    if (chunk < CHUNK_MIN) chunk = CHUNK_MIN;
+    nchunk = (nfile + chunk - 1) / chunk;
+    if ((total = (double *)calloc((size_t)ncomp*npts, sizeof(double))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+
+    #pragma omp parallel private(j)
+    {
+        double *acc = (double *)malloc((size_t)ncomp*npts*sizeof(double));
+
+        if (acc == NULL) {
+            #pragma omp atomic write
+            error = -1;
+        }
+        #pragma omp for ordered schedule(dynamic, 1)
+        for (c=0; c<nchunk; c++) {
+            int n = (c == nchunk - 1) ? nfile - c*chunk : chunk;
+            int k = (acc != NULL) ? stack_chunk(files + c*chunk, n, npts, acc) : 0;
+            /* fold chunks in order */
+            #pragma omp ordered
+            {
+                nstack += k;
+                if (k > 0)
+                    for (j=0; j<ncomp*npts; j++) total[j] += acc[j];
+            }
+        }
+        free(acc);
+    }
+    if (error) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    if (nstack == 0) {
+        fprintf(stderr, "No file stacked\n");
+        exit(-1);
+    }
+
+    if ((stack = (float *)malloc(npts*sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (j=0; j<npts; j++) {
+        double s = total[j] / nstack;
+        if (method == NROOT) {
+            s = copysign(pow(fabs(s), power), s);
+        } else if (method == PWS) {
+            double re = total[npts + j] / nstack;
+            double im = total[2*npts + j] / nstack;
+            s *= pow(sqrt(re*re + im*im), power);
+        }
+        stack[j] = (float)s;
+    }
+
+    /* header of the first file, aligned at t=0 */
+    read_sac_head(files[i], &hd);
+    if (tmark >= 0 && tmark <= 9)
+        *((float *)&hd + TMARK + tmark) = 0.;
+    else if (tmark == -3)
+        hd.o = 0.;
+    else if (tmark == -2)
+        hd.a = 0.;
+    hd.npts = npts;
+    hd.b = t1;
+    hd.e = t1 + (npts - 1) * delta;
+    hd.user0 = nstack;
+    if (write_sac(out, hd, stack) != 0) exit(-1);
+
+    printf("%d of %d files stacked\n", nstack, nfile);
+    free(stack);
+    free(total);
+    return 0;
+}
+
+/*
+ *  stack_chunk
+ *
+ *  Description: sum windows of nfile files in order into sum, which is
+ *      ncomp rows of npts: sum of data, and for PWS sum of real and
+ *      imaginary parts of unit phasors of the analytic signal.
+ *
+ *  Return: number of files stacked
+ */
+int stack_chunk(char **files, int nfile, int npts, double *sum)
+{
+    const FFTPLAN *plan = NULL;
+    float *z = NULL;
+    int i, j, n = 0;
+
+    memset(sum, 0, (size_t)ncomp*npts*sizeof(double));
+    if (method == PWS) {
+        /* padded to twice the window, so that the ends do not wrap around */
+        if ((plan = fft_plan(fft_size(2*npts))) == NULL
+                || (z = (float *)malloc(2*(size_t)fft_size(2*npts)*sizeof(float))) == NULL) {
+            fprintf(stderr, "Error in allocating memory\n");
+            return 0;
+        }
+    }
+
+    for (i=0; i<nfile; i++) {
+        SACHEAD hd;
+        float *data;
+
+        if ((data = read_sac_pdw(files[i], &hd, tmark, t1, t2)) == NULL)
+            continue;
+        if (fabs(hd.delta - delta) > 1e-4 * delta) {
+            fprintf(stderr, "Warning: delta of %s differs, skipped\n", files[i]);
+            free(data);
+            continue;
+        }
+        if (hd.npts != npts) {
+            fprintf(stderr, "Warning: window of %s has %d samples, not %d, skipped\n",
+                    files[i], hd.npts, npts);
+            free(data);
+            continue;
+        }
+
+        if (method == LINEAR) {
+            #pragma omp simd
+            for (j=0; j<npts; j++) sum[j] += data[j];
+        } else if (method == NROOT) {
+            double r = 1. / power;
+            for (j=0; j<npts; j++)
+                sum[j] += copysign(pow(fabs(data[j]), r), data[j]);
+        } else {
+            double *re = sum + npts;
+            double *im = sum + 2*npts;
+            fft_analytic(plan, data, npts, z);
+            for (j=0; j<npts; j++) {
+                float a = hypotf(z[2*j], z[2*j+1]);
+                sum[j] += data[j];
+                if (a > 0.f) {
+                    re[j] += z[2*j] / a;
+                    im[j] += z[2*j+1] / a;
+                }
+            }
+        }
+        free(data);
+        n++;
+    }
+
+    free(z);
+    return n;
+}
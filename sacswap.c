@@ -0,0 +1,75 @@
+/*
+ *  Convert SAC files to native byte order in place
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sacio.h"
+
+void usage(void);
+
+void usage()
+{
+    fprintf(stderr, "Convert SAC files to native byte order in place          \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Usage:                                                   \n");
+    fprintf(stderr, "  sacswap [-L filelist] [sacfiles]                       \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Options:                                                 \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line\n");
+    fprintf(stderr, "  -h   show usage.                                       \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Notes:                                                   \n");
+    fprintf(stderr, "  1. each file is converted into a temporary file which  \n");
+    fprintf(stderr, "     then replaces the original.                         \n");
+    fprintf(stderr, "  2. files already in native byte order are untouched.   \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Examples:                                                \n");
+    fprintf(stderr, "  sacswap seis*                                          \n");
+    fprintf(stderr, "  sacswap -L archive.lst                                 \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i;
+    char *list = NULL;
+    char **files;
+    int nfile;
+    int nconv = 0, nerr = 0;
+
+    while ((c=getopt(argc, argv, "L:h")) != -1) {
+        switch (c) {
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+
+    if (nfile == 0) {
+        usage();
+        exit(-1);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:nconv,nerr)
+    for (i=0; i<nfile; i++) {
+        int ret = sac_to_native(files[i]);
+        if (ret == TRUE) nconv++;
+        else if (ret == -1) nerr++;
+    }
+
+    printf("%d of %d files converted, %d already native, %d failed\n",
+           nconv, nfile, nfile - nconv - nerr, nerr);
+    return nerr ? -1 : 0;
+}
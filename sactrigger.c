@@ -0,0 +1,395 @@
+/*
+ *  Detect triggers in continuous SAC data by STA/LTA and coincidence
+ *
+ *  Files of the same delta and npts are streamed LANES at a time, with
+ *  their samples interleaved so that the recursive STA/LTA of all of them
+ *  runs in one vectorized loop, and batches run in parallel. Triggers of
+ *  all files are then sorted by time and merged across stations.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include "sacio.h"
+#include "datetime.h"
+
+/* channels processed together, and samples per chunk of each */
+#define LANES   8
+#define CHUNK   65536
+
+/* file to be scanned */
+typedef struct {
+    int     ifile;
+    float   delta;
+    int     npts;
+    char    sta[SAC_CHANNEL_NAME_LENGTH];   /* NET.STA */
+} ITEM;
+
+/* trigger of a file, in seconds since 1970 */
+typedef struct {
+    double  on, off;
+    float   peak;       /* largest STA/LTA of the trigger */
+    const ITEM *item;
+} TRIG;
+
+void usage(void);
+int compare_item(const void *a, const void *b);
+int compare_trig(const void *a, const void *b);
+int trigger_batch(char **files, const ITEM *item, int n);
+int add_trig(double on, double off, float peak, const ITEM *item);
+
+/* options */
+double tsta = 0., tlta = 0.;
+double thon = 0., thoff = 0.;
+int nmin = 1;
+int header = 0;
+
+/* triggers of all files */
+TRIG *trig = NULL;
+int ntrig = 0, maxtrig = 0;
+
+void usage()
+{
+    fprintf(stderr, "Detect triggers in continuous SAC data by STA/LTA and      \n");
+    fprintf(stderr, "coincidence                                                \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sactrigger -Csta/lta -Ton/off [-Nnsta] [-H]              \n");
+    fprintf(stderr, "             [-L filelist] [sacfiles]                      \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -C   lengths of STA and LTA windows in seconds           \n");
+    fprintf(stderr, "  -T   STA/LTA to switch a trigger on and off              \n");
+    fprintf(stderr, "  -N   print coincidences of at least nsta stations        \n");
+    fprintf(stderr, "       instead of triggers                                 \n");
+    fprintf(stderr, "  -H   write on times of the first 10 triggers of each     \n");
+    fprintf(stderr, "       file into its t0 to t9                              \n");
+    fprintf(stderr, "  -L   read names of SAC files from filelist, one per line \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. STA and LTA are recursive averages of squared samples,\n");
+    fprintf(stderr, "     after removal of a recursive mean over the LTA        \n");
+    fprintf(stderr, "     window. Triggers start after the first LTA window of  \n");
+    fprintf(stderr, "     each file.                                            \n");
+    fprintf(stderr, "  2. each trigger is printed as                            \n");
+    fprintf(stderr, "       on off peak file                                    \n");
+    fprintf(stderr, "     with on and off in yyyy-mm-ddThh:mm:ss.mmm, sorted    \n");
+    fprintf(stderr, "     by on time.                                           \n");
+    fprintf(stderr, "  3. triggers overlapping in time are merged, and those of \n");
+    fprintf(stderr, "     at least nsta stations, by knetwk and kstnm, are      \n");
+    fprintf(stderr, "     printed as                                            \n");
+    fprintf(stderr, "       on off nsta stations                                \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sactrigger -C1/30 -T4/1.5 2023.001/*.BHZ                 \n");
+    fprintf(stderr, "  sactrigger -C0.5/10 -T3.5/1 -N4 -L month.lst             \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j, k;
+    char *list = NULL;
+    char **files;
+    int nfile, nitem, nbatch, nerr = 0;
+    int error = 0;
+    ITEM *item;
+    int *batch;
+    char on[DATETIME_LENGTH], off[DATETIME_LENGTH];
+
+    while ((c=getopt(argc, argv, "C:T:N:HL:h")) != -1) {
+        switch (c) {
+            case 'C':
+                if (sscanf(optarg, "%lf/%lf", &tsta, &tlta) != 2) error = 1;
+                break;
+            case 'T':
+                if (sscanf(optarg, "%lf/%lf", &thon, &thoff) != 2) error = 1;
+                break;
+            case 'N':
+                nmin = atoi(optarg);
+                break;
+            case 'H':
+                header = 1;
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind;
+    nfile = argc - optind;
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0 || error || tsta <= 0. || tlta <= tsta || thon <= 0.
+            || thoff <= 0. || thoff > thon || nmin < 1) {
+        usage();
+        exit(-1);
+    }
+
+    if ((item = (ITEM *)malloc(nfile*sizeof(ITEM))) == NULL
+            || (batch = (int *)malloc((nfile+1)*sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+
+    /* headers, to batch files of the same delta and npts */
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+:nerr)
+    for (i=0; i<nfile; i++) {
+        SACHEAD hd;
+        char *p;
+        item[i].ifile = i;
+        item[i].npts = -1;
+        if (read_sac_head(files[i], &hd) != 0) {
+            nerr++;
+        } else if (hd.iftype == IXY) {
+            fprintf(stderr, "Warning: IXY file %s skipped\n", files[i]);
+            nerr++;
+        } else {
+            item[i].delta = hd.delta;
+            item[i].npts = hd.npts;
+            sac_channel_name(&hd, item[i].sta);
+            if ((p = strchr(item[i].sta, '.')) != NULL
+                    && (p = strchr(p + 1, '.')) != NULL) *p = '\0';
+        }
+    }
+    for (i=0, nitem=0; i<nfile; i++)
+        if (item[i].npts >= 0) item[nitem++] = item[i];
+    qsort(item, nitem, sizeof(ITEM), compare_item);
+
+    for (i=0, nbatch=0; i<nitem; i=j) {
+        for (j=i+1; j<nitem && j-i<LANES && item[j].delta == item[i].delta
+                && item[j].npts == item[i].npts; j++)
+            ;
+        batch[nbatch++] = i;
+    }
+    batch[nbatch] = nitem;
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nerr)
+    for (i=0; i<nbatch; i++)
+        nerr += trigger_batch(files, item + batch[i], batch[i+1] - batch[i]);
+
+    /* sort-merge of triggers over time */
+    qsort(trig, ntrig, sizeof(TRIG), compare_trig);
+    for (i=0; i<ntrig; i=j) {
+        double end = trig[i].off;
+        int nsta = 0;
+
+        if (nmin == 1) {
+            datetime_format(trig[i].on, on);
+            datetime_format(trig[i].off, off);
+            printf("%s %s %6.2f %s\n", on, off, trig[i].peak,
+                   files[trig[i].item->ifile]);
+            j = i + 1;
+            continue;
+        }
+        for (j=i+1; j<ntrig && trig[j].on <= end; j++)
+            if (trig[j].off > end) end = trig[j].off;
+        for (k=i; k<j; k++) {
+            int m;
+            for (m=i; m<k && strcmp(trig[m].item->sta, trig[k].item->sta) != 0; m++)
+                ;
+            if (m == k) nsta++;
+        }
+        if (nsta < nmin) continue;
+        datetime_format(trig[i].on, on);
+        datetime_format(end, off);
+        printf("%s %s %d", on, off, nsta);
+        for (k=i; k<j; k++) {
+            int m;
+            for (m=i; m<k && strcmp(trig[m].item->sta, trig[k].item->sta) != 0; m++)
+                ;
+            if (m == k) printf(" %s", trig[k].item->sta);
+        }
+        printf("\n");
+    }
+
+    free(trig);
+    free(item);
+    free(batch);
+    return nerr ? -1 : 0;
+}
+
+/*
+ *  trigger_batch
+ *
+ *  Description: STA/LTA triggers of n files of the same delta and npts,
+ *      streamed chunk by chunk, and their on times written into t0 to t9
+ *      if required.
+ *
+ *  Return: number of files failed
+ *
+ */
+int trigger_batch(char **files, const ITEM *item, int n)
+{
+    SACSTREAM *s[LANES];
+    SACHEAD hd[LANES];
+    double t0[LANES], mean[LANES], sta[LANES], lta[LANES], ton[LANES];
+    float peak[LANES];
+    int on[LANES], nt[LANES];
+    float *buf, *x;
+    double csta, clta, delta = item[0].delta;
+    long long k0, warm;
+    int l, k, len, nerr = 0;
+
+    csta = 1. / (tsta / delta);
+    clta = 1. / (tlta / delta);
+    warm = (long long)ceil(tlta / delta);
+    if (csta > 1.) csta = 1.;
+    if (clta > 1.) clta = 1.;
+
+    buf = (float *)calloc((size_t)CHUNK * LANES, sizeof(float));
+    x = (float *)malloc(CHUNK * sizeof(float));
+    if (buf == NULL || x == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        free(buf);
+        free(x);
+        return n;
+    }
+    for (l=0; l<LANES; l++) {
+        s[l] = NULL;
+        t0[l] = mean[l] = sta[l] = lta[l] = ton[l] = 0.;
+        peak[l] = 0.f;
+        on[l] = nt[l] = 0;
+        if (l >= n) continue;
+        if ((s[l] = sac_stream_open(files[item[l].ifile], &hd[l])) == NULL) {
+            nerr++;
+            continue;
+        }
+        t0[l] = datetime_ref(&hd[l]) + hd[l].b;
+    }
+
+    for (k0=0; k0<item[0].npts; k0+=len) {
+        len = (item[0].npts - k0 < CHUNK) ? (int)(item[0].npts - k0) : CHUNK;
+        for (l=0; l<n; l++) {
+            if (s[l] == NULL) continue;
+            if (sac_stream_read(s[l], x, len) != len) {
+                fprintf(stderr, "Error in reading %s\n", files[item[l].ifile]);
+                sac_stream_close(s[l]);
+                s[l] = NULL;
+                nerr++;
+                memset(x, 0, len * sizeof(float));
+            }
+            if (k0 == 0) mean[l] = x[0];
+            for (k=0; k<len; k++) buf[(size_t)k*LANES+l] = x[k];
+        }
+
+        /* recursive mean, STA and LTA of all lanes, ratio in place */
+        for (k=0; k<len; k++) {
+            float *v = buf + (size_t)k * LANES;
+            #pragma omp simd
+            for (l=0; l<LANES; l++) {
+                double y = v[l] - mean[l];
+                mean[l] += clta * y;
+                sta[l] += csta * (y * y - sta[l]);
+                lta[l] += clta * (y * y - lta[l]);
+                v[l] = (lta[l] > 0.) ? (float)(sta[l] / lta[l]) : 0.f;
+            }
+        }
+
+        /* switch triggers on and off */
+        for (l=0; l<n; l++) {
+            if (s[l] == NULL) continue;
+            for (k=(k0 >= warm) ? 0 : (int)(warm - k0); k<len; k++) {
+                float r = buf[(size_t)k*LANES+l];
+                if (!on[l]) {
+                    if (r < thon) continue;
+                    on[l] = 1;
+                    ton[l] = t0[l] + (k0 + k) * delta;
+                    peak[l] = r;
+                } else {
+                    if (r > peak[l]) peak[l] = r;
+                    if (r >= thoff) continue;
+                    on[l] = 0;
+                    if (header && nt[l] < 10)
+                        *((float *)&hd[l] + TMARK + nt[l]) = (float)(ton[l] - t0[l] + hd[l].b);
+                    nt[l]++;
+                    if (add_trig(ton[l], t0[l] + (k0 + k) * delta, peak[l], item + l) != 0)
+                        nerr++;
+                }
+            }
+        }
+    }
+
+    for (l=0; l<n; l++) {
+        if (s[l] == NULL) continue;
+        sac_stream_close(s[l]);
+        /* trigger still on at the end of data */
+        if (on[l]) {
+            if (header && nt[l] < 10)
+                *((float *)&hd[l] + TMARK + nt[l]) = (float)(ton[l] - t0[l] + hd[l].b);
+            nt[l]++;
+            if (add_trig(ton[l], t0[l] + (item[l].npts - 1) * delta, peak[l], item + l) != 0)
+                nerr++;
+        }
+        if (header && nt[l] > 0 && write_sac_head(files[item[l].ifile], hd[l]) != 0)
+            nerr++;
+    }
+    free(buf);
+    free(x);
+    return nerr;
+}
+
+/*
+ *  add_trig: add a trigger to those of all files
+ */
+int add_trig(double on, double off, float peak, const ITEM *item)
+{
+    int error = 0;
+
+    #pragma omp critical (trig)
+    {
+        if (ntrig == maxtrig) {
+            TRIG *tmp;
+            maxtrig = maxtrig ? 2 * maxtrig : 1024;
+            if ((tmp = (TRIG *)realloc(trig, maxtrig * sizeof(TRIG))) == NULL) {
+                fprintf(stderr, "Error in allocating memory for triggers\n");
+                maxtrig = ntrig;
+                error = -1;
+            } else {
+                trig = tmp;
+            }
+        }
+        if (!error) {
+            trig[ntrig].on = on;
+            trig[ntrig].off = off;
+            trig[ntrig].peak = peak;
+            trig[ntrig].item = item;
+            ntrig++;
+        }
+    }
+    return error;
+}
+
+/*
+ *  compare_item: order files by delta, npts, then by name
+ */
+int compare_item(const void *a, const void *b)
+{
+    const ITEM *x = (const ITEM *)a;
+    const ITEM *y = (const ITEM *)b;
+
+    if (x->delta != y->delta) return (x->delta > y->delta) - (x->delta < y->delta);
+    if (x->npts != y->npts) return (x->npts > y->npts) - (x->npts < y->npts);
+    return (x->ifile > y->ifile) - (x->ifile < y->ifile);
+}
+
+/*
+ *  compare_trig: order triggers by on time, then by file
+ */
+int compare_trig(const void *a, const void *b)
+{
+    const TRIG *x = (const TRIG *)a;
+    const TRIG *y = (const TRIG *)b;
+
+    if (x->on != y->on) return (x->on > y->on) - (x->on < y->on);
+    return (x->item->ifile > y->item->ifile) - (x->item->ifile < y->item->ifile);
+}
@@ -0,0 +1,122 @@
+/*
+ *  Unpack members of a bundle into SAC files
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sacio.h"
+
+void usage(void);
+
+void usage()
+{
+    fprintf(stderr, "Unpack members of a bundle into SAC files                \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Usage:                                                   \n");
+    fprintf(stderr, "  sacunpack [-D dir] [-l] bundle.sacb [members]          \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Options:                                                 \n");
+    fprintf(stderr, "  -D   directory of output files, default is current one \n");
+    fprintf(stderr, "  -l   list members with channel, npts and delta only    \n");
+    fprintf(stderr, "  -h   show usage.                                       \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Notes:                                                   \n");
+    fprintf(stderr, "  1. all members are unpacked if none is given.          \n");
+    fprintf(stderr, "  2. output files are named by members.                  \n");
+    fprintf(stderr, "  3. members named with '/', . or .. are skipped.        \n");
+    fprintf(stderr, "                                                         \n");
+    fprintf(stderr, "Examples:                                                \n");
+    fprintf(stderr, "  sacunpack -D 20100101 event.sacb                       \n");
+    fprintf(stderr, "  sacunpack event.sacb IC.BJT.00.BHZ.SAC                 \n");
+    fprintf(stderr, "  sacunpack -l event.sacb                                \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i;
+    char *dir = ".";
+    int list = 0;
+    SACBUNDLE *b;
+    int *member;
+    int nmember;
+    int nerr = 0;
+
+    while ((c=getopt(argc, argv, "D:lh")) != -1) {
+        switch (c) {
+            case 'D':
+                dir = optarg;
+                break;
+            case 'l':
+                list = 1;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    if (argc - optind < 1) {
+        usage();
+        exit(-1);
+    }
+    if ((b = sac_bundle_open(argv[optind])) == NULL) exit(-1);
+
+    /* indices of members to be unpacked */
+    nmember = argc - optind - 1;
+    if (nmember == 0) nmember = sac_bundle_count(b);
+    if ((member = (int *)malloc((nmember+1)*sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    for (i=0; i<nmember; i++) {
+        if (argc - optind - 1 == 0) {
+            member[i] = i;
+        } else if ((member[i] = sac_bundle_find(b, argv[optind+1+i])) < 0) {
+            fprintf(stderr, "No member %s in %s\n", argv[optind+1+i], argv[optind]);
+            nerr++;
+        }
+    }
+
+    if (list) {
+        for (i=0; i<nmember; i++) {
+            const SACBENTRY *e = sac_bundle_entry(b, member[i]);
+            if (e == NULL) continue;
+            printf("%s %s %d %g\n", e->name, e->chan, e->npts, e->delta);
+        }
+        sac_bundle_close(b);
+        return nerr ? -1 : 0;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:nerr)
+    for (i=0; i<nmember; i++) {
+        SACHEAD hd;
+        const SACBENTRY *e;
+        char *name;
+
+        if ((e = sac_bundle_entry(b, member[i])) == NULL) continue;
+        /* a member must not name a file out of dir */
+        if (strchr(e->name, '/') != NULL || e->name[0] == '\0'
+                || strcmp(e->name, ".") == 0 || strcmp(e->name, "..") == 0) {
+            fprintf(stderr, "Invalid member name %s\n", e->name);
+            nerr++;
+            continue;
+        }
+        if ((name = (char *)malloc(strlen(dir) + strlen(e->name) + 2)) == NULL
+                || sac_bundle_head(b, member[i], &hd) != 0) {
+            free(name);
+            nerr++;
+            continue;
+        }
+        sprintf(name, "%s/%s", dir, e->name);
+        if (write_sac(name, hd, sac_bundle_data(b, member[i])) != 0) nerr++;
+        free(name);
+    }
+
+    sac_bundle_close(b);
+    free(member);
+    return nerr ? -1 : 0;
+}
@@ -0,0 +1,148 @@
+/*
+ *  Detect events in continuous SAC data by template matching
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "sacio.h"
+#include "datetime.h"
+#include "xcorr.h"
+
+void usage(void);
+
+void usage()
+{
+    fprintf(stderr, "Detect events in continuous SAC data by template matching \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Usage:                                                     \n");
+    fprintf(stderr, "  sacxcorr -Ttmark/t1/t2 -Cthreshold [-L templatelist]     \n");
+    fprintf(stderr, "           dayfile [templates]                             \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Options:                                                   \n");
+    fprintf(stderr, "  -T   window of templates, tmark+t1 to tmark+t2 of each   \n");
+    fprintf(stderr, "       template file                                       \n");
+    fprintf(stderr, "  -C   threshold of normalized cross-correlation           \n");
+    fprintf(stderr, "  -L   read names of template files from templatelist, one \n");
+    fprintf(stderr, "       per line                                            \n");
+    fprintf(stderr, "  -h   show usage.                                         \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Notes:                                                     \n");
+    fprintf(stderr, "  1. tmark: -5(b), -4(e), -3(o), -2(a), 0-9(Tn),           \n");
+    fprintf(stderr, "     others(t=0), the same as read_sac_pdw.                \n");
+    fprintf(stderr, "  2. templates must have the delta of dayfile.             \n");
+    fprintf(stderr, "  3. each detection is printed as                          \n");
+    fprintf(stderr, "       datetime cc template                                \n");
+    fprintf(stderr, "     with datetime of tmark of the template in dayfile,    \n");
+    fprintf(stderr, "     sorted by time. Detections of a template within a     \n");
+    fprintf(stderr, "     template length are merged into the largest one.      \n");
+    fprintf(stderr, "                                                           \n");
+    fprintf(stderr, "Examples:                                                  \n");
+    fprintf(stderr, "  sacxcorr -T1/-1/4 -C0.7 -L tmpl.lst 20230101.BHZ         \n");
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, j;
+    char *list = NULL;
+    char **files;
+    int nfile, ntemp, ndet, m, nerr = 0;
+    int tmark = 0;
+    float t1 = 0., t2 = 0., thresh = -2.;
+    float *data, **tmpl;
+    int *itemp, *npts;
+    SACHEAD hd;
+    XCTEMPLATES *t;
+    XCDETECT *det;
+    double t0;
+
+    while ((c=getopt(argc, argv, "T:C:L:h")) != -1) {
+        switch (c) {
+            case 'T':
+                if (sscanf(optarg, "%d/%f/%f", &tmark, &t1, &t2) != 3) {
+                    fprintf(stderr, "Invalid window %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'C':
+                thresh = atof(optarg);
+                break;
+            case 'L':
+                list = optarg;
+                break;
+            case 'h':
+                usage();
+                return -1;
+            default:
+                return -1;
+        }
+    }
+
+    files = argv + optind + 1;
+    nfile = argc - optind - 1;
+    if (nfile < 0 || t2 <= t1 || thresh < -1. || thresh > 1.) {
+        usage();
+        exit(-1);
+    }
+    if (list != NULL && (files = sac_read_list(list, files, &nfile)) == NULL)
+        exit(-1);
+    if (nfile == 0) {
+        usage();
+        exit(-1);
+    }
+
+    /* the day-file is read once */
+    if ((data = read_sac(argv[optind], &hd)) == NULL) exit(-1);
+
+    if ((tmpl = (float **)calloc(nfile, sizeof(float *))) == NULL
+            || (itemp = (int *)malloc(nfile * sizeof(int))) == NULL
+            || (npts = (int *)malloc(nfile * sizeof(int))) == NULL) {
+        fprintf(stderr, "Error in allocating memory\n");
+        exit(-1);
+    }
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:nerr)
+    for (i=0; i<nfile; i++) {
+        SACHEAD th;
+        if ((tmpl[i] = read_sac_pdw(files[i], &th, tmark, t1, t2)) == NULL) {
+            nerr++;
+            continue;
+        }
+        npts[i] = th.npts;
+        if (fabs(th.delta - hd.delta) > 1e-4 * hd.delta) {
+            fprintf(stderr, "Skip %s with delta %g of dayfile %g\n",
+                    files[i], th.delta, hd.delta);
+            free(tmpl[i]);
+            tmpl[i] = NULL;
+            nerr++;
+        }
+    }
+    /* templates differing by rounding of delta are cut to the shortest */
+    for (i=0, ntemp=0, m=0; i<nfile; i++) {
+        if (tmpl[i] == NULL) continue;
+        if (ntemp == 0 || npts[i] < m) m = npts[i];
+        tmpl[ntemp] = tmpl[i];
+        itemp[ntemp++] = i;
+    }
+
+    if ((t = xcorr_templates(ntemp, tmpl, m)) == NULL) exit(-1);
+    for (i=0; i<ntemp; i++) free(tmpl[i]);
+    free(tmpl);
+    free(npts);
+    if ((ndet = xcorr_scan(t, data, hd.npts, thresh, &det)) < 0) exit(-1);
+    xcorr_templates_free(t);
+
+    /* tmark of the template is -t1 after its first sample */
+    t0 = datetime_ref(&hd) + hd.b - t1;
+    for (j=0; j<ndet; j++) {
+        char s[DATETIME_LENGTH];
+        datetime_format(t0 + (double)det[j].lag * hd.delta, s);
+        printf("%s %6.3f %s\n", s, det[j].cc, files[itemp[det[j].itemp]]);
+    }
+
+    free(det);
+    free(itemp);
+    free(data);
+    return nerr ? -1 : 0;
+}
@@ -0,0 +1,303 @@
+/*******************************************************************************
+ *                                  xcorr.c                                    *
+ *  Normalized cross-correlation of templates with long data:                  *
+ *      xcorr_templates       transform a batch of templates of m samples      *
+ *      xcorr_templates_free  free transformed templates                       *
+ *      xcorr_scan            detections of templates in data above threshold  *
+ *                                                                             *
+ *  Data are cut into overlapping blocks of the FFT size, each giving          *
+ *  nfft-m+1 lags. A task transforms one block once and correlates it with a   *
+ *  group of templates, two templates per inverse FFT as real and imaginary    *
+ *  parts, and tasks of all blocks and groups run in parallel. Norms of the    *
+ *  data under the template at all lags come from running sums in O(n).        *
+ *                                                                             *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "xcorr.h"
+#include "fft.h"
+
+struct xcorr_templates {
+    int     ntemp, m;
+    int     nfft;
+    const FFTPLAN *plan;
+    float   *spec;      /* conj(T1) + i*conj(T2) of pairs, nfft complex each */
+};
+
+static int compare_detect(const void *a, const void *b);
+static int compare_lag   (const void *a, const void *b);
+
+/*
+ *  xcorr_templates
+ *
+ *  Description: transform ntemp templates of m samples, with mean removed
+ *      and normalized to unit norm
+ *
+ *  Return: transformed templates, NULL if failed
+ *
+ */
+XCTEMPLATES *xcorr_templates(int ntemp, float **tmpl, int m)
+{
+    XCTEMPLATES *t;
+    int npair = (ntemp + 1) / 2;
+    int i, j, k, error = 0;
+
+    if (ntemp <= 0 || m <= 1) {
+        fprintf(stderr, "No template to correlate\n");
+        return NULL;
+    }
+    if ((t = (XCTEMPLATES *)malloc(sizeof(XCTEMPLATES))) == NULL
+            || (t->nfft = fft_size(4 * m < 4096 ? 4096 : 4 * m)) == 0
+            || (t->plan = fft_plan(t->nfft)) == NULL
+            || (t->spec = (float *)malloc((size_t)npair * 2 * t->nfft * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for templates\n");
+        free(t);
+        return NULL;
+    }
+    t->ntemp = ntemp;
+    t->m = m;
+
+    #pragma omp parallel for schedule(dynamic, 4) private(j, k)
+    for (i=0; i<npair; i++) {
+        float *s = t->spec + (size_t)i * 2 * t->nfft;
+        float *z = (float *)malloc(2 * t->nfft * sizeof(float));
+        int q;
+
+        if (z == NULL) {
+            #pragma omp atomic write
+            error = -1;
+            continue;
+        }
+        /* pair packed as real and imaginary parts, spectra separated by
+         * symmetry: T1[k] = (Z[k] + conj Z[-k])/2, T2[k] = (Z[k] - conj Z[-k])/2i */
+        memset(s, 0, 2 * t->nfft * sizeof(float));
+        for (q=0; q<2 && 2*i+q<ntemp; q++) {
+            const float *x = tmpl[2*i+q];
+            double mean = 0., norm = 0.;
+            for (j=0; j<m; j++) mean += x[j];
+            mean /= m;
+            for (j=0; j<m; j++) norm += (x[j] - mean) * (x[j] - mean);
+            norm = (norm > 0.) ? 1. / sqrt(norm) : 0.;
+            for (j=0; j<m; j++) s[2*j+q] = (float)((x[j] - mean) * norm);
+        }
+        fft_forward(t->plan, s);
+        memcpy(z, s, 2 * t->nfft * sizeof(float));
+        for (k=0; k<t->nfft; k++) {
+            int r = (t->nfft - k) % t->nfft;
+            float ar = 0.5f * (z[2*k] + z[2*r]);        /* T1 */
+            float ai = 0.5f * (z[2*k+1] - z[2*r+1]);
+            float br = 0.5f * (z[2*k+1] + z[2*r+1]);    /* T2 */
+            float bi = -0.5f * (z[2*k] - z[2*r]);
+            /* conj(T1) + i*conj(T2) */
+            s[2*k]   = ar + bi;
+            s[2*k+1] = -ai + br;
+        }
+        free(z);
+    }
+    if (error) {
+        fprintf(stderr, "Error in allocating memory for templates\n");
+        xcorr_templates_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+/*
+ *  xcorr_templates_free: free transformed templates
+ */
+void xcorr_templates_free(XCTEMPLATES *t)
+{
+    if (t == NULL) return;
+    free(t->spec);
+    free(t);
+}
+
+/*
+ *  xcorr_scan
+ *
+ *  Description: normalized cross-correlation of templates with n samples
+ *      of data, and detections where it reaches thresh. Lags of a
+ *      template above thresh within m samples of each other are one
+ *      detection, at the lag of the largest cc.
+ *
+ *  IN:
+ *      const XCTEMPLATES *t    :   templates
+ *      const float       *x    :   data
+ *      int                n    :   samples of data
+ *      float              thresh:  threshold of cc
+ *  OUT:
+ *      XCDETECT         **det  :   detections sorted by lag and template,
+ *                                  to be freed by caller
+ *
+ *  Return: number of detections, -1 if failed
+ *
+ */
+int xcorr_scan(const XCTEMPLATES *t, const float *x, int n, float thresh,
+               XCDETECT **det)
+{
+    const int m = t->m, nfft = t->nfft, l = nfft - m + 1;
+    int nlag = n - m + 1;
+    int npair = (t->ntemp + 1) / 2;
+    int ngroup = (npair + XCORR_GROUP/2 - 1) / (XCORR_GROUP/2);
+    int nblock, ntask, task, i, k, last = 0, nd = 0, nmax = 0, error = 0;
+    float *rnorm;
+    XCDETECT *all = NULL;
+
+    *det = NULL;
+    if (nlag <= 0) return 0;
+    nblock = (nlag + l - 1) / l;
+    ntask = nblock * ngroup;
+
+    /* inverse norm of data under the template at each lag */
+    if ((rnorm = (float *)malloc(nlag * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error in allocating memory for correlation\n");
+        return -1;
+    }
+    {
+        double s1 = 0., s2 = 0., c = 0.;
+        for (k=0; k<m; k++) c += x[k];
+        c /= m;     /* offset for precision of running sums */
+        for (k=0; k<m; k++) {
+            s1 += x[k] - c;
+            s2 += (x[k] - c) * (x[k] - c);
+        }
+        for (k=0; k<nlag; k++) {
+            double v = s2 - s1 * s1 / m;
+            rnorm[k] = (v > 1e-12 * s2 && v > 0.) ? (float)(1. / sqrt(v)) : 0.f;
+            if (k + m < n) {
+                double a = x[k] - c, b = x[k+m] - c;
+                s1 += b - a;
+                s2 += b * b - a * a;
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) private(i, k)
+    for (task=0; task<ntask; task++) {
+        int b0 = (task / ngroup) * l;
+        int p0 = (task % ngroup) * (XCORR_GROUP/2);
+        int p1 = (p0 + XCORR_GROUP/2 < npair) ? p0 + XCORR_GROUP/2 : npair;
+        int nl = (nlag - b0 < l) ? nlag - b0 : l;
+        float *xf = (float *)malloc(2 * nfft * sizeof(float));
+        float *z = (float *)malloc(2 * nfft * sizeof(float));
+        XCDETECT *loc = NULL;
+        int nloc = 0, maxloc = 0, fail = 0, p;
+
+        if (xf == NULL || z == NULL) {
+            #pragma omp atomic write
+            error = -1;
+            free(xf);
+            free(z);
+            continue;
+        }
+        for (k=0; k<nfft; k++) {
+            xf[2*k] = (b0 + k < n) ? x[b0+k] : 0.f;
+            xf[2*k+1] = 0.f;
+        }
+        fft_forward(t->plan, xf);
+
+        for (p=p0; p<p1 && !fail; p++) {
+            const float *s = t->spec + (size_t)p * 2 * nfft;
+            #pragma omp simd
+            for (k=0; k<nfft; k++) {
+                z[2*k]   = xf[2*k] * s[2*k]   - xf[2*k+1] * s[2*k+1];
+                z[2*k+1] = xf[2*k] * s[2*k+1] + xf[2*k+1] * s[2*k];
+            }
+            fft_inverse(t->plan, z);
+            for (i=0; i<2 && 2*p+i<t->ntemp && !fail; i++) {
+                for (k=0; k<nl; k++) {
+                    float cc = z[2*k+i] * rnorm[b0+k];
+                    if (cc < thresh) continue;
+                    if (nloc == maxloc) {
+                        int nmore = maxloc ? 2 * maxloc : 256;
+                        XCDETECT *tmp;
+                        /* loc and maxloc are kept if not enlarged */
+                        if ((tmp = (XCDETECT *)realloc(loc, nmore * sizeof(XCDETECT))) == NULL) {
+                            #pragma omp atomic write
+                            error = -1;
+                            fail = 1;
+                            break;
+                        }
+                        loc = tmp;
+                        maxloc = nmore;
+                    }
+                    loc[nloc].itemp = 2*p + i;
+                    loc[nloc].lag = b0 + k;
+                    loc[nloc].cc = cc;
+                    nloc++;
+                }
+            }
+        }
+
+        if (nloc > 0 && !fail) {
+            #pragma omp critical (xcorr_merge)
+            {
+                if (nd + nloc > nmax) {
+                    XCDETECT *tmp;
+                    if ((tmp = (XCDETECT *)realloc(all, 2 * (nd + nloc) * sizeof(XCDETECT))) == NULL) {
+                        error = -1;
+                    } else {
+                        all = tmp;
+                        nmax = 2 * (nd + nloc);
+                    }
+                }
+                if (!error) {
+                    memcpy(all + nd, loc, nloc * sizeof(XCDETECT));
+                    nd += nloc;
+                }
+            }
+        }
+        free(loc);
+        free(xf);
+        free(z);
+    }
+    free(rnorm);
+    if (error) {
+        fprintf(stderr, "Error in allocating memory for correlation\n");
+        free(all);
+        return -1;
+    }
+
+    /* lags above threshold of a template within m samples are one detection */
+    qsort(all, nd, sizeof(XCDETECT), compare_detect);
+    for (i=0, k=0; i<nd; i++) {
+        int prev = (i > 0) ? last : 0;
+        last = all[i].lag;
+        if (k > 0 && all[i].itemp == all[k-1].itemp && all[i].lag - prev <= m) {
+            if (all[i].cc > all[k-1].cc) all[k-1] = all[i];
+            continue;
+        }
+        all[k++] = all[i];
+    }
+    nd = k;
+    qsort(all, nd, sizeof(XCDETECT), compare_lag);
+
+    *det = all;
+    return nd;
+}
+
+/*
+ *  compare_detect: order detections by template, then by lag
+ */
+static int compare_detect(const void *a, const void *b)
+{
+    const XCDETECT *x = (const XCDETECT *)a;
+    const XCDETECT *y = (const XCDETECT *)b;
+
+    if (x->itemp != y->itemp) return (x->itemp > y->itemp) - (x->itemp < y->itemp);
+    return (x->lag > y->lag) - (x->lag < y->lag);
+}
+
+/*
+ *  compare_lag: order detections by lag, then by template
+ */
+static int compare_lag(const void *a, const void *b)
+{
+    const XCDETECT *x = (const XCDETECT *)a;
+    const XCDETECT *y = (const XCDETECT *)b;
+
+    if (x->lag != y->lag) return (x->lag > y->lag) - (x->lag < y->lag);
+    return (x->itemp > y->itemp) - (x->itemp < y->itemp);
+}
@@ -0,0 +1,27 @@
+/*
+ *  xcorr.h
+ *
+ *  Normalized cross-correlation of a batch of templates with long data.
+ *
+ */
+#ifndef _XCORR_H
+#define _XCORR_H
+
+/* templates correlated with a block of data by one task */
+#define XCORR_GROUP     32
+
+/* detection: template, lag of the first sample of template in data, cc */
+typedef struct {
+    int     itemp;
+    int     lag;
+    float   cc;
+} XCDETECT;
+
+typedef struct xcorr_templates XCTEMPLATES;
+
+XCTEMPLATES *xcorr_templates(int ntemp, float **tmpl, int m);
+void xcorr_templates_free(XCTEMPLATES *t);
+int xcorr_scan(const XCTEMPLATES *t, const float *x, int n, float thresh,
+               XCDETECT **det);
+
+#endif